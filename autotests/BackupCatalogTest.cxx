@@ -0,0 +1,286 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <BackupCatalog.hxx>
+#include <SliceIndex.hxx>
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+class BackupCatalogTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void init();
+    void roundTrip();
+    void removeRun();
+    void foundRun();
+    void synced();
+    void damagedEnd();
+    void noCatalog();
+
+  private:
+    // a full backup with two slices, and an incremental one with one
+    void writeRuns();
+
+  private:
+    QScopedPointer<QTemporaryDir> dir;
+    QString fileName;
+    QDateTime firstTime, secondTime, fileTime;
+};
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::init()
+{
+  dir.reset(new QTemporaryDir);
+  QVERIFY(dir->isValid());
+
+  fileName = dir->path() + QStringLiteral("/profile.catalog");
+  firstTime = QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1500000000123));
+  secondTime = firstTime.addDays(1);
+  fileTime = QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1400000000000));
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::writeRuns()
+{
+  BackupCatalog catalog;
+
+  SliceIndex index;
+  index.add(SliceIndex::Dir, QStringLiteral("home"), 0, 0, fileTime);
+  index.add(SliceIndex::File, QStringLiteral("home/a"), 512, 1000, fileTime);
+  index.add(SliceIndex::File, QStringLiteral("home/b.zst"), 2048, 30, fileTime);
+  index.setChecksum(7);
+
+  QVERIFY(catalog.startRun(fileName, QStringLiteral("/backups"), QStringLiteral("backup_1"), firstTime, false));
+  QVERIFY(catalog.isWriting());
+  catalog.addSlice(QStringLiteral("backup_1_01.tar"), index);
+
+  index.clear();
+  index.add(SliceIndex::Continued, QStringLiteral("home/a"), 0, 500, fileTime);
+  index.setChecksum(8);
+  catalog.addSlice(QStringLiteral("backup_1_02.tar"), index);
+  catalog.addFile(QStringLiteral("backup_1_02.tar.idx"));
+
+  QVERIFY2(catalog.finishRun(), qPrintable(catalog.errorString()));
+  QVERIFY(!catalog.isWriting());
+  QVERIFY(!QFile::exists(fileName + QStringLiteral(".new")));
+  QVERIFY(!QFile::exists(fileName + QStringLiteral(".paths")));
+
+  index.clear();
+  index.add(SliceIndex::File, QStringLiteral("home/a"), 512, 1200, fileTime.addDays(1));
+  QVERIFY(catalog.startRun(fileName, QStringLiteral("/backups"), QStringLiteral("backup_2"), secondTime, true));
+  catalog.addSlice(QStringLiteral("backup_2_01.tar"), index);
+  QVERIFY2(catalog.finishRun(), qPrintable(catalog.errorString()));
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::roundTrip()
+{
+  writeRuns();
+
+  BackupCatalog catalog;
+  QVERIFY2(catalog.open(fileName), qPrintable(catalog.errorString()));
+
+  const QVector<BackupCatalog::Run> runs = catalog.runs(QStringLiteral("/backups"));
+  QCOMPARE(runs.count(), 2);
+  QCOMPARE(runs[0].target, QStringLiteral("/backups"));
+  QCOMPARE(runs[0].name, QStringLiteral("backup_1"));
+  QCOMPARE(runs[0].startTime, firstTime);
+  QVERIFY(!runs[0].incremental);
+  QCOMPARE(runs[0].slices, QStringList() << QStringLiteral("backup_1_01.tar") << QStringLiteral("backup_1_02.tar"));
+  QCOMPARE(runs[0].files, QStringList() << QStringLiteral("backup_1_01.tar") << QStringLiteral("backup_1_02.tar")
+                                        << QStringLiteral("backup_1_02.tar.idx"));
+  QCOMPARE(runs[1].name, QStringLiteral("backup_2"));
+  QCOMPARE(runs[1].startTime, secondTime);
+  QVERIFY(runs[1].incremental);
+
+  QVERIFY(catalog.runs(QStringLiteral("/elsewhere")).isEmpty());
+
+  // every part of the file, the oldest first
+  const QVector<BackupCatalog::Version> versions = catalog.lookup(QStringLiteral("home/a"));
+  QCOMPARE(versions.count(), 3);
+
+  QCOMPARE(versions[0].run.name, QStringLiteral("backup_1"));
+  QCOMPARE(versions[0].slice, 0);
+  QCOMPARE(versions[0].type, 'f');
+  QCOMPARE(versions[0].offset, Q_INT64_C(512));
+  QCOMPARE(versions[0].size, Q_INT64_C(1000));
+  QCOMPARE(versions[0].mtime, QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1400000000000)));
+  QCOMPARE(versions[0].hash, Q_UINT64_C(0));
+
+  QCOMPARE(versions[1].run.name, QStringLiteral("backup_1"));
+  QCOMPARE(versions[1].slice, 1);
+  QCOMPARE(versions[1].type, 'c');
+  QCOMPARE(versions[1].size, Q_INT64_C(500));
+  QCOMPARE(versions[1].hash, Q_UINT64_C(8));
+
+  QCOMPARE(versions[2].run.name, QStringLiteral("backup_2"));
+  QCOMPARE(versions[2].slice, 0);
+  QCOMPARE(versions[2].size, Q_INT64_C(1200));
+
+  // a member stored compressed
+  const QVector<BackupCatalog::Version> compressed = catalog.lookup(QStringLiteral("home/b"));
+  QCOMPARE(compressed.count(), 1);
+  QCOMPARE(compressed[0].offset, Q_INT64_C(2048));
+  QCOMPARE(compressed[0].hash, Q_UINT64_C(7));
+
+  QCOMPARE(catalog.lookup(QStringLiteral("home")).count(), 1);
+  QVERIFY(catalog.lookup(QStringLiteral("home/c")).isEmpty());
+  QVERIFY(catalog.lookup(QStringLiteral("home/a.gz")).isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::removeRun()
+{
+  writeRuns();
+
+  BackupCatalog catalog;
+  QVERIFY(catalog.open(fileName));
+  const BackupCatalog::Run first = catalog.runs(QStringLiteral("/backups")).first();
+
+  QVERIFY2(catalog.removeRun(fileName, first), qPrintable(catalog.errorString()));
+
+  QVERIFY(catalog.open(fileName));
+  const QVector<BackupCatalog::Run> runs = catalog.runs(QStringLiteral("/backups"));
+  QCOMPARE(runs.count(), 1);
+  QCOMPARE(runs[0].name, QStringLiteral("backup_2"));
+
+  const QVector<BackupCatalog::Version> versions = catalog.lookup(QStringLiteral("home/a"));
+  QCOMPARE(versions.count(), 1);
+  QCOMPARE(versions[0].run.name, QStringLiteral("backup_2"));
+  QVERIFY(catalog.lookup(QStringLiteral("home/b")).isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::foundRun()
+{
+  writeRuns();
+
+  BackupCatalog::Run found;
+  found.target = QStringLiteral("/backups");
+  found.name = QStringLiteral("backup_0");
+  found.startTime = firstTime.addDays(-1);
+  found.incremental = false;
+  found.slices << QStringLiteral("backup_0_01.tar");
+  found.files = found.slices;
+
+  BackupCatalog catalog;
+  QVERIFY2(catalog.addFoundRun(fileName, found), qPrintable(catalog.errorString()));
+
+  // sorted in by its start time, but without members
+  QVERIFY(catalog.open(fileName));
+  const QVector<BackupCatalog::Run> runs = catalog.runs(QStringLiteral("/backups"));
+  QCOMPARE(runs.count(), 3);
+  QCOMPARE(runs[0].name, QStringLiteral("backup_0"));
+  QCOMPARE(runs[0].slices, found.slices);
+  QCOMPARE(runs[1].name, QStringLiteral("backup_1"));
+  QCOMPARE(catalog.lookup(QStringLiteral("home/a")).count(), 3);
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::synced()
+{
+  writeRuns();
+
+  BackupCatalog catalog;
+  QVERIFY(catalog.open(fileName));
+  QVERIFY(!catalog.isSynced(QStringLiteral("/backups")));
+
+  QVERIFY2(catalog.markSynced(fileName, QStringLiteral("/backups")), qPrintable(catalog.errorString()));
+
+  QVERIFY(catalog.open(fileName));
+  QVERIFY(catalog.isSynced(QStringLiteral("/backups")));
+  QVERIFY(!catalog.isSynced(QStringLiteral("/other")));
+
+  // the mark is no backup
+  const QVector<BackupCatalog::Run> runs = catalog.runs(QStringLiteral("/backups"));
+  QCOMPARE(runs.count(), 2);
+  QCOMPARE(runs[0].name, QStringLiteral("backup_1"));
+  QCOMPARE(runs[1].name, QStringLiteral("backup_2"));
+  QCOMPARE(catalog.lookup(QStringLiteral("home/a")).count(), 2);
+
+  // a new catalog has to be synced again
+  catalog.close();
+  QVERIFY(QFile::remove(fileName));
+  writeRuns();
+  QVERIFY(catalog.open(fileName));
+  QVERIFY(!catalog.isSynced(QStringLiteral("/backups")));
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::damagedEnd()
+{
+  writeRuns();
+
+  // e.g. a crash while a run was appended
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::Append));
+  const qint64 validSize = file.size();
+  file.write(QByteArray(100, 'x'));
+  file.close();
+
+  BackupCatalog catalog;
+  QVERIFY(catalog.open(fileName));
+  QCOMPARE(catalog.runs(QStringLiteral("/backups")).count(), 2);
+
+  // the next run replaces the damaged part
+  SliceIndex index;
+  index.add(SliceIndex::File, QStringLiteral("home/a"), 512, 1300, fileTime);
+  QVERIFY(catalog.startRun(fileName, QStringLiteral("/backups"), QStringLiteral("backup_3"), secondTime.addDays(1), true));
+  catalog.addSlice(QStringLiteral("backup_3_01.tar"), index);
+  QVERIFY2(catalog.finishRun(), qPrintable(catalog.errorString()));
+
+  QVERIFY(catalog.open(fileName));
+  QCOMPARE(catalog.runs(QStringLiteral("/backups")).count(), 3);
+  QCOMPARE(catalog.lookup(QStringLiteral("home/a")).count(), 4);
+  QCOMPARE(catalog.lookup(QStringLiteral("home/a")).last().size, Q_INT64_C(1300));
+
+  QVERIFY(file.size() > validSize);
+  QCOMPARE(file.size() % 8, Q_INT64_C(0));
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalogTest::noCatalog()
+{
+  BackupCatalog catalog;
+
+  // no catalog yet is no error
+  QVERIFY(!catalog.open(fileName));
+  QVERIFY(catalog.errorString().isEmpty());
+  QVERIFY(catalog.lookup(QStringLiteral("home/a")).isEmpty());
+
+  // another file is left alone
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write("no catalog");
+  file.close();
+
+  QVERIFY(!catalog.open(fileName));
+  QVERIFY(!catalog.errorString().isEmpty());
+
+  QVERIFY(catalog.startRun(fileName, QStringLiteral("/backups"), QStringLiteral("backup_1"), firstTime, false));
+  QVERIFY(!catalog.finishRun());
+  QCOMPARE(file.size(), Q_INT64_C(10));
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(BackupCatalogTest)
+
+#include "BackupCatalogTest.moc"
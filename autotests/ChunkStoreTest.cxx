@@ -0,0 +1,437 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <ChunkStore.hxx>
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QDirIterator>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+// the chunk sizes of ChunkStore.cxx
+static const int MIN_CHUNK = 16 * 1024;
+static const int MAX_CHUNK = 256 * 1024;
+
+class ChunkStoreTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void init();
+    void boundaries();
+    void sameContent();
+    void insertion();
+    void unchangedFiles();
+    void restore();
+
+  private:
+    static QByteArray randomData(int size, quint64 seed);
+    static FileEntry fileEntry(const QString &path, qint64 size);
+    bool storeSnapshot(const QString &name, const QList<QPair<FileEntry, QByteArray>> &files);
+    QVector<ChunkStore::ChunkRecord> chunkIndex() const;
+    static bool writeFile(const QString &path, const QByteArray &data, mode_t mode, qint64 mtime);
+    static QString linkTarget(const QString &path);
+    bool storeTree(const QString &name, const QString &root, bool unchanged);
+    static void compareTrees(const QString &source, const QString &restored);
+
+  private:
+    QScopedPointer<QTemporaryDir> dir;
+    ChunkStore store;
+};
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::init()
+{
+  dir.reset(new QTemporaryDir);
+  QVERIFY(dir->isValid());
+  QVERIFY2(store.open(dir->path()), qPrintable(store.errorString()));
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray ChunkStoreTest::randomData(int size, quint64 seed)
+{
+  // splitmix64, the same bytes on every run
+  QByteArray data(size + 8, 0);
+
+  for (int i = 0; i < size; i += 8)
+  {
+    quint64 z = (seed += Q_UINT64_C(0x9e3779b97f4a7c15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+    z ^= (z >> 31);
+    memcpy(data.data() + i, &z, 8);
+  }
+
+  data.truncate(size);
+  return data;
+}
+
+//--------------------------------------------------------------------------------
+
+FileEntry ChunkStoreTest::fileEntry(const QString &path, qint64 size)
+{
+  FileEntry entry;
+  entry.path = path;
+  entry.name = path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+  entry.mode = S_IFREG | 0644;
+  entry.uid = ::getuid();
+  entry.gid = ::getgid();
+  entry.size = size;
+  entry.mtime = Q_INT64_C(1500000000000);
+  entry.ctime = entry.mtime;
+  return entry;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStoreTest::storeSnapshot(const QString &name, const QList<QPair<FileEntry, QByteArray>> &files)
+{
+  if ( !store.startSnapshot(name) )
+    return false;
+
+  for (int i = 0; i < files.count(); i++)
+  {
+    store.startFile(files[i].first);
+
+    // in pieces, as the archiver passes them
+    const QByteArray &data = files[i].second;
+    for (int pos = 0; pos < data.size(); pos += 100000)
+    {
+      if ( !store.writeData(data.constData() + pos, qMin(100000, data.size() - pos)) )
+        return false;
+    }
+
+    if ( !store.finishFile() )
+      return false;
+  }
+
+  return store.finishSnapshot();
+}
+
+//--------------------------------------------------------------------------------
+
+QVector<ChunkStore::ChunkRecord> ChunkStoreTest::chunkIndex() const
+{
+  QVector<ChunkStore::ChunkRecord> records;
+
+  QFile file(dir->path() + QStringLiteral("/chunks.idx"));
+  if ( !file.open(QIODevice::ReadOnly) )
+    return records;
+
+  // behind the magic and the count
+  const QByteArray data = file.readAll();
+  const int num = (data.size() - 16) / static_cast<int>(sizeof(ChunkStore::ChunkRecord));
+
+  records.resize(num);
+  memcpy(records.data(), data.constData() + 16, num * sizeof(ChunkStore::ChunkRecord));
+
+  return records;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStoreTest::writeFile(const QString &path, const QByteArray &data, mode_t mode, qint64 mtime)
+{
+  QFile file(path);
+  if ( !file.open(QIODevice::WriteOnly) || (file.write(data) != data.size()) )
+    return false;
+
+  file.close();
+
+  struct timeval times[2];
+  times[0].tv_sec = times[1].tv_sec = mtime / 1000;
+  times[0].tv_usec = times[1].tv_usec = (mtime % 1000) * 1000;
+
+  return (::chmod(QFile::encodeName(path).constData(), mode) == 0) &&
+         (::utimes(QFile::encodeName(path).constData(), times) == 0);
+}
+
+//--------------------------------------------------------------------------------
+
+QString ChunkStoreTest::linkTarget(const QString &path)
+{
+  // QFile::symLinkTarget() would make it absolute
+  char target[4096];
+  const ssize_t len = ::readlink(QFile::encodeName(path).constData(), target, sizeof(target));
+
+  return (len > 0) ? QFile::decodeName(QByteArray(target, static_cast<int>(len))) : QString();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStoreTest::storeTree(const QString &name, const QString &root, bool unchanged)
+{
+  if ( !store.startSnapshot(name) )
+    return false;
+
+  // parents before their content, as the archiver walks the tree
+  QStringList paths(root);
+  QDirIterator it(root, QDir::AllEntries | QDir::System | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+  while ( it.hasNext() )
+    paths.append(it.next());
+
+  paths.sort();
+
+  foreach (const QString &path, paths)
+  {
+    const FileEntry entry(path);
+
+    if ( entry.isDir() )
+    {
+      if ( !store.addDir(entry) )
+        return false;
+    }
+    else if ( entry.isSymLink() )
+    {
+      if ( !store.addSymLink(entry, linkTarget(path)) )
+        return false;
+    }
+    else if ( !unchanged || !store.addUnchangedFile(entry) )
+    {
+      QFile file(path);
+      if ( !file.open(QIODevice::ReadOnly) )
+        return false;
+
+      const QByteArray data = file.readAll();
+
+      store.startFile(entry);
+      if ( !store.writeData(data.constData(), data.size()) || !store.finishFile() )
+        return false;
+    }
+  }
+
+  return store.finishSnapshot();
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::compareTrees(const QString &source, const QString &restored)
+{
+  // below its absolute path
+  const QString copy = restored + source;
+
+  QStringList paths(source);
+  QDirIterator it(source, QDir::AllEntries | QDir::System | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+  while ( it.hasNext() )
+    paths.append(it.next());
+
+  QStringList copies(source);
+  QDirIterator copyIt(copy, QDir::AllEntries | QDir::System | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+  while ( copyIt.hasNext() )
+    copies.append(copyIt.next().mid(restored.length()));
+
+  paths.sort();
+  copies.sort();
+  QCOMPARE(copies, paths);
+
+  foreach (const QString &path, paths)
+  {
+    const FileEntry original(path);
+    const FileEntry entry(restored + path);
+
+    QCOMPARE(entry.error, 0);
+    QCOMPARE(entry.mode, original.mode);
+
+    if ( entry.isSymLink() )
+    {
+      QCOMPARE(linkTarget(entry.path), linkTarget(path));
+      continue;
+    }
+
+    QCOMPARE(entry.mtime, original.mtime);
+
+    if ( !entry.isDir() )
+    {
+      QCOMPARE(entry.size, original.size);
+
+      QFile a(path), b(entry.path);
+      QVERIFY(a.open(QIODevice::ReadOnly));
+      QVERIFY(b.open(QIODevice::ReadOnly));
+      QVERIFY2(a.readAll() == b.readAll(), qPrintable(path));
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::boundaries()
+{
+  const QByteArray data = randomData(4 * 1024 * 1024 + 1234, 1);
+
+  QVERIFY2(storeSnapshot(QStringLiteral("1"), QList<QPair<FileEntry, QByteArray>>()
+                           << qMakePair(fileEntry(QStringLiteral("/data"), data.size()), data)),
+           qPrintable(store.errorString()));
+
+  QCOMPARE(store.getContentBytes(), static_cast<quint64>(data.size()));
+  QCOMPARE(store.getNewBytes(), static_cast<quint64>(data.size()));
+
+  const QVector<ChunkStore::ChunkRecord> records = chunkIndex();
+  QVERIFY(records.count() > data.size() / MAX_CHUNK);
+  QVERIFY(records.count() < data.size() / MIN_CHUNK);
+
+  // only the chunk at the end of the file may be shorter than the minimum
+  qint64 sum = 0;
+  int small = 0;
+  foreach (const ChunkStore::ChunkRecord &rec, records)
+  {
+    QVERIFY(rec.length <= static_cast<quint32>(MAX_CHUNK));
+    if ( rec.length < static_cast<quint32>(MIN_CHUNK) )
+      small++;
+
+    sum += rec.length;
+  }
+
+  QVERIFY(small <= 1);
+  QCOMPARE(sum, static_cast<qint64>(data.size()));
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::sameContent()
+{
+  const QByteArray data = randomData(2 * 1024 * 1024, 2);
+  const FileEntry entry = fileEntry(QStringLiteral("/data"), data.size());
+
+  QVERIFY(storeSnapshot(QStringLiteral("1"), QList<QPair<FileEntry, QByteArray>>() << qMakePair(entry, data)));
+  const int chunks = chunkIndex().count();
+
+  // the same cuts again, under another name, too
+  QVERIFY(storeSnapshot(QStringLiteral("2"), QList<QPair<FileEntry, QByteArray>>()
+                          << qMakePair(entry, data)
+                          << qMakePair(fileEntry(QStringLiteral("/copy"), data.size()), data)));
+
+  QCOMPARE(store.getContentBytes(), static_cast<quint64>(2 * data.size()));
+  QCOMPARE(store.getNewBytes(), Q_UINT64_C(0));
+  QCOMPARE(chunkIndex().count(), chunks);
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::insertion()
+{
+  const QByteArray data = randomData(4 * 1024 * 1024, 3);
+  QVERIFY(storeSnapshot(QStringLiteral("1"), QList<QPair<FileEntry, QByteArray>>()
+                          << qMakePair(fileEntry(QStringLiteral("/data"), data.size()), data)));
+
+  QByteArray changed = data;
+  changed.insert(1000000, randomData(1000, 4));
+
+  QVERIFY(storeSnapshot(QStringLiteral("2"), QList<QPair<FileEntry, QByteArray>>()
+                          << qMakePair(fileEntry(QStringLiteral("/data"), changed.size()), changed)));
+
+  // the cuts behind the insertion are found again; only the chunks around it are new
+  QVERIFY(store.getNewBytes() > 0);
+  QVERIFY(store.getNewBytes() < static_cast<quint64>(2 * MAX_CHUNK + 1000));
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::unchangedFiles()
+{
+  const QByteArray data = randomData(300000, 5);
+  FileEntry a = fileEntry(QStringLiteral("/dir/a"), data.size());
+  FileEntry b = fileEntry(QStringLiteral("/dir/b"), 0);
+
+  QVERIFY(storeSnapshot(QStringLiteral("1"), QList<QPair<FileEntry, QByteArray>>()
+                          << qMakePair(a, data) << qMakePair(b, QByteArray())));
+
+  // the next snapshot finds them in the table of the last one
+  QVERIFY(store.startSnapshot(QStringLiteral("2")));
+  QVERIFY(store.addUnchangedFile(a));
+  QVERIFY(store.addUnchangedFile(b));
+
+  FileEntry changed = a;
+  changed.mtime += 1000;
+  QVERIFY(!store.addUnchangedFile(changed));
+  changed = a;
+  changed.ctime += 1000;
+  QVERIFY(!store.addUnchangedFile(changed));
+  QVERIFY(!store.addUnchangedFile(fileEntry(QStringLiteral("/dir/c"), data.size())));
+
+  QVERIFY2(store.finishSnapshot(), qPrintable(store.errorString()));
+  QCOMPARE(store.getContentBytes(), static_cast<quint64>(data.size()));
+  QCOMPARE(store.getNewBytes(), Q_UINT64_C(0));
+
+  // and the snapshot made of them has a table as well
+  QVERIFY(store.startSnapshot(QStringLiteral("3")));
+  QVERIFY(store.addUnchangedFile(a));
+  QVERIFY(store.addUnchangedFile(b));
+  QVERIFY(store.finishSnapshot());
+
+  QVERIFY(QFile::exists(dir->path() + QStringLiteral("/snapshots/3.snap")));
+  QVERIFY(!QFile::exists(dir->path() + QStringLiteral("/snapshots/3.snap.files")));
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStoreTest::restore()
+{
+  QTemporaryDir source, restored, damaged;
+  QVERIFY(source.isValid() && restored.isValid() && damaged.isValid());
+
+  // a tree with everything a snapshot holds
+  const QString root = source.path() + QStringLiteral("/tree");
+  QVERIFY(QDir().mkpath(root + QStringLiteral("/sub/deeper")));
+  QVERIFY(QDir().mkpath(root + QStringLiteral("/empty")));
+
+  const QByteArray large = randomData(3 * 1024 * 1024 + 77, 6);
+  QVERIFY(writeFile(root + QStringLiteral("/sub/deeper/large"), large, 0600, Q_INT64_C(1400000000123)));
+  QVERIFY(writeFile(root + QStringLiteral("/sub/copy"), large, 0644, Q_INT64_C(1400000000456)));
+  QVERIFY(writeFile(root + QStringLiteral("/small"), QByteArray("small file\n"), 0755, Q_INT64_C(1300000000000)));
+  QVERIFY(writeFile(root + QStringLiteral("/nothing"), QByteArray(), 0640, Q_INT64_C(1200000000000)));
+  QVERIFY(::symlink("sub/deeper/large", QFile::encodeName(root + QStringLiteral("/link")).constData()) == 0);
+  QVERIFY(::symlink("/nonexistent", QFile::encodeName(root + QStringLiteral("/sub/dangling")).constData()) == 0);
+  QVERIFY(::chmod(QFile::encodeName(root + QStringLiteral("/empty")).constData(), 0700) == 0);
+
+  QVERIFY2(storeTree(QStringLiteral("1"), root, false), qPrintable(store.errorString()));
+
+  // the copy is found among the chunks stored just before
+  QCOMPARE(store.getNewBytes(), static_cast<quint64>(large.size() + 11));
+  QVERIFY(!QFile::exists(dir->path() + QStringLiteral("/chunks.idx.added")));
+
+  // the second snapshot takes the chunks of the unchanged files from the first
+  QVERIFY2(storeTree(QStringLiteral("2"), root, true), qPrintable(store.errorString()));
+  QCOMPARE(store.getNewBytes(), Q_UINT64_C(0));
+
+  QVERIFY2(store.restoreSnapshot(dir->path() + QStringLiteral("/snapshots/2.snap"), restored.path()),
+           qPrintable(store.errorString()));
+  compareTrees(root, restored.path());
+
+  // a damaged chunk is found, and everything else is still restored.
+  // The last byte belongs to the large file; the small one was stored first
+  QFile pack(dir->path() + QStringLiteral("/packs/00000000.pack"));
+  QVERIFY(pack.open(QIODevice::ReadWrite));
+  QVERIFY(pack.seek(pack.size() - 1));
+  QByteArray byte = pack.read(1);
+  byte[0] = static_cast<char>(byte[0] ^ 1);
+  QVERIFY(pack.seek(pack.size() - 1) && (pack.write(byte) == 1));
+  pack.close();
+
+  QVERIFY(!store.restoreSnapshot(dir->path() + QStringLiteral("/snapshots/1.snap"), damaged.path()));
+  QVERIFY(store.errorString().contains(QStringLiteral("damaged")));
+
+  const QString small = damaged.path() + root + QStringLiteral("/small");
+  QVERIFY(QFile::exists(small));
+  QCOMPARE(FileEntry(small).mtime, Q_INT64_C(1300000000000));
+
+  // no repository around it
+  QVERIFY(!store.restoreSnapshot(dir->path() + QStringLiteral("/nothing.snap"), restored.path()));
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(ChunkStoreTest)
+
+#include "ChunkStoreTest.moc"
@@ -0,0 +1,227 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <FileIndex.hxx>
+#include <FileEntry.hxx>
+#include <ContentHash.hxx>
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include <unistd.h>
+
+class FileIndexTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void init();
+    void roundTrip();
+    void hardLinks();
+    void replace();
+    void invalid();
+
+  private:
+    FileEntry createFile(const QString &name, const QByteArray &content);
+    static quint64 hashOf(const QByteArray &content);
+
+  private:
+    QScopedPointer<QTemporaryDir> dir;
+};
+
+//--------------------------------------------------------------------------------
+
+void FileIndexTest::init()
+{
+  dir.reset(new QTemporaryDir);
+  QVERIFY(dir->isValid());
+}
+
+//--------------------------------------------------------------------------------
+
+FileEntry FileIndexTest::createFile(const QString &name, const QByteArray &content)
+{
+  QFile file(dir->path() + QLatin1Char('/') + name);
+  if ( file.open(QIODevice::WriteOnly) )
+    file.write(content);
+  file.close();
+
+  return FileEntry(file.fileName());
+}
+
+//--------------------------------------------------------------------------------
+
+quint64 FileIndexTest::hashOf(const QByteArray &content)
+{
+  ContentHash hash;
+  hash.addData(content.constData(), content.size());
+  return hash.result();
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndexTest::roundTrip()
+{
+  const QString indexName = dir->path() + QStringLiteral("/backup.idx");
+
+  QList<FileEntry> entries;
+  entries << createFile(QStringLiteral("a"), "first")
+          << createFile(QStringLiteral("b"), QByteArray(100000, 'x'))
+          << createFile(QString::fromUtf8("\xc3\xa4 with blanks"), QByteArray())
+          << createFile(QStringLiteral("not hashed"), "content");
+
+  foreach (const FileEntry &entry, entries)
+    QCOMPARE(entry.error, 0);
+
+  FileIndex index;
+  QVERIFY(!index.open(indexName));  // no index yet is no error
+  QVERIFY(index.errorString().isEmpty());
+
+  QVERIFY(index.startWriting(indexName));
+  index.add(entries[0], hashOf("first"));
+  index.add(entries[1], hashOf(QByteArray(100000, 'x')));
+  index.add(entries[2], hashOf(QByteArray()));
+  index.add(entries[3]);
+  QVERIFY2(index.finishWriting(), qPrintable(index.errorString()));
+
+  QVERIFY(!QFile::exists(indexName + QStringLiteral(".new")));
+  QVERIFY(!QFile::exists(indexName + QStringLiteral(".paths")));
+
+  QVERIFY2(index.open(indexName), qPrintable(index.errorString()));
+  QVERIFY(index.isOpen());
+
+  for (int i = 0; i < entries.count(); i++)
+  {
+    const qint64 pos = index.find(entries[i]);
+    QVERIFY(pos != -1);
+
+    const FileIndex::Record &rec = index.record(pos);
+    QCOMPARE(rec.device, static_cast<quint64>(entries[i].device));
+    QCOMPARE(rec.inode, static_cast<quint64>(entries[i].inode));
+    QCOMPARE(rec.pathHash, FileIndex::hashPath(entries[i].path));
+    QCOMPARE(rec.size, entries[i].size);
+    QCOMPARE(rec.mtime, entries[i].mtime);
+    QCOMPARE(rec.ctime, entries[i].ctime);
+    QVERIFY(index.isUnchanged(pos, entries[i]));
+  }
+
+  QCOMPARE(index.contentHash(index.find(entries[0])), hashOf("first"));
+  QCOMPARE(index.contentHash(index.find(entries[2])), hashOf(QByteArray()));
+  QCOMPARE(index.contentHash(index.find(entries[3])), Q_UINT64_C(0));
+
+  // a changed file is found, but not unchanged
+  FileEntry changed = entries[1];
+  changed.size++;
+  QVERIFY(!index.isUnchanged(index.find(changed), changed));
+  changed = entries[1];
+  changed.ctime++;
+  QVERIFY(!index.isUnchanged(index.find(changed), changed));
+
+  // a new file, and a known inode under another name
+  QCOMPARE(index.find(createFile(QStringLiteral("new"), "new")), Q_INT64_C(-1));
+  FileEntry moved = entries[0];
+  moved.path = dir->path() + QStringLiteral("/moved");
+  QCOMPARE(index.find(moved), Q_INT64_C(-1));
+
+  QCOMPARE(index.unseenPaths().count(), entries.count());
+  index.markSeen(index.find(entries[0]));
+  index.markSeen(index.find(entries[2]));
+  QCOMPARE(index.unseenPaths(), QStringList() << entries[1].path << entries[3].path);
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndexTest::hardLinks()
+{
+  const QString indexName = dir->path() + QStringLiteral("/backup.idx");
+
+  const FileEntry first = createFile(QStringLiteral("first"), "shared");
+  const QString secondPath = dir->path() + QStringLiteral("/second");
+  QCOMPARE(::link(QFile::encodeName(first.path).constData(), QFile::encodeName(secondPath).constData()), 0);
+  const FileEntry second(secondPath);
+  QCOMPARE(second.inode, first.inode);
+
+  FileIndex index;
+  QVERIFY(index.startWriting(indexName));
+  index.add(first, 1);
+  index.add(second, 2);
+  QVERIFY(index.finishWriting());
+  QVERIFY(index.open(indexName));
+
+  // the same inode, but a record per name
+  const qint64 firstPos = index.find(first);
+  const qint64 secondPos = index.find(second);
+  QVERIFY(firstPos != -1);
+  QVERIFY(secondPos != -1);
+  QVERIFY(firstPos != secondPos);
+  QCOMPARE(index.record(firstPos).hash, Q_UINT64_C(1));
+  QCOMPARE(index.record(secondPos).hash, Q_UINT64_C(2));
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndexTest::replace()
+{
+  const QString indexName = dir->path() + QStringLiteral("/backup.idx");
+
+  const FileEntry kept = createFile(QStringLiteral("kept"), "kept");
+  const FileEntry removed = createFile(QStringLiteral("removed"), "removed");
+
+  FileIndex index;
+  QVERIFY(index.startWriting(indexName));
+  index.add(kept);
+  index.add(removed);
+  QVERIFY(index.finishWriting());
+
+  // the next backup reads the last index while it writes its own
+  QVERIFY(index.open(indexName));
+  QVERIFY(index.startWriting(indexName));
+  index.add(kept);
+  QVERIFY(index.finishWriting());
+  QVERIFY(!index.isOpen());
+
+  QVERIFY(index.open(indexName));
+  QVERIFY(index.find(kept) != -1);
+  QCOMPARE(index.find(removed), Q_INT64_C(-1));
+
+  // a cancelled backup leaves the index alone
+  QVERIFY(index.startWriting(indexName));
+  index.add(removed);
+  index.discardWriting();
+  QVERIFY(!QFile::exists(indexName + QStringLiteral(".new")));
+  QVERIFY(!QFile::exists(indexName + QStringLiteral(".paths")));
+
+  QVERIFY(index.open(indexName));
+  QVERIFY(index.find(kept) != -1);
+  QCOMPARE(index.find(removed), Q_INT64_C(-1));
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndexTest::invalid()
+{
+  const QString indexName = dir->path() + QStringLiteral("/backup.idx");
+
+  QFile file(indexName);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write(QByteArray(1000, 'x'));
+  file.close();
+
+  FileIndex index;
+  QVERIFY(!index.open(indexName));
+  QVERIFY(!index.errorString().isEmpty());
+  QVERIFY(!index.isOpen());
+  QCOMPARE(index.find(createFile(QStringLiteral("a"), "a")), Q_INT64_C(-1));
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(FileIndexTest)
+
+#include "FileIndexTest.moc"
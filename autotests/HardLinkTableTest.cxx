@@ -0,0 +1,171 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <HardLinkTable.hxx>
+#include <FileEntry.hxx>
+
+#include <QtTest>
+
+class HardLinkTableTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void pending();
+    void sameSlice();
+    void otherSlice();
+    void retarget();
+    void allNamesSeen();
+    void failed();
+
+  private:
+    static FileEntry entry(const QString &path, ino_t inode, nlink_t links);
+};
+
+//--------------------------------------------------------------------------------
+
+FileEntry HardLinkTableTest::entry(const QString &path, ino_t inode, nlink_t links)
+{
+  FileEntry entry;
+  entry.path = path;
+  entry.mode = S_IFREG | 0644;
+  entry.device = 1;
+  entry.inode = inode;
+  entry.links = links;
+  return entry;
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::pending()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  // the first name gets the content
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 3), QStringLiteral("a"), 1, slice).isEmpty());
+
+  // queued, but not written yet
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/b"), 10, 3), QStringLiteral("b"), 1, slice), QStringLiteral("a"));
+  QCOMPARE(slice, static_cast<int>(HardLinkTable::PENDING));
+
+  // another inode, and the same inode on another device
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/c"), 11, 3), QStringLiteral("c"), 1, slice).isEmpty());
+  FileEntry other = entry(QStringLiteral("/d"), 10, 3);
+  other.device = 2;
+  QVERIFY(table.linkTarget(other, QStringLiteral("d"), 1, slice).isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::sameSlice()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 3), QStringLiteral("a"), 2, slice).isEmpty());
+  table.stored(entry(QStringLiteral("/a"), 10, 3), QStringLiteral("a"), 2);
+
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/b"), 10, 3), QStringLiteral("b"), 2, slice), QStringLiteral("a"));
+  QCOMPARE(slice, 2);
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::otherSlice()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 4), QStringLiteral("a"), 1, slice).isEmpty());
+  table.stored(entry(QStringLiteral("/a"), 10, 4), QStringLiteral("a"), 1);
+
+  // a link into the last slice could not be extracted; the name is stored again
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/b"), 10, 4), QStringLiteral("b"), 2, slice).isEmpty());
+
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/c"), 10, 4), QStringLiteral("c"), 2, slice), QStringLiteral("b"));
+  QCOMPARE(slice, static_cast<int>(HardLinkTable::PENDING));
+
+  table.stored(entry(QStringLiteral("/b"), 10, 4), QStringLiteral("b"), 2);
+
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/d"), 10, 4), QStringLiteral("d"), 2, slice), QStringLiteral("b"));
+  QCOMPARE(slice, 2);
+
+  // the fourth name dropped the entry, although the target moved
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/e"), 10, 5), QStringLiteral("e"), 2, slice).isEmpty());
+  table.stored(entry(QStringLiteral("/e"), 10, 5), QStringLiteral("e"), 2);
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/f"), 10, 5), QStringLiteral("f"), 2, slice), QStringLiteral("e"));
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::retarget()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 4), QStringLiteral("a"), 1, slice).isEmpty());
+  table.stored(entry(QStringLiteral("/a"), 10, 4), QStringLiteral("a"), 1);
+
+  // the link did not fit into the slice; the name is stored in the next one
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/b"), 10, 4), QStringLiteral("b"), 1, slice), QStringLiteral("a"));
+  table.retarget(entry(QStringLiteral("/b"), 10, 4), QStringLiteral("b"));
+  table.stored(entry(QStringLiteral("/b"), 10, 4), QStringLiteral("b"), 2);
+
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/c"), 10, 4), QStringLiteral("c"), 2, slice), QStringLiteral("b"));
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/d"), 10, 4), QStringLiteral("d"), 2, slice), QStringLiteral("b"));
+
+  // dropped after the fourth name; retarget() does not bring it back
+  table.retarget(entry(QStringLiteral("/d"), 10, 4), QStringLiteral("d"));
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/e"), 10, 5), QStringLiteral("e"), 2, slice).isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::allNamesSeen()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 3), QStringLiteral("a"), 1, slice).isEmpty());
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/b"), 10, 3), QStringLiteral("b"), 1, slice), QStringLiteral("a"));
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/c"), 10, 3), QStringLiteral("c"), 1, slice), QStringLiteral("a"));
+
+  // dropped with the last name; a link created during the backup is stored in full
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/d"), 10, 4), QStringLiteral("d"), 1, slice).isEmpty());
+
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/e"), 10, 4), QStringLiteral("e"), 1, slice), QStringLiteral("d"));
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTableTest::failed()
+{
+  HardLinkTable table;
+  int slice = 0;
+
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/a"), 10, 3), QStringLiteral("a"), 1, slice).isEmpty());
+  table.failed(entry(QStringLiteral("/a"), 10, 3));
+
+  // the next name gets the content
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/b"), 10, 3), QStringLiteral("b"), 1, slice).isEmpty());
+  QCOMPARE(table.linkTarget(entry(QStringLiteral("/c"), 10, 3), QStringLiteral("c"), 1, slice), QStringLiteral("b"));
+
+  // all three names were counted
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/d"), 10, 4), QStringLiteral("d"), 1, slice).isEmpty());
+
+  table.clear();
+  QVERIFY(table.linkTarget(entry(QStringLiteral("/e"), 10, 4), QStringLiteral("e"), 1, slice).isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(HardLinkTableTest)
+
+#include "HardLinkTableTest.moc"
@@ -0,0 +1,131 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <PathTrie.hxx>
+
+#include <QtTest>
+
+class PathTrieTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void empty();
+    void find();
+    void walk();
+    void root();
+};
+
+//--------------------------------------------------------------------------------
+
+void PathTrieTest::empty()
+{
+  PathTrie trie;
+
+  QVERIFY(trie.isEmpty());
+  QVERIFY(!trie.find(QStringLiteral("/")));
+  QVERIFY(!trie.find(QStringLiteral("/home")));
+
+  trie.insert(QStringLiteral("/home/user/tmp"), true);
+  QVERIFY(!trie.isEmpty());
+
+  trie.clear();
+  QVERIFY(trie.isEmpty());
+  QVERIFY(!trie.find(QStringLiteral("/home/user/tmp")));
+}
+
+//--------------------------------------------------------------------------------
+
+void PathTrieTest::find()
+{
+  PathTrie trie;
+  trie.insert(QStringLiteral("/home/user/tmp"), true);
+  trie.insert(QStringLiteral("/home/user/notes.txt"), false);
+  trie.insert(QStringLiteral("/var"), true);
+
+  // the directories on the way are no exclusions themselves
+  const PathTrie::Node *home = trie.find(QStringLiteral("/home"));
+  QVERIFY(home);
+  QVERIFY(!home->isExcludedDir());
+  QVERIFY(!home->isExcludedFile());
+
+  const PathTrie::Node *tmp = trie.find(QStringLiteral("/home/user/tmp"));
+  QVERIFY(tmp);
+  QVERIFY(tmp->isExcludedDir());
+  QVERIFY(!tmp->isExcludedFile());
+
+  const PathTrie::Node *notes = trie.find(QStringLiteral("/home/user/notes.txt"));
+  QVERIFY(notes);
+  QVERIFY(notes->isExcludedFile());
+  QVERIFY(!notes->isExcludedDir());
+
+  QVERIFY(trie.find(QStringLiteral("/var"))->isExcludedDir());
+
+  // empty components do not count
+  QCOMPARE(trie.find(QStringLiteral("/home/user/tmp/")), tmp);
+  QCOMPARE(trie.find(QStringLiteral("//home//user/tmp")), tmp);
+
+  // nothing is excluded at or below these
+  QVERIFY(!trie.find(QStringLiteral("/usr")));
+  QVERIFY(!trie.find(QStringLiteral("/home/other")));
+  QVERIFY(!trie.find(QStringLiteral("/home/user/tmp2")));
+  QVERIFY(!trie.find(QStringLiteral("/home/user/tmp/file")));
+  QVERIFY(!trie.find(QStringLiteral("/Home")));
+}
+
+//--------------------------------------------------------------------------------
+
+void PathTrieTest::walk()
+{
+  PathTrie trie;
+  trie.insert(QStringLiteral("/home/user/tmp"), true);
+  trie.insert(QStringLiteral("/home/user/tmp"), false);  // a file and a dir of the same name
+
+  // the way the scanner goes down from one directory to the next
+  const PathTrie::Node *node = trie.find(QStringLiteral("/"));
+  QVERIFY(node);
+
+  node = node->child(QStringLiteral("home"));
+  QVERIFY(node);
+  QVERIFY(!node->child(QStringLiteral("other")));
+
+  node = node->child(QStringLiteral("user"));
+  QVERIFY(node);
+
+  node = node->child(QStringLiteral("tmp"));
+  QCOMPARE(node, trie.find(QStringLiteral("/home/user/tmp")));
+  QVERIFY(node->isExcludedDir());
+  QVERIFY(node->isExcludedFile());
+  QVERIFY(!node->child(QStringLiteral("x")));
+}
+
+//--------------------------------------------------------------------------------
+
+void PathTrieTest::root()
+{
+  PathTrie trie;
+  trie.insert(QStringLiteral("/"), true);
+
+  QVERIFY(!trie.isEmpty());
+
+  const PathTrie::Node *node = trie.find(QStringLiteral("/"));
+  QVERIFY(node);
+  QVERIFY(node->isExcludedDir());
+  QVERIFY(!node->child(QStringLiteral("home")));
+
+  trie.clear();
+  QVERIFY(trie.isEmpty());
+  QVERIFY(!trie.find(QStringLiteral("/")));
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(PathTrieTest)
+
+#include "PathTrieTest.moc"
@@ -0,0 +1,113 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <SliceIndex.hxx>
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+class SliceIndexTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void checksums();
+    void write();
+    void unwritable();
+};
+
+//--------------------------------------------------------------------------------
+
+void SliceIndexTest::checksums()
+{
+  const QDateTime mtime = QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1500000000999));
+
+  SliceIndex index;
+  index.setChecksum(1);  // nothing to set it on
+
+  index.add(SliceIndex::Dir, QStringLiteral("home"), 0, 0, mtime);
+  index.setChecksum(2);
+  index.add(SliceIndex::File, QStringLiteral("home/a"), 512, 10, mtime);
+  index.setChecksum(3);
+  index.add(SliceIndex::HardLink, QStringLiteral("home/b"), 1536, 0, mtime);
+  index.setChecksum(4);
+  index.add(SliceIndex::Continued, QStringLiteral("home/c"), 2048, 100, mtime);
+  index.setChecksum(5);
+
+  QCOMPARE(index.count(), 4);
+  QCOMPARE(index.at(0).checksum, Q_UINT64_C(0));
+  QCOMPARE(index.at(1).checksum, Q_UINT64_C(3));
+  QCOMPARE(index.at(2).checksum, Q_UINT64_C(0));
+  QCOMPARE(index.at(3).checksum, Q_UINT64_C(5));
+
+  // seconds
+  QCOMPARE(index.at(1).mtime, Q_INT64_C(1500000000));
+  QCOMPARE(index.at(1).name, QByteArray("home/a"));
+
+  index.clear();
+  QCOMPARE(index.count(), 0);
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceIndexTest::write()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+
+  const QString slice = dir.path() + QStringLiteral("/backup_1.tar");
+  const QString fileName = SliceIndex::fileNameForSlice(slice);
+  QCOMPARE(fileName, slice + QStringLiteral(".idx"));
+  QVERIFY(SliceIndex::isIndexFile(fileName));
+  QVERIFY(!SliceIndex::isIndexFile(slice));
+
+  const QDateTime mtime = QDateTime::fromMSecsSinceEpoch(Q_INT64_C(1500000000000));
+
+  SliceIndex index;
+  index.add(SliceIndex::Dir, QStringLiteral("home"), 0, 0, mtime);
+  index.add(SliceIndex::File, QStringLiteral("home/a file"), 512, 10, mtime);
+  index.setChecksum(Q_UINT64_C(0xabc));
+  index.add(SliceIndex::SparseFile, QString::fromUtf8("home/\xc3\xa4"), 1536, 2048, mtime);
+  index.setChecksum(Q_UINT64_C(0xfedcba9876543210));
+  index.add(SliceIndex::SymLink, QStringLiteral("home/back\\slash"), 4608, 0, mtime);
+  index.add(SliceIndex::HardLink, QStringLiteral("home/new\nline"), 5120, 0, mtime);
+
+  QVERIFY2(index.write(fileName), qPrintable(index.errorString()));
+
+  QFile file(fileName);
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  const QList<QByteArray> lines = file.readAll().split('\n');
+
+  QCOMPARE(lines.count(), 2 + index.count() + 1);  // the last line ends with a newline
+  QVERIFY(lines[0].startsWith("# kbackup slice index 1:"));
+  QVERIFY((lines[1] == "# checksum xxh3") || (lines[1] == "# checksum xxh64"));
+  QCOMPARE(lines[2], QByteArray("d 0 0 1500000000 - home"));
+  QCOMPARE(lines[3], QByteArray("f 512 10 1500000000 0000000000000abc home/a file"));
+  QCOMPARE(lines[4], QByteArray("s 1536 2048 1500000000 fedcba9876543210 home/\xc3\xa4"));
+  QCOMPARE(lines[5], QByteArray("l 4608 0 1500000000 - home/back\\\\slash"));
+  QCOMPARE(lines[6], QByteArray("h 5120 0 1500000000 - home/new\\nline"));
+  QVERIFY(lines[7].isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceIndexTest::unwritable()
+{
+  SliceIndex index;
+  index.add(SliceIndex::Dir, QStringLiteral("home"), 0, 0, QDateTime::currentDateTime());
+
+  QVERIFY(!index.write(QStringLiteral("/nonexistent/dir/backup_1.tar.idx")));
+  QVERIFY(!index.errorString().isEmpty());
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(SliceIndexTest)
+
+#include "SliceIndexTest.moc"
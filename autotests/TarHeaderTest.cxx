@@ -0,0 +1,406 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <TarHeader.hxx>
+#include <FileEntry.hxx>
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QStandardPaths>
+#include <QProcess>
+
+#include <unistd.h>
+
+Q_DECLARE_METATYPE(QVector<TarHeader::Extent>)
+
+// the blocks are checked field by field, and where GNU tar is installed
+// it has to restore the files from them; a continued file with tar -M
+
+class TarHeaderTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void init();
+    void sparseHeader();
+    void sparseMap_data();
+    void sparseMap();
+    void extractSparse_data();
+    void extractSparse();
+    void continuation();
+    void extractContinued_data();
+    void extractContinued();
+
+  private:
+    static FileEntry fileEntry(qint64 size);
+    static QByteArray field(const QByteArray &block, int offset, int length);
+    static qint64 number(const QByteArray &block, int offset, int length);
+    static bool checksumOk(const QByteArray &block);
+    static QByteArray content(const QVector<TarHeader::Extent> &extents, qint64 size);
+
+    // the archive is extracted into the temporary dir
+    bool extract(const QStringList &archives, bool multiVolume);
+
+  private:
+    QScopedPointer<QTemporaryDir> dir;
+    QString tar;
+};
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::init()
+{
+  dir.reset(new QTemporaryDir);
+  QVERIFY(dir->isValid());
+
+  tar = QStandardPaths::findExecutable(QStringLiteral("tar"));
+  if ( !tar.isEmpty() )
+  {
+    QProcess version;
+    version.start(tar, QStringList() << QStringLiteral("--version"));
+    if ( !version.waitForFinished() || !version.readAllStandardOutput().contains("GNU tar") )
+      tar.clear();
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+FileEntry TarHeaderTest::fileEntry(qint64 size)
+{
+  FileEntry entry;
+  entry.mode = S_IFREG | 0640;
+  entry.uid = ::getuid();
+  entry.gid = ::getgid();
+  entry.size = size;
+  entry.mtime = Q_INT64_C(1500000000000);
+  return entry;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeaderTest::field(const QByteArray &block, int offset, int length)
+{
+  const QByteArray data = block.mid(offset, length);
+  const int end = data.indexOf('\0');
+  return (end == -1) ? data : data.left(end);
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 TarHeaderTest::number(const QByteArray &block, int offset, int length)
+{
+  bool ok = false;
+  const qint64 value = field(block, offset, length).toLongLong(&ok, 8);
+  return ok ? value : -1;
+}
+
+//--------------------------------------------------------------------------------
+
+bool TarHeaderTest::checksumOk(const QByteArray &block)
+{
+  unsigned int sum = 0;
+  for (int i = 0; i < TarHeader::BLOCK_SIZE; i++)
+    sum += ((i >= 148) && (i < 156)) ? ' ' : static_cast<unsigned char>(block[i]);
+
+  return number(block, 148, 7) == sum;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeaderTest::content(const QVector<TarHeader::Extent> &extents, qint64 size)
+{
+  QByteArray data(static_cast<int>(size), 0);
+
+  foreach (const TarHeader::Extent &extent, extents)
+  {
+    for (qint64 i = 0; i < extent.length; i++)
+      data[static_cast<int>(extent.offset + i)] = static_cast<char>('a' + (extent.offset + i) % 26);
+  }
+
+  return data;
+}
+
+//--------------------------------------------------------------------------------
+
+bool TarHeaderTest::extract(const QStringList &archives, bool multiVolume)
+{
+  QStringList args;
+  args << QStringLiteral("-x");
+
+  if ( multiVolume )
+    args << QStringLiteral("-M");
+
+  foreach (const QString &archive, archives)
+    args << QStringLiteral("-f") << archive;
+
+  args << QStringLiteral("-C") << dir->path() + QStringLiteral("/out");
+
+  if ( !QDir(dir->path()).mkpath(QStringLiteral("out")) )
+    return false;
+
+  QProcess process;
+  process.setProcessChannelMode(QProcess::ForwardedChannels);
+  process.start(tar, args);
+  process.closeWriteChannel();  // -M asks for the next volume when one is missing
+
+  return process.waitForFinished() && (process.exitStatus() == QProcess::NormalExit) && (process.exitCode() == 0);
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::sparseHeader()
+{
+  const FileEntry entry = fileEntry(1000000);
+  const QByteArray blocks = TarHeader::sparseHeader(QStringLiteral("home/disk.img"), 5120, entry);
+
+  QCOMPARE(blocks.size() % TarHeader::BLOCK_SIZE, 0);
+
+  // the pax header, its records, and the header of the stored data
+  const QByteArray pax = blocks.left(TarHeader::BLOCK_SIZE);
+  QVERIFY(checksumOk(pax));
+  QCOMPARE(pax[156], 'x');
+  QCOMPARE(field(pax, 0, 100), QByteArray("PaxHeaders/disk.img"));
+  QCOMPARE(field(pax, 257, 6), QByteArray("ustar"));
+
+  const qint64 recordsSize = number(pax, 124, 12);
+  QByteArray records = blocks.mid(TarHeader::BLOCK_SIZE, static_cast<int>(recordsSize));
+
+  QStringList keys;
+  while ( !records.isEmpty() )
+  {
+    // "length key=value\n", the length counting the whole record
+    const int blank = records.indexOf(' ');
+    const int length = records.left(blank).toInt();
+    QVERIFY(length > blank);
+    QCOMPARE(records.at(length - 1), '\n');
+
+    const QByteArray record = records.mid(blank + 1, length - blank - 2);
+    keys << QString::fromUtf8(record);
+    records.remove(0, length);
+  }
+
+  QCOMPARE(keys, QStringList() << QStringLiteral("GNU.sparse.major=1") << QStringLiteral("GNU.sparse.minor=0")
+                               << QStringLiteral("GNU.sparse.name=home/disk.img")
+                               << QStringLiteral("GNU.sparse.realsize=1000000"));
+
+  const int headerPos = TarHeader::BLOCK_SIZE + static_cast<int>(recordsSize) + TarHeader::padding(recordsSize);
+  QCOMPARE(blocks.size(), headerPos + TarHeader::BLOCK_SIZE);
+
+  const QByteArray header = blocks.mid(headerPos);
+  QVERIFY(checksumOk(header));
+  QCOMPARE(header[156], '0');
+  QCOMPARE(field(header, 0, 100), QByteArray("GNUSparseFile.0/disk.img"));
+  QCOMPARE(number(header, 124, 12), Q_INT64_C(5120));
+  QCOMPARE(number(header, 100, 8), Q_INT64_C(0640));
+  QCOMPARE(number(header, 136, 12), Q_INT64_C(1500000000));
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::sparseMap_data()
+{
+  QTest::addColumn<QVector<TarHeader::Extent>>("extents");
+  QTest::addColumn<qint64>("size");
+  QTest::addColumn<QByteArray>("map");
+
+  QVector<TarHeader::Extent> extents;
+  TarHeader::Extent extent;
+
+  QTest::newRow("only a hole") << extents << Q_INT64_C(50000) << QByteArray("1\n50000\n0\n");
+
+  extent.offset = 0;
+  extent.length = 8192;
+  extents << extent;
+  extent.offset = 102400;
+  extent.length = 17600;
+  extents << extent;
+  QTest::newRow("data at the end") << extents << Q_INT64_C(120000) << QByteArray("2\n0\n8192\n102400\n17600\n");
+
+  QTest::newRow("hole at the end") << extents << Q_INT64_C(1000000)
+                                   << QByteArray("3\n0\n8192\n102400\n17600\n1000000\n0\n");
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::sparseMap()
+{
+  QFETCH(QVector<TarHeader::Extent>, extents);
+  QFETCH(qint64, size);
+  QFETCH(QByteArray, map);
+
+  const QByteArray blocks = TarHeader::sparseMap(extents, size);
+
+  QCOMPARE(blocks.size() % TarHeader::BLOCK_SIZE, 0);
+  QCOMPARE(blocks.left(map.size()), map);
+  QCOMPARE(blocks.mid(map.size()), QByteArray(blocks.size() - map.size(), 0));
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::extractSparse_data()
+{
+  QTest::addColumn<QString>("name");
+  QTest::addColumn<QVector<TarHeader::Extent>>("extents");
+  QTest::addColumn<qint64>("size");
+
+  QVector<TarHeader::Extent> extents;
+  TarHeader::Extent extent;
+
+  QTest::newRow("only a hole") << QStringLiteral("home/empty.img") << extents << Q_INT64_C(50000);
+
+  // the extents start at a block of the filesystem, like SEEK_DATA finds them
+  extent.offset = 0;
+  extent.length = 8192;
+  extents << extent;
+  extent.offset = 102400;
+  extent.length = 17600;
+  extents << extent;
+  QTest::newRow("data at the end") << QStringLiteral("home/disk.img") << extents << Q_INT64_C(120000);
+
+  extents.removeLast();
+  extent.length = 4096;
+  extents << extent;
+  QTest::newRow("hole at the end") << QStringLiteral("home/disk.img") << extents << Q_INT64_C(1000000);
+
+  // only the pax record holds the whole name
+  QTest::newRow("long name") << QStringLiteral("home/") + QString(120, QLatin1Char('d')) + QStringLiteral("/disk.img")
+                             << extents << Q_INT64_C(1000000);
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::extractSparse()
+{
+  QFETCH(QString, name);
+  QFETCH(QVector<TarHeader::Extent>, extents);
+  QFETCH(qint64, size);
+
+  if ( tar.isEmpty() )
+    QSKIP("GNU tar is not installed");
+
+  const FileEntry entry = fileEntry(size);
+  const QByteArray data = content(extents, size);
+
+  // the member as the archiver writes it: the map, then the extents one after the other
+  QByteArray stored = TarHeader::sparseMap(extents, size);
+  foreach (const TarHeader::Extent &extent, extents)
+    stored += data.mid(static_cast<int>(extent.offset), static_cast<int>(extent.length));
+
+  QByteArray archive = TarHeader::sparseHeader(name, stored.size(), entry);
+  archive += stored;
+  archive += QByteArray(TarHeader::padding(stored.size()), 0);
+  archive += QByteArray(2 * TarHeader::BLOCK_SIZE, 0);
+
+  QFile file(dir->path() + QStringLiteral("/sparse.tar"));
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  QCOMPARE(file.write(archive), static_cast<qint64>(archive.size()));
+  file.close();
+
+  QVERIFY(extract(QStringList() << file.fileName(), false));
+
+  QFile extracted(dir->path() + QStringLiteral("/out/") + name);
+  QVERIFY(extracted.open(QIODevice::ReadOnly));
+  QCOMPARE(extracted.size(), size);
+  QVERIFY(extracted.readAll() == data);
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::continuation()
+{
+  const QByteArray header = TarHeader::continuation(QStringLiteral("home/big.iso"), 300000, 1048576);
+
+  QCOMPARE(header.size(), static_cast<int>(TarHeader::BLOCK_SIZE));
+  QVERIFY(checksumOk(header));
+  QCOMPARE(header[156], 'M');
+  QCOMPARE(field(header, 0, 100), QByteArray("home/big.iso"));
+  QCOMPARE(number(header, 124, 12), Q_INT64_C(300000));
+  QCOMPARE(number(header, 369, 12), Q_INT64_C(1048576));
+
+  // like GNU tar writes it: no magic, and only the fields it compares
+  QVERIFY(field(header, 257, 8).isEmpty());
+  QVERIFY(field(header, 100, 8).isEmpty());
+
+  // a long name is cut to the field, without a long link block
+  const QString longName = QStringLiteral("home/") + QString(150, QLatin1Char('f'));
+  const QByteArray truncated = TarHeader::continuation(longName, 1, 0);
+  QCOMPARE(truncated.size(), static_cast<int>(TarHeader::BLOCK_SIZE));
+  QCOMPARE(truncated.left(100), longName.toLatin1().left(100));
+  QVERIFY(checksumOk(truncated));
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::extractContinued_data()
+{
+  QTest::addColumn<QString>("name");
+  QTest::addColumn<int>("size");
+  QTest::addColumn<int>("split");
+
+  QTest::newRow("short name") << QStringLiteral("home/big.iso") << 100000 << 7 * TarHeader::BLOCK_SIZE;
+  QTest::newRow("rest of one byte") << QStringLiteral("home/big.iso") << 7 * TarHeader::BLOCK_SIZE + 1
+                                    << 7 * TarHeader::BLOCK_SIZE;
+
+  // GNU tar only warns that the name in the continuation header is truncated
+  QTest::newRow("long name") << QStringLiteral("home/") + QString(120, QLatin1Char('f')) << 100000
+                             << 20 * TarHeader::BLOCK_SIZE;
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeaderTest::extractContinued()
+{
+  QFETCH(QString, name);
+  QFETCH(int, size);
+  QFETCH(int, split);
+
+  if ( tar.isEmpty() )
+    QSKIP("GNU tar is not installed");
+
+  const FileEntry entry = fileEntry(size);
+
+  QByteArray data(size, 0);
+  for (int i = 0; i < size; i++)
+    data[i] = static_cast<char>(i * 7 + i / 251);
+
+  // the first slice ends in the middle of the content, the second one
+  // continues it behind the multi-volume header
+  QByteArray first = TarHeader::create(name, TarHeader::RegularFile, size, entry);
+  first += data.left(split);
+
+  QByteArray second = TarHeader::continuation(name, size - split, split);
+  second += data.mid(split);
+  second += QByteArray(TarHeader::padding(size - split), 0);
+  second += QByteArray(2 * TarHeader::BLOCK_SIZE, 0);
+
+  QStringList slices;
+  slices << dir->path() + QStringLiteral("/backup_1.tar") << dir->path() + QStringLiteral("/backup_2.tar");
+
+  QFile file(slices[0]);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write(first);
+  file.close();
+
+  file.setFileName(slices[1]);
+  QVERIFY(file.open(QIODevice::WriteOnly));
+  file.write(second);
+  file.close();
+
+  QVERIFY(extract(slices, true));
+
+  QFile extracted(dir->path() + QStringLiteral("/out/") + name);
+  QVERIFY(extracted.open(QIODevice::ReadOnly));
+  QVERIFY(extracted.readAll() == data);
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(TarHeaderTest)
+
+#include "TarHeaderTest.moc"
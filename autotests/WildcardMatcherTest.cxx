@@ -0,0 +1,127 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <WildcardMatcher.hxx>
+
+#include <QtTest>
+
+// the matcher must give exactly the result of QRegExp::Wildcard, which the filters used before
+
+class WildcardMatcherTest : public QObject
+{
+  Q_OBJECT
+
+  private Q_SLOTS:
+    void matchesLikeQRegExp_data();
+    void matchesLikeQRegExp();
+    void copy();
+
+  private:
+    static QStringList strings();
+};
+
+//--------------------------------------------------------------------------------
+
+QStringList WildcardMatcherTest::strings()
+{
+  return QStringList()
+    << QString() << QStringLiteral("core") << QStringLiteral("cores") << QStringLiteral("x.o")
+    << QStringLiteral(".o") << QStringLiteral("o") << QStringLiteral("a.tar.gz") << QStringLiteral("tar.gz")
+    << QStringLiteral("file~") << QStringLiteral("~") << QStringLiteral("tmp") << QStringLiteral("tmpfile")
+    << QStringLiteral("xtmp") << QStringLiteral(".#lock") << QStringLiteral("mycachedir") << QStringLiteral("cache")
+    << QStringLiteral("abc") << QStringLiteral("aXbYc") << QStringLiteral("acb") << QStringLiteral("a.txt")
+    << QStringLiteral("ab.txt") << QStringLiteral(".txt") << QStringLiteral("file1") << QStringLiteral("file")
+    << QStringLiteral("file12") << QStringLiteral("a\nc") << QStringLiteral("file\n") << QStringLiteral("a.b")
+    << QStringLiteral("axb") << QStringLiteral("a+b") << QStringLiteral("a+bzz") << QStringLiteral("aab")
+    << QStringLiteral("(x)") << QStringLiteral("x|y") << QStringLiteral("x") << QStringLiteral("^a$")
+    << QStringLiteral("back\\slash") << QStringLiteral("{1}") << QStringLiteral("clog.log") << QStringLiteral("b.log")
+    << QStringLiteral("zy") << QStringLiteral("xy") << QStringLiteral("]") << QStringLiteral("Core")
+    << QString::fromUtf8("\xc3\xa4.txt") << QString::fromUtf8("a\xc3\xa4" "c")
+    // characters outside the BMP are two UTF-16 code units, and QRegExp's '?' matches only one
+    << QString::fromUtf8("\xf0\x9f\x98\x80.txt") << QString::fromUtf8("a\xf0\x9f\x98\x80" "c")
+    << QString::fromUtf8("file\xf0\x9f\x98\x80");
+}
+
+//--------------------------------------------------------------------------------
+
+void WildcardMatcherTest::matchesLikeQRegExp_data()
+{
+  QTest::addColumn<QStringList>("patterns");
+
+  const QStringList all = QStringList()
+    << QStringLiteral("core") << QString()                                                // names
+    << QStringLiteral("*.o") << QStringLiteral("*.tar.gz") << QStringLiteral("*~")        // suffixes
+    << QStringLiteral("tmp*") << QStringLiteral(".#*")                                    // prefixes
+    << QStringLiteral("*cache*") << QStringLiteral("a*b*c") << QStringLiteral("a**b")     // combined expression
+    << QStringLiteral("?.txt") << QStringLiteral("file?") << QStringLiteral("a?c")        // single characters
+    << QStringLiteral("a??c") << QStringLiteral("*?")
+    << QStringLiteral("[abc]*.log") << QStringLiteral("[!x]y") << QStringLiteral("[]]")   // character sets
+    << QStringLiteral("a.b") << QStringLiteral("a+b*") << QStringLiteral("(x)")           // regexp syntax is literal
+    << QStringLiteral("x|y") << QStringLiteral("^a$") << QStringLiteral("back\\slash")
+    << QStringLiteral("{1}");
+
+  foreach (const QString &pattern, all)
+    QTest::newRow(qPrintable(QStringLiteral("'%1'").arg(pattern))) << (QStringList() << pattern);
+
+  QTest::newRow("all") << all;
+  QTest::newRow("star") << (QStringList() << QStringLiteral("*"));
+  QTest::newRow("stars") << (QStringList() << QStringLiteral("**"));
+  QTest::newRow("none") << QStringList();
+}
+
+//--------------------------------------------------------------------------------
+
+void WildcardMatcherTest::matchesLikeQRegExp()
+{
+  QFETCH(QStringList, patterns);
+
+  WildcardMatcher matcher;
+  matcher.setPatterns(patterns);
+
+  QCOMPARE(matcher.getPatterns(), patterns);
+  QCOMPARE(matcher.isEmpty(), patterns.isEmpty());
+
+  foreach (const QString &str, strings())
+  {
+    bool expected = false;
+    foreach (const QString &pattern, patterns)
+      expected = expected || QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard).exactMatch(str);
+
+    QVERIFY2(matcher.matches(str) == expected, qPrintable(QStringLiteral("'%1'").arg(str)));
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void WildcardMatcherTest::copy()
+{
+  WildcardMatcher matcher;
+  matcher.setPatterns(QStringList() << QStringLiteral("*.o") << QStringLiteral("a?c") << QStringLiteral("[ab]*"));
+
+  WildcardMatcher copied(matcher);
+  WildcardMatcher assigned;
+  assigned = matcher;
+
+  foreach (const QString &str, strings())
+  {
+    QCOMPARE(copied.matches(str), matcher.matches(str));
+    QCOMPARE(assigned.matches(str), matcher.matches(str));
+  }
+
+  matcher.clear();
+  QVERIFY(matcher.isEmpty());
+  QVERIFY(!matcher.matches(QStringLiteral("x.o")));
+  QVERIFY(copied.matches(QStringLiteral("x.o")));
+}
+
+//--------------------------------------------------------------------------------
+
+QTEST_GUILESS_MAIN(WildcardMatcherTest)
+
+#include "WildcardMatcherTest.moc"
@@ -8,10 +8,14 @@
 //**************************************************************************
 
 #include <Archiver.hxx>
+#include <CompressJob.hxx>
+#include <SpillBuffer.hxx>
+#include <DirScanner.hxx>
+#include <KioPutDevice.hxx>
+#include <PipeDevice.hxx>
 
 #include <kio_version.h>
 #include <ktar.h>
-#include <KFilterBase>
 #include <kio/job.h>
 #include <kio/jobuidelegate.h>
 #include <kprocess.h>
@@ -25,15 +29,22 @@
 #include <qcursor.h>
 #include <QTextStream>
 #include <QFileDialog>
-#include <QTemporaryFile>
 #include <QTimer>
+#include <QThread>
+#include <QScopedPointer>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 #include <sys/statvfs.h>
+#include <limits.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#endif
 
 // For INT64_MAX:
 // The ISO C99 standard specifies that in C++ implementations these
@@ -51,17 +62,164 @@
 //--------------------------------------------------------------------------------
 
 QString Archiver::sliceScript;
+qint64 Archiver::compressBufferSize = 16 * 1024 * 1024;
 Archiver *Archiver::instance;
 
 const KIO::filesize_t MAX_SLICE = INT64_MAX; // 64bit max value
 
+// the number of buffers we read/write before we process events again;
+// about every 400KB, as it was with the former fixed 8KB buffers
+static int eventInterval(qint64 bufferSize)
+{
+  return static_cast<int>(qMax(Q_INT64_C(1), (50 * 8 * 1024) / bufferSize));
+}
+
+// how often the progress is logged when no window shows it
+const qint64 PROGRESS_LOG_INTERVAL = 5 * 60 * 1000;
+
+// when a slice is compressed as a whole, the compressor holds back some data in its
+// buffers which is not yet written to the slice file. A small slice only reserves a
+// part of its capacity, so that it still takes some data.
+// zstd tells how much it holds back, which is added
+const KIO::filesize_t COMPRESSOR_RESERVE = 4 * 1024 * 1024;
+
+// extensions of slices which are compressed as a whole
+static QString stripSliceExtension(const QString &fileName)
+{
+  // the index of a slice goes with it
+  QString name = fileName;
+  if ( SliceIndex::isIndexFile(name) )
+    name = name.left(name.lastIndexOf(QLatin1Char('.')));
+
+  foreach (const QString &ext, QStringList() << QStringLiteral(".xz") << QStringLiteral(".bz2")
+                                             << QStringLiteral(".gz") << QStringLiteral(".zst"))
+    if ( name.endsWith(ext) )
+      return name.left(name.length() - ext.length());
+
+  return name;
+}
+
+// the amount of file content copied inside the kernel before we process events again
+const qint64 COPY_CHUNK = 8 * 1024 * 1024;
+
+// finished slices in the tmp dir waiting for or in their upload to a remote target
+const int MAX_PENDING_UPLOADS = 2;
+
+// a file which does not fit is only started in a slice with at least this much room left
+const KIO::filesize_t MIN_SPLIT_ROOM = 1024 * 1024;
+
+// copies up to len bytes from inFd at inPos to outFd at outPos without passing
+// them through our buffers.
+// Returns the number of bytes copied, 0 at the end of the input file or -1 on error (errno is set)
+static qint64 copyRange(int inFd, off_t inPos, int outFd, off_t outPos, size_t len)
+{
+#ifdef Q_OS_LINUX
+  ssize_t ret = ::copy_file_range(inFd, &inPos, outFd, &outPos, len, 0);
+
+  if ( (ret >= 0) || ((errno != EXDEV) && (errno != ENOSYS) && (errno != EOPNOTSUPP)) )
+    return ret;
+
+  // older kernels can not copy between different filesystems, but sendfile can
+  if ( ::lseek(outFd, outPos, SEEK_SET) == -1 )
+    return -1;
+
+  return ::sendfile(outFd, inFd, &inPos, len);
+#else
+  Q_UNUSED(inFd)
+  Q_UNUSED(inPos)
+  Q_UNUSED(outFd)
+  Q_UNUSED(outPos)
+  Q_UNUSED(len)
+
+  errno = EINVAL;
+  return -1;
+#endif
+}
+
+// the ranges of a file which contain data.
+// Returns false if the file has no holes or the filesystem can not tell where they are
+static bool findDataExtents(int fd, qint64 size, QVector<TarHeader::Extent> &extents)
+{
+  extents.clear();
+
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+  qint64 dataBytes = 0;
+  off_t pos = 0;
+
+  while ( pos < size )
+  {
+    const off_t start = ::lseek(fd, pos, SEEK_DATA);
+
+    if ( start == -1 )
+    {
+      if ( errno == ENXIO )  // only a hole up to the end
+        break;
+
+      return false;
+    }
+
+    off_t end = ::lseek(fd, start, SEEK_HOLE);
+    if ( end == -1 )
+      return false;
+
+    end = qMin(static_cast<qint64>(end), size);  // the file may have grown
+
+    TarHeader::Extent extent;
+    extent.offset = start;
+    extent.length = end - start;
+    extents.append(extent);
+
+    dataBytes += extent.length;
+    pos = end;
+  }
+
+  // reading continues from the start
+  if ( ::lseek(fd, 0, SEEK_SET) == -1 )
+    return false;
+
+  return dataBytes < size;
+#else
+  Q_UNUSED(fd)
+  Q_UNUSED(size)
+
+  return false;
+#endif
+}
+
+// adds len zero bytes to the hash, as a hole reads as zeros
+static void hashZeros(ContentHash &hash, qint64 len)
+{
+  static const char zeros[64 * 1024] = { 0 };
+
+  for (; len > 0; len -= sizeof(zeros))
+    hash.addData(zeros, qMin(len, static_cast<qint64>(sizeof(zeros))));
+}
+
+// the bytes a sparse member takes in the slice: header, map and data
+static qint64 sparseStoredSize(const QString &name, const FileEntry &entry, const QVector<TarHeader::Extent> &extents)
+{
+  qint64 dataBytes = 0;
+  foreach (const TarHeader::Extent &extent, extents)
+    dataBytes += extent.length;
+
+  const qint64 mapSize = TarHeader::sparseMap(extents, entry.size).size();
+
+  return TarHeader::sparseHeader(name, mapSize + dataBytes, entry).size() + mapSize + dataBytes;
+}
+
 //--------------------------------------------------------------------------------
 
 Archiver::Archiver(QWidget *parent)
   : QObject(parent),
-    archive(nullptr), totalBytes(0), totalFiles(0), filteredFiles(0), sliceNum(0), mediaNeedsChange(false),
+    hashContent(false), memberSlice(0), targetFormat(TarSlices), archive(nullptr), totalBytes(0), totalFiles(0), filteredFiles(0),
+    sameContentFiles(0),
+    preScan(false), haveEstimate(false), estimatedFiles(0), estimatedBytes(0), handledFiles(0), handledBytes(0),
+    freeAtStart(0), spaceChecked(false), spaceCheckDue(false), progressLogged(0), sliceNum(0), mediaNeedsChange(false),
     fullBackupInterval(1), incrementalBackup(false), forceFullBackup(false),
-    sliceCapacity(MAX_SLICE), compressionType(KCompressionDevice::None), interactive(parent != nullptr),
+    sliceCapacity(MAX_SLICE), compressMode(CompressNone),
+    cacheMode(PageCache::Normal), sliceFile(nullptr), sliceFilter(nullptr), streamUpload(false), uploadDevice(nullptr),
+    pipeFd(-1), pipeDevice(nullptr),
+    compressWorkers(qMax(1, QThread::idealThreadCount())), queuedJobs(0), interactive(parent != nullptr),
     cancelled(false), runs(false), skippedFiles(false), verbose(false), jobResult(0)
 {
   instance = this;
@@ -69,7 +227,13 @@ Archiver::Archiver(QWidget *parent)
   maxSliceMBs    = Archiver::UNLIMITED;
   numKeptBackups = Archiver::UNLIMITED;
 
-  setCompressFiles(false);
+  setCompressMode(CompressNone);
+
+  connect(&preScanner, SIGNAL(finished()), this, SLOT(preScanFinished()));
+  connect(&uploader, SIGNAL(uploaded(const QString &, const QUrl &)),
+          this, SLOT(sliceUploaded(const QString &, const QUrl &)));
+  connect(&uploader, SIGNAL(failed(const QString &, const QString &)),
+          this, SLOT(sliceUploadFailed(const QString &, const QString &)));
 
   if ( !interactive )
   {
@@ -80,31 +244,36 @@ Archiver::Archiver(QWidget *parent)
 
 //--------------------------------------------------------------------------------
 
-void Archiver::setCompressFiles(bool b)
+void Archiver::setCompressMode(CompressMode mode)
 {
-  if ( b )
-  {
-    ext = QStringLiteral(".xz");
-    compressionType = KCompressionDevice::Xz;
-    KFilterBase *base = KCompressionDevice::filterForCompressionType(compressionType);
-    if ( !base )
-    {
-      ext = QStringLiteral(".bz2");
-      compressionType = KCompressionDevice::BZip2;
-      base = KCompressionDevice::filterForCompressionType(compressionType);
-      if ( !base )
-      {
-        ext = QStringLiteral(".gz");
-        compressionType = KCompressionDevice::GZip;
-      }
-    }
+  compressMode = mode;
 
-    delete base;
-  }
+  if ( compressMode != CompressNone )
+    ext = codec.getExtension();
   else
-  {
     ext = QString();
-  }
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::setCompressCodec(CompressionCodec::Type type)
+{
+  codec.setType(type);
+  setCompressMode(compressMode);  // update the extension
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::setCompressLevel(int level)
+{
+  codec.setLevel(level);
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::setCompressWorkers(int num)
+{
+  compressWorkers = qMax(1, num);
 }
 
 //--------------------------------------------------------------------------------
@@ -134,10 +303,7 @@ void Archiver::setKeptBackups(int num)
 
 void Archiver::setFilter(const QString &filter)
 {
-  filters.clear();
-  QStringList list = filter.split(QLatin1Char(' '), QString::SkipEmptyParts);
-  foreach (const QString &str, list)
-    filters.append(QRegExp(str, Qt::CaseSensitive, QRegExp::Wildcard));
+  filters.setPatterns(filter.split(QLatin1Char(' '), QString::SkipEmptyParts));
 }
 
 //--------------------------------------------------------------------------------
@@ -145,9 +311,9 @@ void Archiver::setFilter(const QString &filter)
 QString Archiver::getFilter() const
 {
   QString filter;
-  foreach (const QRegExp &reg, filters)
+  foreach (const QString &pattern, filters.getPatterns())
   {
-    filter += reg.pattern();
+    filter += pattern;
     filter += QLatin1Char(' ');
   }
   return filter;
@@ -157,14 +323,15 @@ QString Archiver::getFilter() const
 
 void Archiver::setDirFilter(const QString &filter)
 {
-  dirFilters.clear();
+  QStringList patterns;
   QStringList list = filter.split(QLatin1Char('\n'), QString::SkipEmptyParts);
   foreach (const QString &str, list)
   {
     QString expr = str.trimmed();
     if ( !expr.isEmpty() )
-      dirFilters.append(QRegExp(expr, Qt::CaseSensitive, QRegExp::Wildcard));
+      patterns.append(expr);
   }
+  dirFilters.setPatterns(patterns);
 }
 
 //--------------------------------------------------------------------------------
@@ -172,9 +339,9 @@ void Archiver::setDirFilter(const QString &filter)
 QString Archiver::getDirFilter() const
 {
   QString filter;
-  foreach (const QRegExp &reg, dirFilters)
+  foreach (const QString &pattern, dirFilters.getPatterns())
   {
-    filter += reg.pattern();
+    filter += pattern;
     filter += QLatin1Char('\n');
   }
   return filter;
@@ -212,6 +379,14 @@ void Archiver::setIncrementalBackup(bool inc)
 
 //--------------------------------------------------------------------------------
 
+void Archiver::setTargetFormat(TargetFormat format)
+{
+  targetFormat = format;
+  emit backupTypeChanged(isIncrementalBackup());
+}
+
+//--------------------------------------------------------------------------------
+
 void Archiver::setFilePrefix(const QString &prefix)
 {
   filePrefix = prefix;
@@ -221,7 +396,7 @@ void Archiver::setFilePrefix(const QString &prefix)
 
 void Archiver::calculateCapacity()
 {
-  if ( targetURL.isEmpty() ) return;
+  if ( targetURL.isEmpty() && pipeTarget.isEmpty() ) return;
 
   // calculate how large a slice can actually be
   // - limited by the target directory (when we store directly into a local dir)
@@ -231,11 +406,15 @@ void Archiver::calculateCapacity()
 
   KIO::filesize_t totalBytes = 0;
 
-  if ( targetURL.isLocalFile() )
+  if ( !pipeTarget.isEmpty() )
+    sliceCapacity = MAX_SLICE;  // the reader takes it away
+  else if ( targetURL.isLocalFile() )
   {
     if ( ! getDiskFree(targetURL.path(), totalBytes, sliceCapacity) )
       return;
   }
+  else if ( isStreamingUpload() )
+    sliceCapacity = MAX_SLICE;  // nothing is stored locally
   else
   {
     getDiskFree(QDir::tempPath() + QLatin1Char('/'), totalBytes, sliceCapacity);
@@ -275,6 +454,7 @@ bool Archiver::loadProfile(const QString &fileName, QStringList &includes, QStri
   loadedProfile = fileName;
 
   QString target;
+  QStringList dirPatterns;
   QChar type, blank;
   QTextStream stream(&file);
 
@@ -282,6 +462,14 @@ bool Archiver::loadProfile(const QString &fileName, QStringList &includes, QStri
   setFilePrefix(QString());
   setMaxSliceMBs(Archiver::UNLIMITED);
   setFullBackupInterval(1);  // default as in previous versions
+  setCompressWorkers(QThread::idealThreadCount());
+  setCompressCodec(CompressionCodec::Auto);
+  setCompressLevel(0);
+  setCacheMode(PageCache::Normal);
+  setPreScan(false);
+  setTargetFormat(TarSlices);
+  setHashContent(false);
+  setStreamUpload(false);
   filters.clear();
   dirFilters.clear();
 
@@ -342,13 +530,57 @@ bool Archiver::loadProfile(const QString &fileName, QStringList &includes, QStri
     }
     else if ( type == QLatin1Char('x') )
     {
-      dirFilters.append(QRegExp(stream.readLine(), Qt::CaseSensitive, QRegExp::Wildcard));
+      dirPatterns.append(stream.readLine());
     }
     else if ( type == QLatin1Char('Z') )
     {
       int compress;
       stream >> compress;
-      setCompressFiles(compress);
+      setCompressMode(static_cast<CompressMode>(qBound(0, compress, static_cast<int>(CompressSlices))));
+    }
+    else if ( type == QLatin1Char('z') )
+    {
+      QString name;
+      int level;
+      stream >> name >> level;
+      setCompressCodec(CompressionCodec::typeFromName(name));
+      setCompressLevel(level);
+    }
+    else if ( type == QLatin1Char('W') )
+    {
+      int workers;
+      stream >> workers;
+      setCompressWorkers(workers);
+    }
+    else if ( type == QLatin1Char('K') )
+    {
+      int mode;
+      stream >> mode;
+      setCacheMode(static_cast<PageCache::Mode>(qBound(0, mode, static_cast<int>(PageCache::Direct))));
+    }
+    else if ( type == QLatin1Char('T') )
+    {
+      int scan;
+      stream >> scan;
+      setPreScan(scan);
+    }
+    else if ( type == QLatin1Char('H') )
+    {
+      int hash;
+      stream >> hash;
+      setHashContent(hash);
+    }
+    else if ( type == QLatin1Char('U') )
+    {
+      int streaming;
+      stream >> streaming;
+      setStreamUpload(streaming);
+    }
+    else if ( type == QLatin1Char('D') )
+    {
+      int format;
+      stream >> format;
+      setTargetFormat(static_cast<TargetFormat>(qBound(0, format, static_cast<int>(ChunkRepository))));
     }
     else if ( type == QLatin1Char('I') )
     {
@@ -364,6 +596,7 @@ bool Archiver::loadProfile(const QString &fileName, QStringList &includes, QStri
 
   file.close();
 
+  dirFilters.setPatterns(dirPatterns);
   setTarget(QUrl::fromUserInput(target));
 
   setIncrementalBackup(
@@ -400,13 +633,20 @@ bool Archiver::saveProfile(const QString &fileName, const QStringList &includes,
     stream << "B " << getLastBackup().toString(Qt::ISODate) << endl;
 
   stream << "C " << static_cast<int>(getMediaNeedsChange()) << endl;
-  stream << "Z " << static_cast<int>(getCompressFiles()) << endl;
+  stream << "Z " << static_cast<int>(getCompressMode()) << endl;
+  stream << "z " << CompressionCodec::typeName(getCompressCodec()) << " " << getCompressLevel() << endl;
+  stream << "W " << getCompressWorkers() << endl;
+  stream << "K " << static_cast<int>(getCacheMode()) << endl;
+  stream << "T " << static_cast<int>(getPreScan()) << endl;
+  stream << "D " << static_cast<int>(getTargetFormat()) << endl;
+  stream << "H " << static_cast<int>(getHashContent()) << endl;
+  stream << "U " << static_cast<int>(getStreamUpload()) << endl;
 
   if ( !filters.isEmpty() )
     stream << "X " << getFilter() << endl;
 
-  foreach (const QRegExp &exp, dirFilters)
-    stream << "x " << exp.pattern() << endl;
+  foreach (const QString &pattern, dirFilters.getPatterns())
+    stream << "x " << pattern << endl;
 
   foreach (const QString &str, includes)
     stream << "I " << str << endl;
@@ -428,22 +668,37 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
     return false;
   }
 
-  if ( !targetURL.isValid() )
+  const bool toPipe = !pipeTarget.isEmpty();
+
+  if ( toPipe && (targetFormat == ChunkRepository) )
+  {
+    emit warning(i18n("A chunk repository can not be written into '%1'", pipeTarget));
+    return false;
+  }
+
+  if ( !toPipe && !targetURL.isValid() )
   {
     emit warning(i18n("The target dir '%1' is not valid", targetURL.toString()));
     return false;
   }
 
   // non-interactive mode only allows local targets as KIO needs $DISPLAY
-  if ( !interactive && !targetURL.isLocalFile() )
+  if ( !interactive && !toPipe && !targetURL.isLocalFile() )
   {
     emit warning(i18n("The target dir '%1' must be a local file system dir and no remote URL",
                      targetURL.toString()));
     return false;
   }
 
+  if ( (targetFormat == ChunkRepository) && !targetURL.isLocalFile() )
+  {
+    emit warning(i18n("The target dir '%1' must be a local file system dir to hold a chunk repository",
+                     targetURL.toString()));
+    return false;
+  }
+
   // check if the target dir exists and optionally create it
-  if ( targetURL.isLocalFile() )
+  if ( !toPipe && targetURL.isLocalFile() )
   {
     QDir dir(targetURL.path());
     if ( !dir.exists() )
@@ -468,8 +723,7 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
     }
   }
 
-  excludeDirs.clear();
-  excludeFiles.clear();
+  excludeTrie.clear();
 
   // build map for directories and files to be excluded for fast lookup
   foreach (const QString &name, excludes)
@@ -477,9 +731,9 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
     QFileInfo info(name);
 
     if ( !info.isSymLink() && info.isDir() )
-      excludeDirs.insert(name);
+      excludeTrie.insert(name, true);
     else
-      excludeFiles.insert(name);
+      excludeTrie.insert(name, false);
   }
 
   baseName = QString();
@@ -487,150 +741,180 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
   totalBytes = 0;
   totalFiles = 0;
   filteredFiles = 0;
+  sameContentFiles = 0;
+  haveEstimate = false;
+  estimatedFiles = 0;
+  estimatedBytes = 0;
+  handledFiles = 0;
+  handledBytes = 0;
+  throughputSamples.clear();
+  spaceChecked = false;
+  spaceCheckDue = false;
+  progressLogged = 0;
   cancelled = false;
   skippedFiles = false;
   sliceList.clear();
+  hardLinks.clear();
+  pendingDirs.clear();
+  unreadDirs.clear();
+  compressPool.setMaxThreadCount(compressWorkers);
+  codec.setWorkers(compressWorkers);
+  emit remainingChanged(-1, -1);
 
   QDateTime startTime = QDateTime::currentDateTime();
+  qint64 cachedAtStart = PageCache::cachedBytes();
+
+  KIO::filesize_t capacity;
+  if ( toPipe || !targetURL.isLocalFile() || !getDiskFree(targetURL.path(), capacity, freeAtStart) )
+    freeAtStart = 0;
+
+  if ( toPipe && !openPipe() )
+    return false;
 
   runs = true;
   emit inProgress(true);
 
+  // also without a window, for the estimate and the check of the target space
   QTimer runTimer;
-  if ( interactive )  // else we do not need to be interrupted during the backup
-  {
-    connect(&runTimer, SIGNAL(timeout()), this, SLOT(updateElapsed()));
-    runTimer.start(1000);
-  }
+  connect(&runTimer, SIGNAL(timeout()), this, SLOT(updateElapsed()));
+  runTimer.start(1000);
   elapsed.start();
 
-  if ( ! getNextSlice() )
+  if ( !((targetFormat == ChunkRepository) ? startSnapshot() : getNextSlice()) )
   {
+    closePipe();
     runs = false;
     emit inProgress(false);
 
     return false;
   }
 
-  for (QStringList::const_iterator it = includes.constBegin(); !cancelled && (it != includes.constEnd()); ++it)
+  // the state of all files of the last backup decides which ones changed.
+  // Without a profile (or without incremental backups) the time of the last backup is used
+  fileIndex.close();
+  if ( (fullBackupInterval > 1) && !loadedProfile.isEmpty() )
+  {
+    const QString indexName = FileIndex::fileNameForProfile(loadedProfile);
+
+    if ( isIncrementalBackup() && !fileIndex.open(indexName) && !fileIndex.errorString().isEmpty() )
+    {
+      emit warning(i18n("Could not read the file index %1: %2\n"
+                        "Files are selected by the time of the last backup.", indexName, fileIndex.errorString()));
+    }
+
+    if ( !fileIndex.startWriting(indexName) )
+      emit warning(i18n("Could not write the file index %1: %2", indexName, fileIndex.errorString()));
+  }
+
+  // every backup of a profile goes into its catalog
+  if ( !loadedProfile.isEmpty() && (targetFormat == TarSlices) )
   {
-    QString entry = *it;
+    const QString catalogName = BackupCatalog::fileNameForProfile(loadedProfile);
+
+    if ( !catalog.startRun(catalogName, catalogTarget(), QFileInfo(baseName).fileName(), startTime, isIncrementalBackup()) )
+      emit warning(i18n("Could not write the backup catalog %1: %2", catalogName, catalog.errorString()));
+  }
 
+  QStringList roots;
+  foreach (QString entry, includes)
+  {
     if ( (entry.length() > 1) && entry.endsWith(QLatin1Char('/')) )
       entry.truncate(entry.length() - 1);
 
-    QFileInfo info(entry);
+    roots.append(QFileInfo(entry).absoluteFilePath());
+  }
 
-    if ( !info.isSymLink() && info.isDir() )
+  if ( preScan )
+  {
+    preScanner.setExcludes(&excludeTrie);
+    preScanner.setFilters(filters, dirFilters);
+    preScanner.setModifiedSince(isIncrementalBackup() ? lastBackup.toMSecsSinceEpoch() : -1);
+    preScanner.setFileIndex(isIncrementalBackup() ? &fileIndex : nullptr);
+    preScanner.startScan(roots);
+  }
+
+  dirScanner.setExcludes(&excludeTrie);
+  dirScanner.setDirFilters(dirFilters);
+
+  for (QStringList::const_iterator it = roots.constBegin(); !cancelled && (it != roots.constEnd()); ++it)
+  {
+    FileEntry root(*it);
+
+    if ( root.isDir() )
     {
-      QDir dir(info.absoluteFilePath());
-      addDirFiles(dir);
+      addDirFiles(dirScanner.start(root, DirScanner::numThreads));
+      dirScanner.stop();
     }
     else
-      addFile(info.absoluteFilePath());
+      addFile(root, excludeTrie.find(root.path));
   }
 
-  finishSlice();
+  preScanner.stopScan();
+
+  writeQueuedEntries(0);  // wait for all outstanding compressions
+  discardQueuedEntries();
+
+  if ( chunkStore.isOpen() )
+    finishSnapshot();
+  else
+    finishSlice();
+
+  if ( !cancelled && uploader.count() )
+    emit logging(i18n("...waiting for %1 uploads to finish", uploader.count()));
+  waitForUploads(0);
+
+  closePipe();  // the reader sees the end of the stream
+
+  if ( !cancelled && catalog.isWriting() && !catalog.finishRun() )
+    emit warning(i18n("Could not write the backup catalog: %1", catalog.errorString()));
 
-  // reduce the number of old backups to the defined number
-  if ( !cancelled && (numKeptBackups != UNLIMITED) )
+  // reduce the number of old backups to the defined number.
+  // Snapshots share their chunks, so they can't simply be deleted
+  if ( !cancelled && (numKeptBackups != UNLIMITED) && (targetFormat == TarSlices) && !toPipe )
   {
     emit logging(i18n("...reducing number of kept archives to max. %1", numKeptBackups));
 
-    if ( !targetURL.isLocalFile() )  // KIO needs $DISPLAY; non-interactive only allowed for local targets
-    {
-      QPointer<KIO::ListJob> listJob;
-      listJob = KIO::listDir(targetURL, KIO::DefaultFlags, false);
+    // the catalog knows the backups without a listing of the target dir
+    if ( !reduceBackupsWithCatalog() )
+      reduceBackupsWithListing();
+  }
 
-      connect(listJob, SIGNAL(entries(KIO::Job *, const KIO::UDSEntryList &)),
-              this, SLOT(slotListResult(KIO::Job *, const KIO::UDSEntryList &)));
+  runs = false;
+  emit inProgress(false);
+  runTimer.stop();
+  updateElapsed();  // to catch the last partly second
 
-      while ( listJob )
-        qApp->processEvents(QEventLoop::WaitForMoreEvents);
-    }
-    else  // non-intercative. create UDSEntryList on our own
+  if ( !cancelled )
+  {
+    if ( fileIndex.isOpen() )
     {
-      QDir dir(targetURL.path());
-      targetDirList.clear();
-      foreach (const QString &fileName, dir.entryList())
+      // what this run filtered or excluded was not looked at, but is still there;
+      // and what it could not read is maybe still there
+      QStringList removed;
+      int unread = 0;
+      foreach (const QString &path, fileIndex.unseenPaths())
       {
-        KIO::UDSEntry entry;
-#if (KIO_VERSION >= QT_VERSION_CHECK(5, 48, 0))
-        entry.fastInsert(KIO::UDSEntry::UDS_NAME, fileName);
-#else
-        entry.insert(KIO::UDSEntry::UDS_NAME, fileName);
-#endif
-        targetDirList.append(entry);
+        if ( isInUnreadDir(path) )
+          unread++;
+        else if ( !isFilteredPath(path) && !isExcluded(path) )
+          removed.append(path);
       }
-      jobResult = 0;
-    }
 
-    if ( jobResult == 0 )
-    {
-      std::sort(targetDirList.begin(), targetDirList.end(), Archiver::UDSlessThan);
-      QString prefix = filePrefix.isEmpty() ? QString::fromLatin1("backup_") : (filePrefix + QLatin1String("_"));
+      emit logging(i18n("-- Removed Files: %1", removed.count()));
 
-      QString sliceName;
-      int num = 0;
+      if ( unread )
+        emit logging(i18n("-- Files in unreadable directories (not checked): %1", unread));
 
-      foreach (const KIO::UDSEntry &entry, targetDirList)
+      if ( verbose )
       {
-        QString entryName = entry.stringValue(KIO::UDSEntry::UDS_NAME);
-
-        if ( entryName.startsWith(prefix) &&  // only matching current profile
-             entryName.endsWith(QLatin1String(".tar")) )     // just to be sure
-        {
-          if ( (num < numKeptBackups) &&
-               (sliceName.isEmpty() ||
-                !entryName.startsWith(sliceName)) )     // whenever a new backup set (different time) is found
-          {
-            sliceName = entryName.left(prefix.length() + strlen("yyyy.MM.dd-hh.mm.ss_"));
-            if ( !entryName.endsWith(QLatin1String("_inc.tar")) )  // do not count partial (differential) backup files
-              num++;
-            if ( num == numKeptBackups ) num++;  // from here on delete all others
-          }
-
-          if ( (num > numKeptBackups) &&   // delete all other files
-               !entryName.startsWith(sliceName) )     // keep complete last matching archive set
-          {
-            QUrl url = targetURL;
-            url = url.adjusted(QUrl::StripTrailingSlash);
-            url.setPath(url.path() + QLatin1Char('/') + entryName);
-            emit logging(i18n("...deleting %1", entryName));
-
-            // delete the file using KIO
-            if ( !targetURL.isLocalFile() )  // KIO needs $DISPLAY; non-interactive only allowed for local targets
-            {
-              QPointer<KIO::SimpleJob> delJob;
-              delJob = KIO::file_delete(url, KIO::DefaultFlags);
-
-              connect(delJob, SIGNAL(result(KJob *)), this, SLOT(slotResult(KJob *)));
-
-              while ( delJob )
-                qApp->processEvents(QEventLoop::WaitForMoreEvents);
-            }
-            else
-            {
-              QDir dir(targetURL.path());
-              dir.remove(entryName);
-            }
-          }
-        }
+        foreach (const QString &path, removed)
+          emit logging(i18n("...removed %1", path));
       }
     }
-    else
-    {
-      emit warning(i18n("fetching directory listing of target failed. Can not reduce kept archives."));
-    }
-  }
 
-  runs = false;
-  emit inProgress(false);
-  runTimer.stop();
-  updateElapsed();  // to catch the last partly second
+    if ( !fileIndex.finishWriting() && !fileIndex.errorString().isEmpty() )
+      emit warning(i18n("Could not write the file index: %1", fileIndex.errorString()));
 
-  if ( !cancelled )
-  {
     lastBackup = startTime;
     if ( !isIncrementalBackup() )
     {
@@ -649,6 +933,16 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
 
     emit logging(i18n("-- Filtered Files: %1", filteredFiles));
 
+    if ( hashContent && isIncrementalBackup() )
+      emit logging(i18n("-- Files with only new times: %1", sameContentFiles));
+
+    qint64 cachedAtEnd = PageCache::cachedBytes();
+    if ( (cachedAtStart >= 0) && (cachedAtEnd >= 0) )
+    {
+      emit logging(i18n("-- Page Cache: %1 before, %2 after the backup",
+                        KIO::convertSize(cachedAtStart), KIO::convertSize(cachedAtEnd)));
+    }
+
     if ( skippedFiles )
       emit logging(i18n("!! Backup finished <b>but files were skipped</b> !!"));
     else
@@ -688,6 +982,11 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
   }
   else
   {
+    fileIndex.discardWriting();
+    fileIndex.close();
+    catalog.discardRun();
+    chunkStore.close();
+
     emit logging(i18n("...Backup aborted!"));
     return false;
   }
@@ -695,603 +994,2202 @@ bool Archiver::createArchive(const QStringList &includes, const QStringList &exc
 
 //--------------------------------------------------------------------------------
 
-void Archiver::cancel()
+void Archiver::reduceBackupsWithListing()
 {
-  if ( !runs ) return;
-
-  if ( job )
+  if ( !targetURL.isLocalFile() )  // KIO needs $DISPLAY; non-interactive only allowed for local targets
   {
-    job->kill();
-    job = nullptr;
+    QPointer<KIO::ListJob> listJob;
+    listJob = KIO::listDir(targetURL, KIO::DefaultFlags, false);
+
+    connect(listJob, SIGNAL(entries(KIO::Job *, const KIO::UDSEntryList &)),
+            this, SLOT(slotListResult(KIO::Job *, const KIO::UDSEntryList &)));
+
+    while ( listJob )
+      qApp->processEvents(QEventLoop::WaitForMoreEvents);
   }
-  if ( !cancelled )
+  else  // non-intercative. create UDSEntryList on our own
   {
-    cancelled = true;
-
-    if ( archive )
+    QDir dir(targetURL.path());
+    targetDirList.clear();
+    foreach (const QString &fileName, dir.entryList())
     {
-      archive->close();  // else I can not remove the file - don't know why
-      delete archive;
-      archive = nullptr;
+      KIO::UDSEntry entry;
+#if (KIO_VERSION >= QT_VERSION_CHECK(5, 48, 0))
+      entry.fastInsert(KIO::UDSEntry::UDS_NAME, fileName);
+#else
+      entry.insert(KIO::UDSEntry::UDS_NAME, fileName);
+#endif
+      targetDirList.append(entry);
     }
-
-    QFile(archiveName).remove(); // remove the unfinished tar file (which is now corrupted)
-    emit warning(i18n("Backup cancelled"));
+    jobResult = 0;
   }
-}
-
-//--------------------------------------------------------------------------------
-
-void Archiver::finishSlice()
-{
-  if ( archive )
-    archive->close();
 
-  if ( ! cancelled )
+  if ( jobResult == 0 )
   {
-    runScript(QStringLiteral("slice_closed"));
+    std::sort(targetDirList.begin(), targetDirList.end(), Archiver::UDSlessThan);
+    QString prefix = filePrefix.isEmpty() ? QString::fromLatin1("backup_") : (filePrefix + QLatin1String("_"));
 
-    if ( targetURL.isLocalFile() )
-    {
-      emit logging(i18n("...finished slice %1", archiveName));
-      sliceList << archiveName;  // store name for display at the end
-    }
-    else
+    QString sliceName;
+    int num = 0;
+    QMap<QString, BackupCatalog::Run> kept;  // by the name of the set
+
+    foreach (const KIO::UDSEntry &entry, targetDirList)
     {
-      QUrl source = QUrl::fromLocalFile(archiveName);
-      QUrl target = targetURL;
+      QString entryName = entry.stringValue(KIO::UDSEntry::UDS_NAME);
+      QString tarName = stripSliceExtension(entryName);
 
-      while ( true )
+      if ( entryName.startsWith(prefix) &&  // only matching current profile
+           tarName.endsWith(QLatin1String(".tar")) )     // just to be sure
       {
-        // copy to have the archive for the script later down
-        job = KIO::copy(source, target, KIO::DefaultFlags);
-
-        connect(job, SIGNAL(result(KJob *)), this, SLOT(slotResult(KJob *)));
-
-        emit logging(i18n("...uploading archive %1 to %2", source.fileName(), target.toString()));
-
-        while ( job )
-          qApp->processEvents(QEventLoop::WaitForMoreEvents);
+        if ( (num < numKeptBackups) &&
+             (sliceName.isEmpty() ||
+              !entryName.startsWith(sliceName)) )     // whenever a new backup set (different time) is found
+        {
+          sliceName = entryName.left(prefix.length() + strlen("yyyy.MM.dd-hh.mm.ss_"));
+          if ( !tarName.endsWith(QLatin1String("_inc.tar")) )  // do not count partial (differential) backup files
+            num++;
+          if ( num == numKeptBackups ) num++;  // from here on delete all others
+        }
 
-        if ( jobResult == 0 )
+        if ( (num > numKeptBackups) &&   // delete all other files
+             !entryName.startsWith(sliceName) )     // keep complete last matching archive set
         {
-          target = target.adjusted(QUrl::StripTrailingSlash);
-          target.setPath(target.path() + QLatin1Char('/') + source.fileName());
-          sliceList << target.toLocalFile();  // store name for display at the end
-          break;
+          deleteFromTarget(entryName);
         }
-        else
+        else  // the catalog shall know it from now on
         {
-          enum { ASK, CANCEL, RETRY } action = ASK;
-          while ( action == ASK )
-          {
-            int ret = KMessageBox::warningYesNoCancel(static_cast<QWidget*>(parent()),
-                        i18n("How shall we proceed with the upload?"), i18n("Upload Failed"),
-                        KGuiItem(i18n("Retry")), KGuiItem(i18n("Change Target")));
-
-            if ( ret == KMessageBox::Cancel )
-            {
-              action = CANCEL;
-              break;
-            }
-            else if ( ret == KMessageBox::No )  // change target
-            {
-              target = QFileDialog::getExistingDirectoryUrl(static_cast<QWidget*>(parent()));
-              if ( target.isEmpty() )
-                action = ASK;
-              else
-                action = RETRY;
-            }
-            else
-              action = RETRY;
-          }
-
-          if ( action == CANCEL )
-            break;
+          const QString setName = entryName.left(prefix.length() + strlen("yyyy.MM.dd-hh.mm.ss"));
+          BackupCatalog::Run &run = kept[setName];
+
+          run.name = setName;
+          run.startTime = QDateTime::fromString(setName.right(strlen("yyyy.MM.dd-hh.mm.ss")),
+                                                QStringLiteral("yyyy.MM.dd-hh.mm.ss"));
+          run.incremental = tarName.endsWith(QLatin1String("_inc.tar"));
+          // listed with the last slice first
+          run.files.prepend(entryName);
+          if ( !SliceIndex::isIndexFile(entryName) )
+            run.slices.prepend(entryName);
         }
       }
-
-      if ( jobResult != 0 )
-        cancel();
     }
-  }
-
-  if ( ! cancelled )
-    runScript(QStringLiteral("slice_finished"));
-
-  if ( !targetURL.isLocalFile() )
-    QFile(archiveName).remove(); // remove the tmp file
 
-  delete archive;
-  archive = nullptr;
+    addFoundRuns(kept, prefix);
+  }
+  else
+  {
+    emit warning(i18n("fetching directory listing of target failed. Can not reduce kept archives."));
+  }
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::slotResult(KJob *theJob)
+bool Archiver::reduceBackupsWithCatalog()
 {
-  if ( (jobResult = theJob->error()) )
-  {
-    theJob->uiDelegate()->showErrorMessage();
+  if ( loadedProfile.isEmpty() )
+    return false;
 
-    emit warning(theJob->errorString());
-  }
-}
+  const QString catalogName = BackupCatalog::fileNameForProfile(loadedProfile);
+  if ( !catalog.open(catalogName) )
+    return false;
 
-//--------------------------------------------------------------------------------
+  // backups made before there was a catalog are only known from the target dir
+  // until it was listed once
+  const bool synced = catalog.isSynced(catalogTarget());
+  const QVector<BackupCatalog::Run> backups = catalog.runs(catalogTarget());
+  catalog.close();
 
-void Archiver::slotListResult(KIO::Job *theJob, const KIO::UDSEntryList &entries)
-{
-  if ( (jobResult = theJob->error()) )
+  if ( !synced )
+    return false;
+
+  int num = 0;
+  for (int i = backups.count() - 1; i >= 0; i--)  // the newest first
   {
-    theJob->uiDelegate()->showErrorMessage();
+    const BackupCatalog::Run &run = backups[i];
 
-    emit warning(theJob->errorString());
+    if ( num < numKeptBackups )
+    {
+      if ( !run.incremental )  // do not count partial (differential) backups
+        num++;
+
+      continue;
+    }
+
+    foreach (const QString &file, run.files)
+      deleteFromTarget(file);
+
+    if ( !catalog.removeRun(catalogName, run) )
+      emit warning(i18n("Could not write the backup catalog %1: %2", catalogName, catalog.errorString()));
   }
 
-  targetDirList = entries;
+  return true;
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::runScript(const QString &mode)
+void Archiver::addFoundRuns(const QMap<QString, BackupCatalog::Run> &found, const QString &prefix)
 {
-  // do some extra action via external script (program)
-  if ( sliceScript.length() )
+  if ( loadedProfile.isEmpty() )
+    return;
+
+  const QString catalogName = BackupCatalog::fileNameForProfile(loadedProfile);
+  const QString target = catalogTarget();
+
+  QVector<BackupCatalog::Run> known;
+  bool synced = false;
+  if ( catalog.open(catalogName) )
   {
-    QString mountPoint;
-    if ( targetURL.isLocalFile() )
-    {
-      KMountPoint::Ptr ptr = KMountPoint::currentMountPoints().findByPath(targetURL.path());
-      if ( ptr )
-        mountPoint = ptr->mountPoint();
-    }
+    known = catalog.runs(target);
+    synced = catalog.isSynced(target);
+    catalog.close();
+  }
+  else if ( !catalog.errorString().isEmpty() )
+    return;
 
-    KProcess proc;
-    proc << sliceScript
-         << mode
-         << archiveName
-         << targetURL.toString(QUrl::PreferLocalFile)
-         << mountPoint;
+  QSet<QString> knownNames;
+  foreach (const BackupCatalog::Run &run, known)
+  {
+    knownNames.insert(run.name);
 
-    connect(&proc, &KProcess::readyReadStandardOutput,
-            this, &Archiver::receivedOutput);
+    // deleted by the listing, or by hand
+    if ( run.name.startsWith(prefix) && !found.contains(run.name) && !catalog.removeRun(catalogName, run) )
+    {
+      emit warning(i18n("Could not write the backup catalog %1: %2", catalogName, catalog.errorString()));
+      return;
+    }
+  }
 
-    proc.setOutputChannelMode(KProcess::MergedChannels);
+  foreach (BackupCatalog::Run run, found)
+  {
+    if ( knownNames.contains(run.name) )
+      continue;
 
-    if ( proc.execute() == -2 )
+    run.target = target;
+
+    if ( !catalog.addFoundRun(catalogName, run) )
     {
-      QString message = i18n("The script '%1' could not be started.", sliceScript);
-      if ( interactive )
-        KMessageBox::error(static_cast<QWidget*>(parent()), message);
-      else
-        emit warning(message);
+      emit warning(i18n("Could not write the backup catalog %1: %2", catalogName, catalog.errorString()));
+      return;
     }
   }
+
+  // from now on the catalog knows all backups in the target dir
+  if ( !synced && !catalog.markSynced(catalogName, target) )
+    emit warning(i18n("Could not write the backup catalog %1: %2", catalogName, catalog.errorString()));
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::receivedOutput()
+void Archiver::deleteFromTarget(const QString &fileName)
 {
-  KProcess *proc = static_cast<KProcess*>(sender());
+  QUrl url = targetURL;
+  url = url.adjusted(QUrl::StripTrailingSlash);
+  url.setPath(url.path() + QLatin1Char('/') + fileName);
+  emit logging(i18n("...deleting %1", fileName));
 
-  QByteArray buffer = proc->readAllStandardOutput();
+  // delete the file using KIO
+  if ( !targetURL.isLocalFile() )  // KIO needs $DISPLAY; non-interactive only allowed for local targets
+  {
+    QPointer<KIO::SimpleJob> delJob;
+    delJob = KIO::file_delete(url, KIO::DefaultFlags);
 
-  QString msg = QString::fromUtf8(buffer);
-  if ( msg.endsWith(QLatin1String("\n")) )
-    msg.truncate(msg.length() - 1);
+    connect(delJob, SIGNAL(result(KJob *)), this, SLOT(slotResult(KJob *)));
 
-  emit warning(msg);
+    while ( delJob )
+      qApp->processEvents(QEventLoop::WaitForMoreEvents);
+  }
+  else
+  {
+    QDir dir(targetURL.path());
+    dir.remove(fileName);
+  }
 }
 
 //--------------------------------------------------------------------------------
 
-bool Archiver::getNextSlice()
+QString Archiver::catalogTarget() const
 {
-  sliceNum++;
+  return pipeTarget.isEmpty() ? targetURL.toString(QUrl::PreferLocalFile) : pipeTarget;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::cancel()
+{
+  if ( !runs ) return;
+
+  uploader.cancel();
+
+  if ( !cancelled )
+  {
+    cancelled = true;
+
+    // let the compression workers stop early; the queue is cleaned up by createArchive()
+    foreach (const QueuedEntry &entry, compressQueue)
+      if ( entry.job )
+        entry.job->cancel();
 
+    // closing would finish the upload of the incomplete slice
+    if ( uploadDevice )
+      uploadDevice->abort();
+
+    // we are called while events are processed, maybe in the middle of a write into the slice.
+    // finishSlice() removes the unfinished slice when nothing writes into it anymore
+    emit warning(i18n("Backup cancelled"));
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::finishSlice()
+{
   if ( archive )
   {
-    emit sliceProgress(100);
+    sliceCache.stop();
+    archive->close();
 
-    finishSlice();
-    if ( cancelled ) return false;
+    // writes the end of the compressed stream
+    if ( sliceFilter && !CompressionCodec::closeDevice(sliceFilter) && !cancelled )
+    {
+      emit warning(i18n("Could not write to archive.\n"
+                        "The operating system reports: %1", sliceFilter->errorString()));
+      skippedFiles = true;
+    }
 
-    if ( interactive && mediaNeedsChange &&
-         KMessageBox::warningContinueCancel(static_cast<QWidget*>(parent()),
-                             i18n("The medium is full. Please insert medium Nr. %1", sliceNum)) ==
-          KMessageBox::Cancel )
+    if ( sliceFile && !cancelled && (sliceFile->error() != QFile::NoError) )
+    {
+      emit warning(i18n("Could not write to archive.\n"
+                        "The operating system reports: %1", sliceFile->errorString()));
+      skippedFiles = true;
+    }
+
+    // the reader went away
+    if ( pipeDevice && !cancelled && pipeDevice->failed() )
     {
+      emit warning(i18n("Could not write archive %1 into %2: %3",
+                        archiveName, pipeTarget, pipeDevice->errorString()));
       cancel();
-      return false;
+    }
+
+    // without a local copy the slice can not be uploaded again
+    if ( uploadDevice && !cancelled && uploadDevice->failed() )
+    {
+      emit warning(i18n("Could not upload archive %1: %2",
+                        getSliceUrl().toDisplayString(), uploadDevice->errorString()));
+      cancel();
+    }
+
+    // also drop what was written while closing
+    if ( !cancelled && (cacheMode != PageCache::Normal) && sliceFile && targetURL.isLocalFile() )
+    {
+      QFile slice(archiveName);
+      if ( slice.open(QIODevice::ReadOnly) )
+        PageCache::dropFile(slice.handle());
     }
   }
 
-  emit newSlice(sliceNum);
+  // the reader of a stream has no place for it
+  QString indexName;
+  if ( ! cancelled && archive && pipeTarget.isEmpty() )
+    indexName = writeSliceIndex();
 
-  if ( baseName.isEmpty() )
+  if ( ! cancelled && archive )
   {
-    QString prefix = filePrefix.isEmpty() ? QString::fromLatin1("backup") : filePrefix;
+    catalog.addSlice(QFileInfo(archiveName).fileName(), sliceIndex);
 
-    if ( targetURL.isLocalFile() )
-      baseName = targetURL.path() + QStringLiteral("/") + prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));
-    else
-      baseName = QDir::tempPath() + QLatin1Char('/') + prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));
+    if ( !indexName.isEmpty() )
+      catalog.addFile(QFileInfo(indexName).fileName());
   }
 
-  archiveName = baseName + QStringLiteral("_%1").arg(sliceNum);
-  if ( isIncrementalBackup() )
-    archiveName += QStringLiteral("_inc.tar");  // mark the file as being not a full backup
-  else
-    archiveName += QStringLiteral(".tar");
+  if ( ! cancelled && !pipeTarget.isEmpty() )
+  {
+    runScript(QStringLiteral("slice_closed"));
 
-  runScript(QStringLiteral("slice_init"));
+    emit logging(i18n("...finished slice %1", archiveName));
+    sliceList << archiveName;  // store name for display at the end
 
-  calculateCapacity();
+    runScript(QStringLiteral("slice_finished"));
+  }
+  else if ( ! cancelled && isStreamingUpload() )
+  {
+    const QString url = getSliceUrl().toDisplayString();
 
-  // don't create a bz2 compressed file as we compress each file on its own
-  archive = new KTar(archiveName, QStringLiteral("application/x-tar"));
+    runScript(QStringLiteral("slice_closed"), url);
 
-  while ( (sliceCapacity < 1024) || !archive->open(QIODevice::WriteOnly) )  // disk full ?
+    emit logging(i18n("...finished slice %1", url));
+    sliceList << url;  // store name for display at the end
+
+    if ( !indexName.isEmpty() )
+      uploader.add(indexName, targetURL);
+
+    runScript(QStringLiteral("slice_finished"), url);
+  }
+  else if ( ! cancelled )
   {
-    if ( !interactive )
-      emit warning(i18n("The file '%1' can not be opened for writing.", archiveName));
+    runScript(QStringLiteral("slice_closed"));
 
-    if ( !interactive ||
-         (KMessageBox::warningYesNo(static_cast<QWidget*>(parent()),
-           i18n("The file '%1' can not be opened for writing.\n\n"
-                "Do you want to retry?", archiveName)) == KMessageBox::No) )
+    if ( targetURL.isLocalFile() )
     {
-      delete archive;
-      archive = nullptr;
-
-      cancel();
-      return false;
+      emit logging(i18n("...finished slice %1", archiveName));
+      sliceList << archiveName;  // store name for display at the end
     }
-    calculateCapacity();  // try again; maybe the user freed up some space
+    else
+    {
+      // uploaded in the background while the next slice is written.
+      // The upload runs the slice_finished script and removes the tmp file
+      emit logging(i18n("...uploading archive %1 to %2", QFileInfo(archiveName).fileName(), targetURL.toString()));
+      uploader.add(archiveName, targetURL, indexName);
+    }
+
+    if ( targetURL.isLocalFile() )
+      runScript(QStringLiteral("slice_finished"));
   }
+  else if ( pipeTarget.isEmpty() && !isStreamingUpload() )
+    QFile(archiveName).remove(); // remove the unfinished tar file (which is now corrupted) or the tmp file
 
-  return true;
+  deleteArchive();
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::emitArchiveError() const
+void Archiver::deleteArchive()
 {
-  QString err;
+  delete archive;
+  archive = nullptr;
+  sliceIndex.clear();
 
-  if ( archive->device() )
-    err = archive->device()->errorString();
+  delete sliceFilter;
+  sliceFilter = nullptr;
 
-  if ( err.isEmpty() )
-  {
-    emit warning(i18n("Could not write to archive. Maybe the medium is full."));
-  }
-  else
-  {
-    emit warning(i18n("Could not write to archive.\n"
-                      "The operating system reports: %1", err));
-  }
+  delete sliceFile;
+  sliceFile = nullptr;
+
+  delete pipeDevice;
+  pipeDevice = nullptr;
+
+  delete uploadDevice;
+  uploadDevice = nullptr;
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::addDirFiles(QDir &dir)
+QUrl Archiver::getSliceUrl() const
 {
-  QString absolutePath = dir.absolutePath();
+  QUrl url = targetURL.adjusted(QUrl::StripTrailingSlash);
+  url.setPath(url.path() + QLatin1Char('/') + QFileInfo(archiveName).fileName());
 
-  if ( excludeDirs.contains(absolutePath) )
-    return;
+  return url;
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::startSnapshot()
+{
+  const QString prefix = filePrefix.isEmpty() ? QString::fromLatin1("backup") : filePrefix;
+  const QString repo = targetURL.path() + QLatin1Char('/') + prefix + QStringLiteral(".chunks");
+  const QString name = prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));
+
+  if ( !chunkStore.open(repo) || !chunkStore.startSnapshot(name) )
+  {
+    emit warning(i18n("Could not open the chunk repository '%1'.\n"
+                      "The operating system reports: %2", repo, chunkStore.errorString()));
+    chunkStore.close();
+    return false;
+  }
+
+  // there is no slice file, but the repository must not back up itself
+  archiveName = QString();
+  archivePath = QFileInfo(repo).absoluteFilePath();
+
+  emit logging(i18n("...writing snapshot %1 into %2", name, repo));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
 
-  foreach (const QRegExp &exp, dirFilters)
+void Archiver::finishSnapshot()
+{
+  if ( !cancelled )
   {
-    if ( exp.exactMatch(absolutePath) )
+    if ( chunkStore.finishSnapshot() )
     {
-      if ( interactive || verbose )
-        emit logging(i18n("...skipping filtered directory %1", absolutePath));
+      emit logging(i18n("...finished snapshot %1", chunkStore.getSnapshotFileName()));
+      emit logging(i18n("-- Deduplication: %1 of %2 were new data",
+                        KIO::convertSize(chunkStore.getNewBytes()),
+                        KIO::convertSize(chunkStore.getContentBytes())));
 
-      return;
+      sliceList << chunkStore.getSnapshotFileName();  // store name for display at the end
+    }
+    else
+    {
+      emitArchiveError();
+      cancel();
     }
   }
 
-  // add the dir itself
-  struct stat status;
-  memset(&status, 0, sizeof(status));
-  if ( ::stat(QFile::encodeName(absolutePath).constData(), &status) == -1 )
+  chunkStore.close();
+}
+
+//--------------------------------------------------------------------------------
+
+KIO::filesize_t Archiver::getSliceBytes() const
+{
+  if ( sliceFilter )
   {
-    emit warning(i18n("Could not get information of directory: %1\n"
-                      "The operating system reports: %2",
-                 absolutePath,
-                 QString::fromLatin1(strerror(errno))));
-    return;
+    const qint64 pending = CompressionCodec::pendingBytes(sliceFilter);
+
+    return (sliceFile ? sliceFile->size() : pipeDevice->pos()) + qMin(COMPRESSOR_RESERVE, sliceCapacity / 16) +
+           ((pending > 0) ? static_cast<KIO::filesize_t>(pending) : 0);
   }
-  QFileInfo dirInfo(absolutePath);
 
-  if ( ! dirInfo.isReadable() )
+  return archive->device()->pos();  // account for tar overhead
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::slotResult(KJob *theJob)
+{
+  if ( (jobResult = theJob->error()) )
   {
-    emit warning(i18n("Directory '%1' is not readable. Skipping.", absolutePath));
-    skippedFiles = true;
-    return;
-  }
+    theJob->uiDelegate()->showErrorMessage();
 
-  totalFiles++;
-  emit totalFilesChanged(totalFiles);
-  if ( interactive || verbose )
-    emit logging(absolutePath);
+    emit warning(theJob->errorString());
+  }
+}
 
-  qApp->processEvents(QEventLoop::AllEvents, 5);
-  if ( cancelled ) return;
+//--------------------------------------------------------------------------------
 
-  if ( ! archive->writeDir(QStringLiteral(".") + absolutePath, dirInfo.owner(), dirInfo.group(),
-                           status.st_mode, dirInfo.lastRead(), dirInfo.lastModified(), dirInfo.created()) )
+void Archiver::slotListResult(KIO::Job *theJob, const KIO::UDSEntryList &entries)
+{
+  if ( (jobResult = theJob->error()) )
   {
-    emit warning(i18n("Could not write directory '%1' to archive.\n"
-                      "Maybe the medium is full.", absolutePath));
-    return;
+    theJob->uiDelegate()->showErrorMessage();
+
+    emit warning(theJob->errorString());
   }
 
-  dir.setFilter(QDir::AllEntries | QDir::Hidden | QDir::System | QDir::NoDotAndDotDot);
+  targetDirList = entries;
+}
 
-  const QFileInfoList list = dir.entryInfoList();
+//--------------------------------------------------------------------------------
 
-  for (int i = 0; !cancelled && (i < list.count()); i++)
+void Archiver::runScript(const QString &mode, const QString &sliceName)
+{
+  // do some extra action via external script (program)
+  if ( sliceScript.length() )
   {
-    if ( !list[i].isSymLink() && list[i].isDir() )
+    QString mountPoint;
+    if ( pipeTarget.isEmpty() && targetURL.isLocalFile() )
+    {
+      KMountPoint::Ptr ptr = KMountPoint::currentMountPoints().findByPath(targetURL.path());
+      if ( ptr )
+        mountPoint = ptr->mountPoint();
+    }
+
+    KProcess proc;
+    proc << sliceScript
+         << mode
+         << (sliceName.isEmpty() ? archiveName : sliceName)
+         << (pipeTarget.isEmpty() ? targetURL.toString(QUrl::PreferLocalFile) : pipeTarget)
+         << mountPoint;
+
+    connect(&proc, &KProcess::readyReadStandardOutput,
+            this, &Archiver::receivedOutput);
+
+    proc.setOutputChannelMode(KProcess::MergedChannels);
+
+    if ( proc.execute() == -2 )
     {
-      QDir dir(list[i].absoluteFilePath());
-      addDirFiles(dir);
+      QString message = i18n("The script '%1' could not be started.", sliceScript);
+      if ( interactive )
+        KMessageBox::error(static_cast<QWidget*>(parent()), message);
+      else
+        emit warning(message);
     }
-    else
-      addFile(list[i].absoluteFilePath());
   }
 }
 
 //--------------------------------------------------------------------------------
 
-bool Archiver::fileIsFiltered(const QString &fileName) const
+void Archiver::receivedOutput()
 {
-  foreach (const QRegExp &exp, filters)
-    if ( exp.exactMatch(fileName) )
-      return true;
+  KProcess *proc = static_cast<KProcess*>(sender());
+
+  QByteArray buffer = proc->readAllStandardOutput();
+
+  QString msg = QString::fromUtf8(buffer);
+  if ( msg.endsWith(QLatin1String("\n")) )
+    msg.truncate(msg.length() - 1);
+
+  emit warning(msg);
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::sliceUploaded(const QString &fileName, const QUrl &url)
+{
+  // of a streamed slice, which is already done
+  if ( SliceIndex::isIndexFile(fileName) )
+  {
+    QFile(fileName).remove();
+    return;
+  }
+
+  emit logging(i18n("...uploaded archive %1", url.toDisplayString()));
+  sliceList << url.toDisplayString();  // store name for display at the end
+
+  // with the tmp file, which the script might still want to use
+  runScript(QStringLiteral("slice_finished"), fileName);
+
+  QFile(fileName).remove();
+  QFile(SliceIndex::fileNameForSlice(fileName)).remove();
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::sliceUploadFailed(const QString &fileName, const QString &errorString)
+{
+  emit warning(i18n("Could not upload archive %1: %2", QFileInfo(fileName).fileName(), errorString));
+
+  // the next uploads wait until we know how to go on
+  enum { ASK, CANCEL, RETRY } action = interactive ? ASK : CANCEL;
+  QUrl target = targetURL;
+
+  while ( action == ASK )
+  {
+    int ret = KMessageBox::warningYesNoCancel(static_cast<QWidget*>(parent()),
+                i18n("How shall we proceed with the upload?"), i18n("Upload Failed"),
+                KGuiItem(i18n("Retry")), KGuiItem(i18n("Change Target")));
+
+    if ( ret == KMessageBox::Cancel )
+      action = CANCEL;
+    else if ( ret == KMessageBox::No )  // change target
+    {
+      target = QFileDialog::getExistingDirectoryUrl(static_cast<QWidget*>(parent()));
+      if ( !target.isEmpty() )
+        action = RETRY;
+    }
+    else
+      action = RETRY;
+  }
+
+  if ( action == RETRY )
+    uploader.retry(target);
+  else
+    cancel();
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::waitForUploads(int maxPending, KIO::filesize_t needed)
+{
+  while ( (uploader.count() > 0) && !cancelled )
+  {
+    KIO::filesize_t total = 0, free = 0;
+    getDiskFree(QDir::tempPath() + QLatin1Char('/'), total, free);
+
+    // as calculateCapacity() leaves 10% of tmp to others
+    if ( (uploader.count() <= maxPending) && ((free * 9 / 10) >= needed) )
+      return;
+
+    qApp->processEvents(QEventLoop::WaitForMoreEvents);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::getNextSlice()
+{
+  sliceNum++;
+
+  if ( archive )
+  {
+    emit sliceProgress(100);
+
+    finishSlice();
+    if ( cancelled ) return false;
+
+    checkTargetSpace();
+    if ( cancelled ) return false;
+
+    if ( interactive && mediaNeedsChange &&
+         KMessageBox::warningContinueCancel(static_cast<QWidget*>(parent()),
+                             i18n("The medium is full. Please insert medium Nr. %1", sliceNum)) ==
+          KMessageBox::Cancel )
+    {
+      cancel();
+      return false;
+    }
+  }
+
+  emit newSlice(sliceNum);
+
+  if ( baseName.isEmpty() )
+  {
+    QString prefix = filePrefix.isEmpty() ? QString::fromLatin1("backup") : filePrefix;
+
+    if ( !pipeTarget.isEmpty() )
+      baseName = prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));  // only a name in the stream
+    else if ( targetURL.isLocalFile() )
+      baseName = targetURL.path() + QStringLiteral("/") + prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));
+    else
+      baseName = QDir::tempPath() + QLatin1Char('/') + prefix + QDateTime::currentDateTime().toString(QStringLiteral("_yyyy.MM.dd-hh.mm.ss"));
+  }
+
+  archiveName = baseName + QStringLiteral("_%1").arg(sliceNum);
+  if ( isIncrementalBackup() )
+    archiveName += QStringLiteral("_inc.tar");  // mark the file as being not a full backup
+  else
+    archiveName += QStringLiteral(".tar");
+
+  if ( compressMode == CompressSlices )
+    archiveName += ext;
+
+  // (QFileInfo to have correct path comparison even in case archiveName contains // etc.)
+  archivePath = QFileInfo(archiveName).absoluteFilePath();
+
+  // the slices still uploading share the tmp dir with the new one.
+  // Without a size limit a slice takes all of it, so the uploads must finish first
+  if ( !targetURL.isLocalFile() && pipeTarget.isEmpty() )
+  {
+    if ( maxSliceMBs == UNLIMITED )
+      waitForUploads(0);
+    else
+      waitForUploads(MAX_PENDING_UPLOADS - 1, static_cast<KIO::filesize_t>(maxSliceMBs) * 1024 * 1024);
+
+    if ( cancelled ) return false;
+  }
+
+  runScript(QStringLiteral("slice_init"));
+
+  calculateCapacity();
+
+  if ( !pipeTarget.isEmpty() )
+  {
+    // every slice continues the stream; archiveName only gives the name
+    pipeDevice = new PipeDevice(pipeFd);
+
+    if ( compressMode == CompressSlices )
+    {
+      sliceFilter = codec.createDevice(pipeDevice, -1);
+      archive = new KTar(sliceFilter);
+    }
+    else
+      archive = new KTar(pipeDevice);
+  }
+  else if ( compressMode == CompressSlices )
+  {
+    // we need access to the compressed file to know how much of the slice is used
+    sliceFile = new QFile(archiveName);
+    sliceFilter = codec.createDevice(sliceFile, -1);
+    archive = new KTar(sliceFilter);
+  }
+  else if ( targetURL.isLocalFile() )
+  {
+    // we write into the file ourself, so that addLocalFile() can copy file content
+    // directly into it
+    sliceFile = new QFile(archiveName);
+    archive = new KTar(sliceFile);
+  }
+  else if ( isStreamingUpload() )
+  {
+    // straight into the upload; archiveName only gives the name
+    uploadDevice = new KioPutDevice(getSliceUrl());
+    archive = new KTar(uploadDevice);
+
+    emit logging(i18n("...uploading archive %1", getSliceUrl().toDisplayString()));
+  }
+  else  // don't create a compressed file; if at all, we compress each file on its own
+    archive = new KTar(archiveName, QStringLiteral("application/x-tar"));
+
+  while ( (sliceCapacity < 1024) || !archive->open(QIODevice::WriteOnly) )  // disk full ?
+  {
+    if ( !interactive )
+      emit warning(i18n("The file '%1' can not be opened for writing.", archiveName));
+
+    if ( !interactive ||
+         (KMessageBox::warningYesNo(static_cast<QWidget*>(parent()),
+           i18n("The file '%1' can not be opened for writing.\n\n"
+                "Do you want to retry?", archiveName)) == KMessageBox::No) )
+    {
+      deleteArchive();
+
+      cancel();
+      return false;
+    }
+    calculateCapacity();  // try again; maybe the user freed up some space
+  }
+
+  if ( sliceFile )
+    sliceCache.startWriting(sliceFile->handle(), cacheMode);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::emitArchiveError() const
+{
+  QString err;
+
+  if ( chunkStore.isOpen() )
+    err = chunkStore.errorString();
+  else if ( archive->device() )
+    err = archive->device()->errorString();
+
+  if ( err.isEmpty() )
+  {
+    emit warning(i18n("Could not write to archive. Maybe the medium is full."));
+  }
+  else
+  {
+    emit warning(i18n("Could not write to archive.\n"
+                      "The operating system reports: %1", err));
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::addDirFiles(DirScanner::Node *node)
+{
+  const FileEntry &dir = node->dir;
+  const QString &absolutePath = dir.path;
+
+  if ( node->skip == DirScanner::Node::Excluded )
+    return;
+
+  if ( node->skip == DirScanner::Node::Filtered )
+  {
+    if ( interactive || verbose )
+      emit logging(i18n("...skipping filtered directory %1", absolutePath));
+
+    return;
+  }
+
+  // add the dir itself
+  if ( dir.error )
+  {
+    unreadDirs.insert(absolutePath);
+    emit warning(i18n("Could not get information of directory: %1\n"
+                      "The operating system reports: %2",
+                 absolutePath,
+                 QString::fromLatin1(strerror(dir.error))));
+    return;
+  }
+
+  // normally a scanner thread has read the dir already
+  while ( !dirScanner.waitScanned(node, 50) )
+  {
+    qApp->processEvents(QEventLoop::AllEvents, 5);
+    if ( cancelled ) return;
+  }
+
+  if ( node->openError )
+  {
+    unreadDirs.insert(absolutePath);
+    emit warning(i18n("Directory '%1' is not readable. Skipping.", absolutePath));
+    skippedFiles = true;
+    return;
+  }
+
+  handledFiles++;
+
+  qApp->processEvents(QEventLoop::AllEvents, 5);
+  if ( cancelled ) return;
+
+  // an incremental backup needs the directory only when something below it is archived,
+  // or when the directory itself changed (e.g. it is new or files were removed)
+  pendingDirs.append(dir);
+
+  if ( !isIncrementalBackup() || (dir.lastModified() >= lastBackup) )
+  {
+    writePendingDirs();
+    if ( cancelled ) return;
+  }
+
+  if ( node->readError )
+  {
+    unreadDirs.insert(absolutePath);
+    emit warning(i18n("Could not read directory: %1\n"
+                      "The operating system reports: %2",
+                 absolutePath,
+                 QString::fromLatin1(strerror(node->readError))));
+    skippedFiles = true;
+
+    if ( !pendingDirs.isEmpty() )
+      pendingDirs.removeLast();
+    return;
+  }
+
+  const QVector<FileEntry> &entries = node->entries;
+
+  for (int i = 0, subdir = 0; !cancelled && (i < entries.count()); i++)
+  {
+    if ( entries[i].isDir() )
+    {
+      addDirFiles(node->subdirs[subdir]);
+      dirScanner.release(node, subdir);
+      subdir++;
+    }
+    else
+      addFile(entries[i], node->excludes ? node->excludes->child(entries[i].name) : nullptr);
+  }
+
+  // still pending: nothing below it was archived
+  if ( !pendingDirs.isEmpty() && (pendingDirs.last().path == absolutePath) )
+    pendingDirs.removeLast();
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::writePendingDirs()
+{
+  // outermost first, so that tar creates them in order
+  for (int i = 0; (i < pendingDirs.count()) && !cancelled; i++)
+  {
+    const FileEntry &dir = pendingDirs[i];
+
+    totalFiles++;
+    emit totalFilesChanged(totalFiles);
+    if ( interactive || verbose )
+      emit logging(dir.path);
+
+    if ( chunkStore.isOpen() )
+    {
+      if ( !chunkStore.addDir(dir) )
+      {
+        emitArchiveError();
+        cancel();
+      }
+    }
+    else if ( useCompressQueue() )
+      queueDir(dir);
+    else
+      addDir(dir);
+  }
+
+  pendingDirs.clear();
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::fileIsFiltered(const QString &fileName) const
+{
+  return filters.matches(fileName);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::isExcluded(const QString &path) const
+{
+  const PathTrie::Node *node = excludeTrie.find(QStringLiteral("/"));
+
+  foreach (const QString &name, path.split(QLatin1Char('/'), QString::SkipEmptyParts))
+  {
+    if ( !node )
+      return false;
+
+    if ( node->isExcludedDir() )
+      return true;
+
+    node = node->child(name);
+  }
+
+  return node && (node->isExcludedDir() || node->isExcludedFile());
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::isFilteredPath(const QString &path) const
+{
+  if ( fileIsFiltered(path.section(QLatin1Char('/'), -1)) )
+    return true;
+
+  // the directory filters match the absolute path of a directory
+  for (int i = path.indexOf(QLatin1Char('/'), 1); i != -1; i = path.indexOf(QLatin1Char('/'), i + 1))
+  {
+    if ( dirFilters.matches(path.left(i)) )
+      return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::isInUnreadDir(const QString &path) const
+{
+  if ( unreadDirs.isEmpty() )
+    return false;
+
+  if ( unreadDirs.contains(path) )
+    return true;
+
+  for (int i = path.indexOf(QLatin1Char('/'), 1); i != -1; i = path.indexOf(QLatin1Char('/'), i + 1))
+  {
+    if ( unreadDirs.contains(path.left(i)) )
+      return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::addFile(const FileEntry &entry, const PathTrie::Node *excludes)
+{
+  if ( fileIsFiltered(entry.name) )
+  {
+    filteredFiles++;
+    return;
+  }
+
+  if ( excludes && excludes->isExcludedFile() )
+    return;
+
+  // avoid including my own archive file
+  // startsWith() is needed as KDE4 KTar does not create directly the .tar file but until it's closed
+  // the file is named "...tarXXXX.new"
+  if ( entry.path.startsWith(archivePath) )
+    return;
+
+  if ( cancelled ) return;
+
+  // between two files nothing is written into the slice
+  if ( spaceCheckDue )
+  {
+    spaceCheckDue = false;
+    checkTargetSpace();
+    if ( cancelled ) return;
+  }
+
+  if ( entry.error )
+  {
+    emit warning(i18n("Could not get information of file: %1\n"
+                      "The operating system reports: %2",
+                 entry.path,
+                 QString::fromLatin1(strerror(entry.error))));
+    skippedFiles = true;
+    return;
+  }
+
+  if ( isIncrementalBackup() )
+  {
+    qint64 pos = -1;
+
+    if ( isUnchanged(entry, pos) )
+    {
+      // still part of the backup set
+      fileIndex.add(entry, (pos != -1) ? fileIndex.contentHash(pos) : 0);
+      filteredFiles++;
+      return;
+    }
+
+    // e.g. touched by a build; an older backup has this content already
+    quint64 hash = 0;
+    if ( hashContent && hasSameContent(entry, pos, hash) )
+    {
+      if ( verbose )
+        emit logging(i18n("...only the times changed: %1", entry.path));
+
+      fileIndex.add(entry, hash);
+      sameContentFiles++;
+      filteredFiles++;
+      return;
+    }
+
+    if ( cancelled ) return;
+  }
+
+  // the file is archived, so the directories above it are needed
+  if ( !pendingDirs.isEmpty() )
+  {
+    writePendingDirs();
+    if ( cancelled ) return;
+  }
+
+  // counted when started; the moving average of the throughput smooths this out
+  handledFiles++;
+  if ( !entry.isSymLink() )
+    handledBytes += entry.size;
+
+  // the content is already in the repository; the snapshot gets the chunks of the last one
+  if ( chunkStore.isOpen() && !entry.isSymLink() && chunkStore.addUnchangedFile(entry) )
+  {
+    fileIndex.add(entry);
+
+    totalFiles++;
+    emit totalFilesChanged(totalFiles);
+    return;
+  }
+
+  /* don't skip. We probably do not need to read it anyway, since it might be empty
+  if ( ! info.isReadable() )
+  {
+    emit warning(i18n("File '%1' is not readable. Skipping.").arg(info.absoluteFilePath()));
+    skippedFiles = true;
+    return;
+  }
+  */
+
+  // emit before we do the compression, so that the receiver can already show
+  // with which file we work
+
+  // show filename + size
+  if ( interactive || verbose )
+    emit logging(entry.path + QStringLiteral(" (%1)").arg(KIO::convertSize(entry.size)));
+
+  qApp->processEvents(QEventLoop::AllEvents, 5);
+  if ( cancelled ) return;
+
+  // a large file is compressed by zstd's own threads instead of a single worker of the pool.
+  // The queue is written first, so that the pool is idle meanwhile
+  const bool queued = useCompressQueue() && (entry.isSymLink() || !codec.usesThreads(entry.size));
+
+  if ( useCompressQueue() && !queued )
+  {
+    writeQueuedEntries(0);
+    if ( cancelled ) return;
+  }
+
+  // further names of an inode become hard links to the first one archived
+  // into the same slice. A chunk repository stores the content only once anyway
+  const bool linked = (entry.links > 1) && !entry.isSymLink() && !chunkStore.isOpen();
+  QString linkTarget;
+  int linkSlice = HardLinkTable::PENDING;
+  if ( linked )
+    linkTarget = hardLinks.linkTarget(entry, memberName(entry), sliceNum, linkSlice);
+
+  if ( queued )
+  {
+    queueFile(entry, linkTarget, linkSlice);  // totals are updated when the entry is written
+    return;
+  }
+
+  if ( !linkTarget.isEmpty() )
+  {
+    AddFileStatus ret = addHardLink(entry, linkTarget);
+
+    if ( ret == Error )
+    {
+      cancel();
+      return;
+    }
+    else if ( ret == Added )
+    {
+      fileIndex.add(entry);
+
+      totalFiles++;
+      emit totalFilesChanged(totalFiles);
+      return;
+    }
+
+    // the slice is full; the content is stored again in the next one
+    hardLinks.retarget(entry, memberName(entry));
+  }
+
+  if ( entry.isSymLink() )
+  {
+    if ( addSymLink(entry) )
+      fileIndex.add(entry);
+
+    totalFiles++;
+    emit totalFilesChanged(totalFiles);
+    return;
+  }
+
+  if ( chunkStore.isOpen() )
+  {
+    AddFileStatus ret = addChunkedFile(entry);   // this also increases totalBytes
+
+    if ( ret == Error )
+    {
+      cancel();
+      return;
+    }
+    else if ( ret == Skipped )
+    {
+      skippedFiles = true;
+      return;
+    }
+  }
+  else if ( !getCompressFiles() )
+  {
+    AddFileStatus ret = addLocalFile(entry);   // this also increases totalBytes
+
+    if ( ret == Error )
+    {
+      cancel();  //  we must cancel as the tar-file is now corrupt (file was only partly written)
+      return;
+    }
+    else if ( ret == Skipped )
+    {
+      hardLinks.failed(entry);  // the next name is stored in full
+      skippedFiles = true;
+      return;
+    }
+  }
+  else  // add the file compressed
+  {
+    // as we can't know which size the file will have after compression,
+    // we compress the file into a buffer and put this into the archive.
+    // Only large files end up in a temporary file
+    SpillBuffer comprBuffer(compressBufferSize);
+
+    if ( ! compressFile(entry.path, comprBuffer) || cancelled )
+    {
+      hardLinks.failed(entry);
+      return;
+    }
+
+    // here we have the compressed file in comprBuffer
+
+    comprBuffer.open(QIODevice::ReadOnly);
+
+    AddFileStatus ret = addCompressedFile(entry, comprBuffer);
+
+    if ( ret == Error )
+    {
+      cancel();
+      return;
+    }
+    else if ( ret == Skipped )
+    {
+      hardLinks.failed(entry);
+      skippedFiles = true;
+      return;
+    }
+  }
+
+  if ( linked )
+    hardLinks.stored(entry, memberName(entry), memberSlice);
+
+  // every way to add the file hashed the content on the way
+  fileIndex.add(entry, hashContent ? contentHash.result() : 0);
+  sliceIndex.setChecksum(hashContent ? contentHash.result() : 0);
+
+  totalFiles++;
+  emit totalFilesChanged(totalFiles);
+  emit totalBytesChanged(totalBytes);
+
+  qApp->processEvents(QEventLoop::AllEvents, 5);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::isUnchanged(const FileEntry &entry, qint64 &pos)
+{
+  pos = -1;
+
+  if ( !fileIndex.isOpen() )
+    return entry.lastModified() < lastBackup;
+
+  pos = fileIndex.find(entry);
+  if ( pos == -1 )  // new, or another file got the inode
+    return false;
+
+  fileIndex.markSeen(pos);
+  return fileIndex.isUnchanged(pos, entry);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::hasSameContent(const FileEntry &entry, qint64 pos, quint64 &hash)
+{
+  if ( (pos == -1) || entry.isSymLink() )
+    return false;
+
+  const quint64 stored = fileIndex.contentHash(pos);
+
+  // a different size is a different content anyway
+  if ( !stored || (fileIndex.record(pos).size != entry.size) )
+    return false;
+
+  return hashFile(entry, hash) && (hash == stored);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::hashFile(const FileEntry &entry, quint64 &hash)
+{
+  QFile file(entry.path);
+
+  if ( !file.open(QIODevice::ReadOnly | QIODevice::Unbuffered) || !allocateBuffer(entry.blockSize) )
+    return false;
+
+  contentHash.reset();
+  readCache.startReading(file.handle(), cacheMode);
+
+  qint64 hashed = 0;
+  int count = 0;
+  const int interval = eventInterval(ioBuffer.size());
+  bool ok = true;
+
+  while ( !cancelled )
+  {
+    const qint64 len = file.read(ioBuffer.data(), ioBuffer.size());
+
+    if ( len <= 0 )  // end of file, or the file will fail again when archived
+    {
+      ok = (len == 0);
+      break;
+    }
+
+    contentHash.addData(ioBuffer.data(), len);
+    readCache.doneReading(hashed, len);
+    hashed += len;
+
+    count = (count + 1) % interval;
+    if ( count == 0 )
+      qApp->processEvents(QEventLoop::AllEvents, 5);
+  }
+
+  readCache.stop();
+
+  hash = contentHash.result();
+  return ok && !cancelled;
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::addSymLink(const FileEntry &entry)
+{
+  char target[PATH_MAX + 1];
+  ssize_t len = ::readlink(QFile::encodeName(entry.path).constData(), target, PATH_MAX);
+
+  if ( len == -1 )
+  {
+    emit warning(i18n("Could not read the symbolic link: %1\n"
+                      "The operating system reports: %2",
+                 entry.path,
+                 QString::fromLatin1(strerror(errno))));
+    skippedFiles = true;
+    return false;
+  }
+  target[len] = 0;
+
+  if ( chunkStore.isOpen() )
+  {
+    if ( !chunkStore.addSymLink(entry, QFile::decodeName(target)) )
+    {
+      emitArchiveError();
+      return false;
+    }
+
+    return true;
+  }
+
+  const qint64 offset = archive->device()->pos();
+
+  if ( ! archive->writeSymLink(QStringLiteral(".") + entry.path, QFile::decodeName(target),
+                               entry.owner(), entry.group(),
+                               entry.mode, entry.lastRead(), entry.lastModified(), entry.created()) )
+  {
+    emitArchiveError();
+    return false;
+  }
+
+  sliceIndex.add(SliceIndex::SymLink, QDir::cleanPath(QStringLiteral(".") + entry.path), offset, 0, entry.lastModified());
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::addDir(const FileEntry &dir)
+{
+  const qint64 offset = archive->device()->pos();
+
+  if ( ! archive->writeDir(QStringLiteral(".") + dir.path, dir.owner(), dir.group(),
+                           dir.mode, dir.lastRead(), dir.lastModified(), dir.created()) )
+  {
+    emit warning(i18n("Could not write directory '%1' to archive.\n"
+                      "Maybe the medium is full.", dir.path));
+    return;
+  }
+
+  sliceIndex.add(SliceIndex::Dir, QDir::cleanPath(QStringLiteral(".") + dir.path), offset, 0, dir.lastModified());
+}
+
+//--------------------------------------------------------------------------------
+
+Archiver::AddFileStatus Archiver::addCompressedFile(const FileEntry &entry, QIODevice &comprDevice)
+{
+  if ( (sliceBytes + comprDevice.size()) > sliceCapacity )
+    if ( ! getNextSlice() ) return Error;
+
+  const qint64 offset = archive->device()->pos();
+
+  // the entry holds the metadata (permission, date, owner) of the original file
+  if ( ! archive->prepareWriting(QStringLiteral(".") + entry.path + ext,
+                                 entry.owner(), entry.group(), comprDevice.size(),
+                                 entry.mode, entry.lastRead(), entry.lastModified(), entry.created()) )
+  {
+    emitArchiveError();
+    return Error;
+  }
+
+  sliceIndex.add(SliceIndex::File, memberName(entry), offset, comprDevice.size(), entry.lastModified());
+  memberSlice = sliceNum;
+
+  if ( ! allocateBuffer(0) )
+    return Error;
+
+  qint64 len;
+  int count = 0;
+  const int interval = eventInterval(ioBuffer.size());
+  while ( ! comprDevice.atEnd() )
+  {
+    len = comprDevice.read(ioBuffer.data(), ioBuffer.size());
+
+    if ( len < 0 )  // error in reading
+    {
+      emit warning(i18n("Could not read from file '%1'\n"
+                        "The operating system reports: %2",
+                   entry.path,
+                   comprDevice.errorString()));
+      return Error;
+    }
+
+    if ( ! archive->writeData(ioBuffer.data(), len) )
+    {
+      emitArchiveError();
+      return Error;
+    }
+
+    count = (count + 1) % interval;
+    if ( count == 0 )
+    {
+      qApp->processEvents(QEventLoop::AllEvents, 5);
+      if ( cancelled ) return Error;
+    }
+  }
+  if ( ! archive->finishWriting(comprDevice.size()) )
+  {
+    emitArchiveError();
+    return Error;
+  }
+
+  // get filesize
+  sliceBytes = getSliceBytes();
+  totalBytes += comprDevice.size();
+
+  if ( sliceFile )
+    sliceCache.written(sliceFile->pos());
+
+  emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
+
+  return Added;
+}
+
+//--------------------------------------------------------------------------------
+
+Archiver::AddFileStatus Archiver::addHardLink(const FileEntry &entry, const QString &target)
+{
+  // KTar can not write hard links; the header goes directly between its entries
+  const QByteArray header = TarHeader::hardLink(memberName(entry), target, entry);
+
+  // the target must stay in the same slice
+  if ( (sliceBytes + header.size()) > sliceCapacity )
+    return Skipped;
+
+  const qint64 offset = archive->device()->pos();
+
+  if ( archive->device()->write(header) != header.size() )
+  {
+    emitArchiveError();
+    return Error;
+  }
+
+  sliceIndex.add(SliceIndex::HardLink, memberName(entry), offset, 0, entry.lastModified());
+
+  sliceBytes = getSliceBytes();
+
+  if ( sliceFile )
+    sliceCache.written(sliceFile->pos());
+
+  emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
+
+  return Added;
+}
+
+//--------------------------------------------------------------------------------
+
+QString Archiver::memberName(const FileEntry &entry) const
+{
+  // as KTar stores it: a clean relative path
+  return QDir::cleanPath(QStringLiteral(".") + entry.path + (getCompressFiles() ? ext : QString()));
+}
+
+//--------------------------------------------------------------------------------
+
+QString Archiver::writeSliceIndex()
+{
+  const QString indexName = SliceIndex::fileNameForSlice(archiveName);
+
+  if ( !sliceIndex.write(indexName) )
+  {
+    emit warning(i18n("Could not write the index %1 of the slice: %2", indexName, sliceIndex.errorString()));
+    return QString();
+  }
+
+  return indexName;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::queueDir(const FileEntry &dir)
+{
+  QueuedEntry entry;
+  entry.type = QueuedEntry::Dir;
+  entry.file = dir;
+  entry.job = nullptr;
+
+  compressQueue.append(entry);
+  writeQueuedEntries(compressWorkers * 2);
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::queueFile(const FileEntry &file, const QString &linkTarget, int linkSlice)
+{
+  QueuedEntry entry;
+  entry.file = file;
+  entry.linkSlice = HardLinkTable::PENDING;
+
+  if ( !linkTarget.isEmpty() )
+  {
+    entry.type = QueuedEntry::HardLink;
+    entry.linkTarget = linkTarget;
+    entry.linkSlice = linkSlice;
+    entry.job = nullptr;
+  }
+  else if ( file.isSymLink() )
+  {
+    entry.type = QueuedEntry::SymLink;
+    entry.job = nullptr;
+  }
+  else
+  {
+    entry.type = QueuedEntry::File;
+
+    // the pool already compresses compressWorkers files at once;
+    // zstd threads for each of them would oversubscribe the CPUs
+    CompressionCodec jobCodec(codec);
+    jobCodec.setWorkers(1);
+
+    entry.job = new CompressJob(file.path, jobCodec, compressBufferSize, cacheMode);
+    compressPool.start(entry.job);
+    queuedJobs++;
+  }
+
+  compressQueue.append(entry);
+
+  // keep the workers busy, but do not let them run away too far from the
+  // archive writer, since every finished job keeps its compressed data
+  writeQueuedEntries(compressWorkers * 2);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::queuedFileWritten(const FileEntry &file, AddFileStatus ret, quint64 hash)
+{
+  if ( ret == Error )
+  {
+    cancel();
+    return false;
+  }
+
+  if ( ret == Skipped )
+  {
+    // the next name is stored in full; the names already queued find out
+    // when they are written, as their target stays pending
+    hardLinks.failed(file);
+    skippedFiles = true;
+    return true;
+  }
+
+  if ( file.links > 1 )
+  {
+    hardLinks.stored(file, memberName(file), memberSlice);
+
+    // the names of the inode queued behind it can now be linked to it
+    for (QueuedEntry &queued : compressQueue)
+    {
+      if ( (queued.type == QueuedEntry::HardLink) &&
+           (queued.file.device == file.device) && (queued.file.inode == file.inode) )
+      {
+        queued.linkTarget = memberName(file);
+        queued.linkSlice = memberSlice;
+      }
+    }
+  }
+
+  fileIndex.add(file, hashContent ? hash : 0);
+  sliceIndex.setChecksum(hashContent ? hash : 0);
+
+  totalFiles++;
+  emit totalFilesChanged(totalFiles);
+  emit totalBytesChanged(totalBytes);
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::writeQueuedEntries(int maxJobs)
+{
+  while ( !compressQueue.isEmpty() && !cancelled )
+  {
+    CompressJob *job = compressQueue.first().job;
+
+    if ( job && !job->isDone() )
+    {
+      if ( queuedJobs <= maxJobs )
+        return;
+
+      // stay responsive while we wait for the head of the queue
+      qApp->processEvents(QEventLoop::AllEvents, 5);
+      job->waitForDone(50);
+      continue;
+    }
+
+    QueuedEntry entry = compressQueue.takeFirst();
+    const FileEntry &file = entry.file;
+
+    if ( entry.type == QueuedEntry::Dir )
+      addDir(file);
+    else if ( entry.type == QueuedEntry::SymLink )
+    {
+      if ( addSymLink(file) )
+        fileIndex.add(file);
+
+      totalFiles++;
+      emit totalFilesChanged(totalFiles);
+    }
+    else if ( entry.type == QueuedEntry::HardLink )
+    {
+      AddFileStatus ret = Skipped;
+
+      // the target was written into the current slice
+      if ( entry.linkSlice == sliceNum )
+        ret = addHardLink(file, entry.linkTarget);
+
+      if ( ret == Error )
+      {
+        cancel();
+        return;
+      }
+      else if ( ret == Added )
+      {
+        fileIndex.add(file);
+
+        totalFiles++;
+        emit totalFilesChanged(totalFiles);
+      }
+      else
+      {
+        // the target failed or is in an earlier slice: this name gets the content
+        // again and becomes the target of the following names
+        hardLinks.retarget(file, memberName(file));
+
+        SpillBuffer comprBuffer(compressBufferSize);
+
+        if ( compressFile(file.path, comprBuffer) && !cancelled )
+        {
+          comprBuffer.open(QIODevice::ReadOnly);
+          ret = addCompressedFile(file, comprBuffer);
+        }
+
+        if ( ! queuedFileWritten(file, ret, contentHash.result()) )
+          return;
+      }
+    }
+    else
+    {
+      queuedJobs--;
+
+      AddFileStatus ret = Skipped;
+      quint64 hash = 0;
+
+      if ( job->isOk() )
+      {
+        job->getBuffer().open(QIODevice::ReadOnly);
+        ret = addCompressedFile(file, job->getBuffer());
+        hash = job->getContentHash();
+      }
+      else
+        emit warning(job->getErrorString());
+
+      delete job;
+
+      if ( ! queuedFileWritten(file, ret, hash) )
+        return;
+    }
+
+    qApp->processEvents(QEventLoop::AllEvents, 5);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::discardQueuedEntries()
+{
+  // only left over when the backup was cancelled
+  foreach (const QueuedEntry &entry, compressQueue)
+    if ( entry.job )
+      entry.job->cancel();
+
+  compressPool.waitForDone();
+
+  foreach (const QueuedEntry &entry, compressQueue)
+    delete entry.job;
+
+  compressQueue.clear();
+  queuedJobs = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+Archiver::AddFileStatus Archiver::addLocalFile(const FileEntry &entry)
+{
+  QFile sourceFile(entry.path);
+
+  // if the size is 0 (e.g. a pipe), don't open it since we will not read any content
+  // and Qt hangs when opening a pipe
+  if ( (entry.size > 0) && !sourceFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) )
+  {
+    emit warning(i18n("Could not open file '%1' for reading.", entry.path));
+    return Skipped;
+  }
+
+  if ( ! allocateBuffer(entry.blockSize) )
+    return Error;
+
+  // a file which does not fit continues in the next slice, so that every slice is filled.
+  // With a compressed slice we can't know how much the file will need,
+  // so the uncompressed size is used as the upper limit and the file starts a new slice.
+  // The reader of a pipe does not know where a slice ends, so there the file starts a new slice, too
+  const bool split = !sliceFilter && !pipeDevice;
+
+  // fewer blocks allocated than the size needs: look for holes.
+  // A sparse member can not be continued in the next slice; one larger than a whole slice
+  // is stored with its holes as zeros, which can
+  QVector<TarHeader::Extent> extents;
+  if ( (entry.allocated < entry.size) && findDataExtents(sourceFile.handle(), entry.size, extents) &&
+       (!split || (sparseStoredSize(memberName(entry), entry, extents) <= static_cast<qint64>(sliceCapacity))) )
+    return addSparseFile(entry, sourceFile, extents);
+
+  if ( (sliceBytes + entry.size) > sliceCapacity )
+    if ( !split || ((sliceBytes + MIN_SPLIT_ROOM) > sliceCapacity) )
+      if ( ! getNextSlice() ) return Error;
+
+  const qint64 offset = archive->device()->pos();
+
+  if ( ! archive->prepareWriting(QStringLiteral(".") + entry.path,
+                                 entry.owner(), entry.group(), entry.size,
+                                 entry.mode, entry.lastRead(), entry.lastModified(), entry.created()) )
+  {
+    emitArchiveError();
+    return Error;
+  }
+
+  sliceIndex.add(SliceIndex::File, memberName(entry), offset, entry.size, entry.lastModified());
+  memberSlice = sliceNum;
+
+  qint64 room = split ? sliceRoom() : INT64_MAX;  // for content in the current slice
+
+  qint64 len;
+  int count = 0, progress;
+  QTime timer;
+  timer.start();
+  bool msgShown = false;
+  qint64 written = 0;
+  bool failed = false;
+
+  // an uncompressed local slice gets the file content directly from the kernel.
+  // Everything KTar wrote so far must be in the file before
+  off_t slicePos = 0;
+  // which is not possible when we need to see the data for the hash
+  bool zeroCopy = (entry.size > 0) && !hashContent && sliceFile && !sliceFilter && sliceFile->flush();
+  if ( zeroCopy )
+    slicePos = sliceFile->pos();
+
+  const int interval = eventInterval(zeroCopy ? COPY_CHUNK : ioBuffer.size());
+
+  // O_DIRECT does not work with copying inside the kernel
+  if ( entry.size > 0 )
+  {
+    readCache.startReading(sourceFile.handle(),
+                           (zeroCopy && (cacheMode == PageCache::Direct)) ? PageCache::Friendly : cacheMode);
+  }
+
+  // a file larger than our buffer is read ahead in a separate thread,
+  // so that reading the file and writing the archive overlap
+  bool readAhead = !zeroCopy && (entry.size > ioBuffer.size()) &&
+                   fileReader.startReading(sourceFile.handle(), entry.size, ioBuffer.size());
+
+  contentHash.reset();
+
+  while ( entry.size && !cancelled )
+  {
+    char *data = ioBuffer.data();
+
+    if ( zeroCopy )
+    {
+      if ( written == entry.size )  // never more than announced in the tar header
+        break;
+
+      if ( room == 0 )
+      {
+        // the slice ends behind the copied content, and the next one needs its
+        // header in the file before copying goes on
+        if ( !sliceFile->seek(slicePos) )
+        {
+          emitArchiveError();
+          failed = true;
+          break;
+        }
+
+        if ( !continueInNextSlice(entry, written, room) )
+        {
+          failed = true;
+          break;
+        }
+
+        if ( !sliceFile->flush() )
+        {
+          emitArchiveError();
+          failed = true;
+          break;
+        }
+
+        slicePos = sliceFile->pos();
+      }
+
+      len = copyRange(sourceFile.handle(), written, sliceFile->handle(), slicePos,
+                      static_cast<size_t>(qMin(qMin(COPY_CHUNK, entry.size - written), room)));
+
+      // e.g. a filesystem which supports none of the copy methods
+      if ( (len < 0) && (errno == EINVAL) && (written == 0) )
+      {
+        zeroCopy = false;
+        continue;
+      }
+
+      if ( len < 0 )
+      {
+        emit warning(i18n("Could not copy file '%1' into the archive\n"
+                          "The operating system reports: %2",
+                     entry.path,
+                     QString::fromLatin1(strerror(errno))));
+        failed = true;
+        break;
+      }
+    }
+    else if ( readAhead )
+    {
+      len = fileReader.nextChunk(data, 100);
+
+      if ( len == FileReader::Pending )
+      {
+        qApp->processEvents(QEventLoop::AllEvents, 5);
+        continue;
+      }
+    }
+    else
+    {
+      if ( sourceFile.atEnd() )
+        break;
+
+      len = sourceFile.read(data, ioBuffer.size());
+    }
+
+    if ( len == 0 )  // end of file
+      break;
+
+    if ( len < 0 )  // error in reading
+    {
+      emit warning(i18n("Could not read from file '%1'\n"
+                        "The operating system reports: %2",
+                   entry.path,
+                   readAhead ? fileReader.errorString() : sourceFile.errorString()));
+      failed = true;
+      break;
+    }
+
+    if ( zeroCopy )
+    {
+      slicePos += len;
+      room -= len;
+    }
+    else
+    {
+      // a chunk reaching beyond the slice is continued in the next one
+      for (qint64 done = 0; done < len; )
+      {
+        if ( (room == 0) && !continueInNextSlice(entry, written + done, room) )
+        {
+          failed = true;
+          break;
+        }
+
+        const qint64 part = qMin(len - done, room);
+
+        if ( ! archive->writeData(data + done, part) )
+        {
+          emitArchiveError();
+          failed = true;
+          break;
+        }
+
+        done += part;
+        room -= part;
+      }
+
+      if ( failed )
+        break;
+
+      if ( hashContent )
+        contentHash.addData(data, len);
+    }
+
+    readCache.doneReading(written, len);
+    if ( sliceFile )
+      sliceCache.written(zeroCopy ? slicePos : sliceFile->pos());
+
+    totalBytes += len;
+    written += len;
+
+    progress = static_cast<int>(written * 100 / entry.size);
+
+    // stay responsive
+    count = (count + 1) % interval;
+    if ( count == 0 )
+    {
+      if ( msgShown )
+        emit fileProgress(progress);
+
+      emit totalBytesChanged(totalBytes);
+      qApp->processEvents(QEventLoop::AllEvents, 5);
+    }
+
+    if ( !msgShown && (timer.elapsed() > 3000) && (progress < 50) )
+    {
+      emit fileProgress(progress);
+      if ( interactive || verbose )
+        emit logging(i18n("...archiving file %1", entry.path));
+
+      if ( interactive )
+        QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
+      qApp->processEvents(QEventLoop::AllEvents, 5);
+      msgShown = true;
+    }
+  }
+
+  if ( readAhead )
+    fileReader.stopReading();  // before the file is closed
+
+  readCache.stop();
+
+  // KTar continues behind the copied content.
+  // A cancel() while events were processed has already removed the slice
+  if ( zeroCopy && !failed && !cancelled && sliceFile && !sliceFile->seek(slicePos) )
+  {
+    emitArchiveError();
+    failed = true;
+  }
+
+  if ( failed || cancelled )
+    return Error;
+
+  emit fileProgress(100);
+  sourceFile.close();
+
+  if ( !cancelled )
+  {
+    // get filesize
+    sliceBytes = getSliceBytes();
+
+    emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
+  }
+
+  if ( msgShown && interactive )
+    QApplication::restoreOverrideCursor();
+
+  // a continued file started at a block boundary, so the size gives the padding of the last part
+  if ( !cancelled && !archive->finishWriting(entry.size) )
+  {
+    emitArchiveError();
+    return Error;
+  }
+
+  return cancelled ? Error : Added;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 Archiver::sliceRoom() const
+{
+  const KIO::filesize_t used = getSliceBytes();
+
+  if ( used >= sliceCapacity )
+    return 0;
+
+  return static_cast<qint64>((sliceCapacity - used) / TarHeader::BLOCK_SIZE * TarHeader::BLOCK_SIZE);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::continueInNextSlice(const FileEntry &entry, qint64 offset, qint64 &room)
+{
+  // the current slice ends in the middle of the file's content
+  if ( ! getNextSlice() )
+    return false;
+
+  const QByteArray header = TarHeader::continuation(memberName(entry), entry.size - offset, offset);
+  const qint64 headerOffset = archive->device()->pos();
+
+  if ( archive->device()->write(header) != header.size() )
+  {
+    emitArchiveError();
+    return false;
+  }
+
+  sliceIndex.add(SliceIndex::Continued, memberName(entry), headerOffset, entry.size - offset, entry.lastModified());
+
+  if ( interactive || verbose )
+    emit logging(i18n("...continuing file %1 in slice %2", entry.path, sliceNum));
 
-  return false;
+  room = sliceRoom();
+  return true;
 }
 
 //--------------------------------------------------------------------------------
 
-void Archiver::addFile(const QFileInfo &info)
+Archiver::AddFileStatus Archiver::addSparseFile(const FileEntry &entry, QFile &sourceFile,
+                                                const QVector<TarHeader::Extent> &extents)
 {
-  if ( (isIncrementalBackup() && (info.lastModified() < lastBackup)) ||
-       fileIsFiltered(info.fileName()) )
-  {
-    filteredFiles++;
-    return;
-  }
+  qint64 dataBytes = 0;
+  foreach (const TarHeader::Extent &extent, extents)
+    dataBytes += extent.length;
 
-  if ( excludeFiles.contains(info.absoluteFilePath()) )
-    return;
+  const QByteArray map = TarHeader::sparseMap(extents, entry.size);
+  const QByteArray header = TarHeader::sparseHeader(memberName(entry), map.size() + dataBytes, entry);
 
-  // avoid including my own archive file
-  // (QFileInfo to have correct path comparison even in case archiveName contains // etc.)
-  // startsWith() is needed as KDE4 KTar does not create directly the .tar file but until it's closed
-  // the file is named "...tarXXXX.new"
-  if ( info.absoluteFilePath().startsWith(QFileInfo(archiveName).absoluteFilePath()) )
-    return;
+  // only what is stored counts, which is known exactly here
+  const qint64 storedSize = header.size() + map.size() + dataBytes;
 
-  if ( cancelled ) return;
+  if ( (sliceBytes + storedSize) > sliceCapacity )
+    if ( ! getNextSlice() ) return Error;
 
-  /* don't skip. We probably do not need to read it anyway, since it might be empty
-  if ( ! info.isReadable() )
+  // the new slice got less space than the last one had
+  if ( !sliceFilter && !pipeDevice && (storedSize > static_cast<qint64>(sliceCapacity)) )
   {
-    emit warning(i18n("File '%1' is not readable. Skipping.").arg(info.absoluteFilePath()));
-    skippedFiles = true;
-    return;
+    emit warning(i18n("The sparse file '%1' needs %2, which does not fit into a slice. Skipping.",
+                      entry.path, KIO::convertSize(storedSize)));
+    return Skipped;
   }
-  */
-
-  // emit before we do the compression, so that the receiver can already show
-  // with which file we work
 
-  // show filename + size
-  if ( interactive || verbose )
-    emit logging(info.absoluteFilePath() + QStringLiteral(" (%1)").arg(KIO::convertSize(info.size())));
-
-  qApp->processEvents(QEventLoop::AllEvents, 5);
-  if ( cancelled ) return;
+  QIODevice *device = archive->device();
+  const qint64 offset = device->pos();
 
-  if ( info.isSymLink() )
+  if ( (device->write(header) != header.size()) || (device->write(map) != map.size()) )
   {
-    archive->addLocalFile(info.absoluteFilePath(), QStringLiteral(".") + info.absoluteFilePath());
-    totalFiles++;
-    emit totalFilesChanged(totalFiles);
-    return;
+    emitArchiveError();
+    return Error;
   }
 
-  if ( !getCompressFiles() )
-  {
-    AddFileStatus ret = addLocalFile(info);   // this also increases totalBytes
+  sliceIndex.add(SliceIndex::SparseFile, memberName(entry), offset, map.size() + dataBytes, entry.lastModified());
+  memberSlice = sliceNum;
 
-    if ( ret == Error )
-    {
-      cancel();  //  we must cancel as the tar-file is now corrupt (file was only partly written)
-      return;
-    }
-    else if ( ret == Skipped )
-    {
-      skippedFiles = true;
-      return;
-    }
-  }
-  else  // add the file compressed
-  {
-    // as we can't know which size the file will have after compression,
-    // we create a compressed file and put this into the archive
-    QTemporaryFile tmpFile;
+  if ( verbose )
+    emit logging(i18n("...sparse file, storing %1 of data", KIO::convertSize(dataBytes)));
 
-    if ( ! compressFile(info.absoluteFilePath(), tmpFile) || cancelled )
-      return;
+  // the extents are not read in one sequence, which O_DIRECT would need to be aligned
+  readCache.startReading(sourceFile.handle(),
+                         (cacheMode == PageCache::Direct) ? PageCache::Friendly : cacheMode);
 
-    // here we have the compressed file in tmpFile
+  contentHash.reset();
 
-    tmpFile.open();  // size() only works if open
+  int count = 0;
+  const int interval = eventInterval(ioBuffer.size());
+  qint64 hashed = 0;  // the hash covers the holes as zeros
+  bool failed = false;
+
+  for (int i = 0; (i < extents.count()) && !failed && !cancelled; i++)
+  {
+    const TarHeader::Extent &extent = extents[i];
 
-    if ( (sliceBytes + tmpFile.size()) > sliceCapacity )
-      if ( ! getNextSlice() ) return;
+    if ( hashContent )
+      hashZeros(contentHash, extent.offset - hashed);
 
-    // to be able to create the exact same metadata (permission, date, owner) we need
-    // to fill the file into the archive with the following:
+    for (qint64 done = 0; (done < extent.length) && !cancelled; )
     {
-      struct stat status;
-      memset(&status, 0, sizeof(status));
+      char *data = ioBuffer.data();
+      const qint64 wanted = qMin(static_cast<qint64>(ioBuffer.size()), extent.length - done);
+      qint64 len = ::pread(sourceFile.handle(), data, static_cast<size_t>(wanted), extent.offset + done);
 
-      if ( ::stat(QFile::encodeName(info.absoluteFilePath()).constData(), &status) == -1 )
+      if ( len < 0 )
       {
-        emit warning(i18n("Could not get information of file: %1\n"
+        emit warning(i18n("Could not read from file '%1'\n"
                           "The operating system reports: %2",
-                     info.absoluteFilePath(),
+                     entry.path,
                      QString::fromLatin1(strerror(errno))));
+        failed = true;
+        break;
+      }
 
-        skippedFiles = true;
-        return;
+      // the file was truncated meanwhile; the map announced the data already
+      if ( len == 0 )
+      {
+        len = wanted;
+        memset(data, 0, static_cast<size_t>(len));
       }
 
-      if ( ! archive->prepareWriting(QStringLiteral(".") + info.absoluteFilePath() + ext,
-                                     info.owner(), info.group(), tmpFile.size(),
-                                     status.st_mode, info.lastRead(), info.lastModified(), info.created()) )
+      if ( device->write(data, len) != len )
       {
         emitArchiveError();
-        cancel();
-        return;
+        failed = true;
+        break;
       }
 
-      const int BUFFER_SIZE = 8*1024;
-      static char buffer[BUFFER_SIZE];
-      qint64 len;
-      int count = 0;
-      while ( ! tmpFile.atEnd() )
-      {
-        len = tmpFile.read(buffer, BUFFER_SIZE);
+      if ( hashContent )
+        contentHash.addData(data, len);
 
-        if ( len < 0 )  // error in reading
-        {
-          emit warning(i18n("Could not read from file '%1'\n"
-                            "The operating system reports: %2",
-                       info.absoluteFilePath(),
-                       tmpFile.errorString()));
-          cancel();
-          return;
-        }
+      readCache.doneReading(extent.offset + done, len);
+      if ( sliceFile )
+        sliceCache.written(sliceFile->pos());
 
-        if ( ! archive->writeData(buffer, len) )
-        {
-          emitArchiveError();
-          cancel();
-          return;
-        }
+      done += len;
+      totalBytes += len;
 
-        count = (count + 1) % 50;
-        if ( count == 0 )
-        {
-          qApp->processEvents(QEventLoop::AllEvents, 5);
-          if ( cancelled ) return;
-        }
-      }
-      if ( ! archive->finishWriting(tmpFile.size()) )
+      count = (count + 1) % interval;
+      if ( count == 0 )
       {
-        emitArchiveError();
-        cancel();
-        return;
+        emit totalBytesChanged(totalBytes);
+        qApp->processEvents(QEventLoop::AllEvents, 5);
       }
     }
 
-    // get filesize
-    sliceBytes = archive->device()->pos();  // account for tar overhead
-    totalBytes += tmpFile.size();
+    hashed = extent.offset + extent.length;
+  }
 
-    emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
+  readCache.stop();
+
+  if ( failed || cancelled )
+    return Error;
+
+  if ( hashContent )
+    hashZeros(contentHash, entry.size - hashed);
+
+  const int padding = TarHeader::padding(map.size() + dataBytes);
+  if ( padding && (device->write(QByteArray(padding, 0)) != padding) )
+  {
+    emitArchiveError();
+    return Error;
   }
 
-  totalFiles++;
-  emit totalFilesChanged(totalFiles);
-  emit totalBytesChanged(totalBytes);
+  sourceFile.close();
 
-  qApp->processEvents(QEventLoop::AllEvents, 5);
-}
+  sliceBytes = getSliceBytes();
 
-//--------------------------------------------------------------------------------
+  if ( sliceFile )
+    sliceCache.written(sliceFile->pos());
 
-Archiver::AddFileStatus Archiver::addLocalFile(const QFileInfo &info)
-{
-  struct stat sourceStat;
-  memset(&sourceStat, 0, sizeof(sourceStat));
+  emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
 
-  if ( ::stat(QFile::encodeName(info.absoluteFilePath()).constData(), &sourceStat) == -1 )
-  {
-    emit warning(i18n("Could not get information of file: %1\n"
-                      "The operating system reports: %2",
-                 info.absoluteFilePath(),
-                 QString::fromLatin1(strerror(errno))));
+  return Added;
+}
 
-    return Skipped;
-  }
+//--------------------------------------------------------------------------------
 
-  QFile sourceFile(info.absoluteFilePath());
+Archiver::AddFileStatus Archiver::addChunkedFile(const FileEntry &entry)
+{
+  QFile sourceFile(entry.path);
 
   // if the size is 0 (e.g. a pipe), don't open it since we will not read any content
-  // and Qt hangs when opening a pipe
-  if ( (info.size() > 0) && !sourceFile.open(QIODevice::ReadOnly) )
+  if ( (entry.size > 0) && !sourceFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) )
   {
-    emit warning(i18n("Could not open file '%1' for reading.", info.absoluteFilePath()));
+    emit warning(i18n("Could not open file '%1' for reading.", entry.path));
     return Skipped;
   }
 
-  if ( (sliceBytes + info.size()) > sliceCapacity )
-    if ( ! getNextSlice() ) return Error;
-
-  if ( ! archive->prepareWriting(QStringLiteral(".") + info.absoluteFilePath(),
-                                 info.owner(), info.group(), info.size(),
-                                 sourceStat.st_mode, info.lastRead(), info.lastModified(), info.created()) )
-  {
-    emitArchiveError();
+  if ( ! allocateBuffer(entry.blockSize) )
     return Error;
-  }
 
-  const int BUFFER_SIZE = 8*1024;
-  static char buffer[BUFFER_SIZE];
-  qint64 len;
-  int count = 0, progress;
+  chunkStore.startFile(entry);
+  contentHash.reset();
+
+  int count = 0;
+  const int interval = eventInterval(ioBuffer.size());
   QTime timer;
   timer.start();
   bool msgShown = false;
   qint64 written = 0;
+  AddFileStatus ret = Added;
+
+  if ( entry.size > 0 )
+    readCache.startReading(sourceFile.handle(), cacheMode);
+
+  // reading overlaps with chunking and hashing
+  bool readAhead = (entry.size > ioBuffer.size()) &&
+                   fileReader.startReading(sourceFile.handle(), entry.size, ioBuffer.size());
 
-  while ( info.size() && !sourceFile.atEnd() && !cancelled )
+  while ( entry.size && !cancelled )
   {
-    len = sourceFile.read(buffer, BUFFER_SIZE);
+    char *data = ioBuffer.data();
+    qint64 len;
 
-    if ( len < 0 )  // error in reading
+    if ( readAhead )
+    {
+      len = fileReader.nextChunk(data, 100);
+
+      if ( len == FileReader::Pending )
+      {
+        qApp->processEvents(QEventLoop::AllEvents, 5);
+        continue;
+      }
+    }
+    else
+    {
+      if ( sourceFile.atEnd() )
+        break;
+
+      len = sourceFile.read(data, ioBuffer.size());
+    }
+
+    if ( len == 0 )  // end of file
+      break;
+
+    // the snapshot is still fine without this file
+    if ( len < 0 )
     {
       emit warning(i18n("Could not read from file '%1'\n"
                         "The operating system reports: %2",
-                   info.absoluteFilePath(),
-                   sourceFile.errorString()));
-      return Error;
+                   entry.path,
+                   readAhead ? fileReader.errorString() : sourceFile.errorString()));
+      ret = Skipped;
+      break;
     }
 
-    if ( ! archive->writeData(buffer, len) )
+    if ( !chunkStore.writeData(data, len) )
     {
       emitArchiveError();
-      return Error;
+      ret = Error;
+      break;
     }
 
+    if ( hashContent )
+      contentHash.addData(data, len);
+
+    readCache.doneReading(written, len);
     totalBytes += len;
     written += len;
 
-    progress = static_cast<int>(written * 100 / info.size());
+    const int progress = static_cast<int>(written * 100 / entry.size);
 
     // stay responsive
-    count = (count + 1) % 50;
+    count = (count + 1) % interval;
     if ( count == 0 )
     {
       if ( msgShown )
@@ -1305,43 +3203,41 @@ Archiver::AddFileStatus Archiver::addLocalFile(const QFileInfo &info)
     {
       emit fileProgress(progress);
       if ( interactive || verbose )
-        emit logging(i18n("...archiving file %1", info.absoluteFilePath()));
+        emit logging(i18n("...archiving file %1", entry.path));
 
-      if ( interactive )
-        QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
-      qApp->processEvents(QEventLoop::AllEvents, 5);
       msgShown = true;
     }
   }
-  emit fileProgress(100);
-  sourceFile.close();
 
-  if ( !cancelled )
-  {
-    // get filesize
-    sliceBytes = archive->device()->pos();  // account for tar overhead
+  if ( readAhead )
+    fileReader.stopReading();  // before the file is closed
 
-    emit sliceProgress(static_cast<int>(sliceBytes * 100 / sliceCapacity));
-  }
+  readCache.stop();
+  sourceFile.close();
 
-  if ( msgShown && interactive )
-    QApplication::restoreOverrideCursor();
+  if ( cancelled )
+    return Error;
+
+  if ( ret != Added )
+    return ret;
 
-  if ( !cancelled && !archive->finishWriting(info.size()) )
+  if ( !chunkStore.finishFile() )
   {
     emitArchiveError();
     return Error;
   }
 
-  return cancelled ? Error : Added;
+  emit fileProgress(100);
+
+  return Added;
 }
 
 //--------------------------------------------------------------------------------
 
-bool Archiver::compressFile(const QString &origName, QFile &comprFile)
+bool Archiver::compressFile(const QString &origName, QIODevice &comprDevice)
 {
   QFile origFile(origName);
-  if ( ! origFile.open(QIODevice::ReadOnly) )
+  if ( ! origFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) )
   {
     emit warning(i18n("Could not read file: %1\n"
                       "The operating system reports: %2",
@@ -1353,21 +3249,27 @@ bool Archiver::compressFile(const QString &origName, QFile &comprFile)
   }
   else
   {
-    KCompressionDevice filter(&comprFile, false, compressionType);
+    struct stat status;
+    memset(&status, 0, sizeof(status));
+    ::fstat(origFile.handle(), &status);
+
+    if ( ! allocateBuffer(status.st_blksize) )
+      return false;
+
+    QScopedPointer<QIODevice> filter(codec.createDevice(&comprDevice, origFile.size()));
 
-    if ( !filter.open(QIODevice::WriteOnly) )
+    if ( !filter->open(QIODevice::WriteOnly) )
     {
       emit warning(i18n("Could not create temporary file for compressing: %1\n"
                         "The operating system reports: %2",
                    origName,
-                   filter.errorString()));
+                   filter->errorString()));
       return false;
     }
 
-    const int BUFFER_SIZE = 8*1024;
-    static char buffer[BUFFER_SIZE];
     qint64 len;
     int count = 0, progress;
+    const int interval = eventInterval(ioBuffer.size());
     QTime timer;
     timer.start();
     bool msgShown = false;
@@ -1375,23 +3277,43 @@ bool Archiver::compressFile(const QString &origName, QFile &comprFile)
     KIO::filesize_t fileSize = origFile.size();
     KIO::filesize_t written = 0;
 
+    readCache.startReading(origFile.handle(), cacheMode);
+    contentHash.reset();
+
     while ( fileSize && !origFile.atEnd() && !cancelled )
     {
-      len = origFile.read(buffer, BUFFER_SIZE);
-      qint64 wrote = filter.write(buffer, len);
+      len = origFile.read(ioBuffer.data(), ioBuffer.size());
+
+      if ( len < 0 )  // error in reading
+      {
+        emit warning(i18n("Could not read from file '%1'\n"
+                          "The operating system reports: %2",
+                     origName,
+                     origFile.errorString()));
+        skippedFiles = true;
+        readCache.stop();
+        return false;
+      }
+
+      qint64 wrote = filter->write(ioBuffer.data(), len);
 
       if ( len != wrote )
       {
         emit warning(i18n("Could not write to temporary file"));
+        readCache.stop();
         return false;
       }
 
+      if ( hashContent )
+        contentHash.addData(ioBuffer.data(), len);
+
+      readCache.doneReading(written, len);
       written += len;
 
       progress = static_cast<int>(written * 100 / fileSize);
 
       // keep the ui responsive
-      count = (count + 1) % 50;
+      count = (count + 1) % interval;
       if ( count == 0 )
       {
         if ( msgShown )
@@ -1410,6 +3332,19 @@ bool Archiver::compressFile(const QString &origName, QFile &comprFile)
         msgShown = true;
       }
     }
+    readCache.stop();
+
+    // a member without the end of the compressed data could not be uncompressed
+    if ( !cancelled && !CompressionCodec::closeDevice(filter.data()) )
+    {
+      emit warning(i18n("Could not compress file '%1'\n"
+                        "The operating system reports: %2",
+                   origName,
+                   filter->errorString()));
+      skippedFiles = true;
+      return false;
+    }
+
     emit fileProgress(100);
     origFile.close();
 
@@ -1422,6 +3357,18 @@ bool Archiver::compressFile(const QString &origName, QFile &comprFile)
 
 //--------------------------------------------------------------------------------
 
+bool Archiver::allocateBuffer(blksize_t blockSize)
+{
+  if ( ioBuffer.resize(IoBuffer::sizeFor(blockSize)) )
+    return true;
+
+  emit warning(i18n("Could not allocate %1 of memory for reading files.",
+                    KIO::convertSize(IoBuffer::sizeFor(blockSize))));
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
 bool Archiver::getDiskFree(const QString &path, KIO::filesize_t &capacityB, KIO::filesize_t &freeB)
 {
   struct statvfs vfs;
@@ -1438,6 +3385,56 @@ bool Archiver::getDiskFree(const QString &path, KIO::filesize_t &capacityB, KIO:
 
 //--------------------------------------------------------------------------------
 
+bool Archiver::isPipe(const QString &name)
+{
+  if ( name == QLatin1String("-") )
+    return true;
+
+  struct stat status;
+  return !name.isEmpty() && (::stat(QFile::encodeName(name).constData(), &status) == 0) && S_ISFIFO(status.st_mode);
+}
+
+//--------------------------------------------------------------------------------
+
+bool Archiver::openPipe()
+{
+  if ( pipeTarget == QLatin1String("-") )
+  {
+    pipeFd = STDOUT_FILENO;
+    emit logging(i18n("...writing the archive to stdout"));
+    return true;
+  }
+
+  // blocks until the reader has opened the other end
+  emit logging(i18n("...waiting for a reader of %1", pipeTarget));
+
+  do
+    pipeFd = ::open(QFile::encodeName(pipeTarget).constData(), O_WRONLY | O_CLOEXEC);
+  while ( (pipeFd == -1) && (errno == EINTR) );
+
+  if ( pipeFd == -1 )
+  {
+    emit warning(i18n("Could not open '%1' for writing.\n"
+                      "The operating system reports: %2", pipeTarget, QString::fromLatin1(strerror(errno))));
+    return false;
+  }
+
+  emit logging(i18n("...writing the archive into %1", pipeTarget));
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::closePipe()
+{
+  if ( pipeFd > STDOUT_FILENO )
+    ::close(pipeFd);
+
+  pipeFd = -1;
+}
+
+//--------------------------------------------------------------------------------
+
 void Archiver::loggingSlot(const QString &message)
 {
   std::cerr << message.toUtf8().constData() << std::endl;
@@ -1454,7 +3451,120 @@ void Archiver::warningSlot(const QString &message)
 
 void Archiver::updateElapsed()
 {
-  emit elapsedChanged(QTime(0, 0).addMSecs(elapsed.elapsed()));
+  const qint64 msecs = elapsed.elapsed();
+  emit elapsedChanged(QTime(0, 0).addMSecs(msecs));
+
+  if ( !haveEstimate )
+    return;
+
+  // the throughput of the last 30 seconds, which follows changes between
+  // large and small files but does not jump with every single file
+  throughputSamples.append(qMakePair(msecs, handledBytes));
+  while ( throughputSamples.count() > 30 )
+    throughputSamples.removeFirst();
+
+  int percent = 100;
+  int seconds = -1;
+
+  if ( estimatedBytes > 0 )
+    percent = static_cast<int>(qMin(handledBytes, estimatedBytes) * 100 / estimatedBytes);
+
+  const qint64 span = throughputSamples.last().first - throughputSamples.first().first;
+  const KIO::filesize_t bytes = throughputSamples.last().second - throughputSamples.first().second;
+
+  if ( handledBytes >= estimatedBytes )
+    seconds = 0;
+  else if ( (span > 0) && (bytes > 0) )
+    seconds = static_cast<int>((estimatedBytes - handledBytes) * span / bytes / 1000);
+
+  emit remainingChanged(percent, seconds);
+
+  // no widget shows it in the background
+  if ( !interactive && runs && (msecs - progressLogged >= PROGRESS_LOG_INTERVAL) )
+  {
+    progressLogged = msecs;
+
+    if ( seconds < 0 )
+      emit logging(i18n("...%1% done", percent));
+    else
+      emit logging(i18n("...%1% done, about %2 remaining", percent, KIO::convertSeconds(seconds)));
+  }
+
+  // we are called while events are processed, maybe in the middle of writing a file
+  spaceCheckDue = true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::preScanFinished()
+{
+  // a late signal of a stopped scan
+  if ( !runs || preScanner.wasStopped() )
+    return;
+
+  foreach (const PreScanner::Total &total, preScanner.getTotals())
+  {
+    emit logging(i18n("...estimated %1 files, %2 in %3",
+                      total.files, KIO::convertSize(total.bytes), total.root));
+
+    estimatedFiles += total.files;
+    estimatedBytes += total.bytes;
+  }
+
+  haveEstimate = true;
+  emit logging(i18n("-- Estimated Total: %1 files, %2", estimatedFiles, KIO::convertSize(estimatedBytes)));
+
+  spaceCheckDue = true;
+}
+
+//--------------------------------------------------------------------------------
+
+void Archiver::checkTargetSpace()
+{
+  // with a media change or a remote target every slice gets new space.
+  // A chunk repository only needs the new data, which we can't estimate
+  if ( !haveEstimate || spaceChecked || cancelled || mediaNeedsChange || !targetURL.isLocalFile() ||
+       !pipeTarget.isEmpty() || chunkStore.isOpen() )
+    return;
+
+  KIO::filesize_t capacity, freeBytes;
+  if ( !getDiskFree(targetURL.path(), capacity, freeBytes) )
+    return;
+
+  const KIO::filesize_t restBytes = estimatedBytes - qMin(handledBytes, estimatedBytes);
+  const int restFiles = qMax(0, estimatedFiles - handledFiles);
+
+  // a tar header plus on average half a block of padding per file
+  KIO::filesize_t needed = restBytes + static_cast<KIO::filesize_t>(restFiles) * 768;
+
+  if ( compressMode != CompressNone )
+  {
+    // use the ratio we got so far; too early to tell with only a few MB done
+    if ( (handledBytes < 64 * 1024 * 1024) || (freeAtStart <= freeBytes) )
+      return;
+
+    needed = static_cast<KIO::filesize_t>(static_cast<double>(needed) * (freeAtStart - freeBytes) / handledBytes);
+  }
+
+  // only stop when it clearly won't fit
+  if ( needed <= freeBytes + freeBytes / 10 )
+    return;
+
+  spaceChecked = true;
+
+  const QString msg = i18n("The rest of the backup needs about %1, but the target has only %2 free.",
+                           KIO::convertSize(needed), KIO::convertSize(freeBytes));
+
+  if ( !interactive )
+  {
+    emit warning(msg);
+    cancel();
+  }
+  else if ( KMessageBox::warningContinueCancel(static_cast<QWidget*>(parent()),
+                msg + QLatin1Char('\n') + i18n("Do you want to continue anyway?")) == KMessageBox::Cancel )
+  {
+    cancel();
+  }
 }
 
 //--------------------------------------------------------------------------------
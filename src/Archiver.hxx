@@ -14,23 +14,46 @@
 
 #include <QObject>
 #include <QPointer>
-#include <QSet>
 #include <QElapsedTimer>
 #include <QTime>
 #include <QDateTime>
 #include <QStringList>
 #include <QList>
-#include <QRegExp>
+#include <QPair>
+#include <QMap>
+#include <QSet>
+#include <QThreadPool>
 
 #include <QUrl>
 #include <kio/copyjob.h>
 #include <kio/udsentry.h>
-#include <KCompressionDevice>
+
+#include <CompressionCodec.hxx>
+#include <IoBuffer.hxx>
+#include <FileReader.hxx>
+#include <PageCache.hxx>
+#include <FileEntry.hxx>
+#include <DirScanner.hxx>
+#include <PreScanner.hxx>
+#include <WildcardMatcher.hxx>
+#include <PathTrie.hxx>
+#include <FileIndex.hxx>
+#include <ChunkStore.hxx>
+#include <ContentHash.hxx>
+#include <HardLinkTable.hxx>
+#include <TarHeader.hxx>
+#include <SliceUploader.hxx>
+#include <SliceIndex.hxx>
+#include <BackupCatalog.hxx>
+
+#include <sys/types.h>
 
 class KTar;
-class QDir;
-class QFileInfo;
 class QFile;
+class QIODevice;
+class CompressJob;
+class KioPutDevice;
+class PipeDevice;
 
 
 class Archiver : public QObject
@@ -57,8 +80,50 @@ class Archiver : public QObject
     void setMediaNeedsChange(bool b) { mediaNeedsChange = b; }
     bool getMediaNeedsChange() const { return mediaNeedsChange; }
 
-    void setCompressFiles(bool b);
-    bool getCompressFiles() const { return !ext.isEmpty(); }
+    // CompressFiles compresses every file on its own and stores it with an added extension
+    // into a not-compressed tar; CompressSlices writes every slice as one compressed stream
+    enum CompressMode { CompressNone = 0, CompressFiles = 1, CompressSlices = 2 };
+    void setCompressMode(CompressMode mode);
+    CompressMode getCompressMode() const { return compressMode; }
+
+    void setCompressFiles(bool b) { setCompressMode(b ? CompressFiles : CompressNone); }
+    bool getCompressFiles() const { return compressMode == CompressFiles; }
+
+    void setCompressCodec(CompressionCodec::Type type);
+    CompressionCodec::Type getCompressCodec() const { return codec.getType(); }
+
+    // 0 is the codec's default level; negative levels select the fast modes of zstd
+    void setCompressLevel(int level);
+    int getCompressLevel() const { return codec.getLevel(); }
+
+    // number of threads compressing files in parallel (1 == compress in the GUI thread)
+    void setCompressWorkers(int num);
+    int getCompressWorkers() const { return compressWorkers; }
+
+    // how the files we read and the slices we write shall use the page cache
+    void setCacheMode(PageCache::Mode mode) { cacheMode = mode; }
+    PageCache::Mode getCacheMode() const { return cacheMode; }
+
+    // walk the selected files in a separate thread first to estimate the remaining
+    // time and to stop early when the backup will not fit onto the target
+    void setPreScan(bool b) { preScan = b; }
+    bool getPreScan() const { return preScan; }
+
+    // TarSlices writes tar archives; ChunkRepository stores the file contents deduplicated
+    // in a repository inside the (local) target dir, where every backup is a complete snapshot
+    enum TargetFormat { TarSlices = 0, ChunkRepository = 1 };
+    void setTargetFormat(TargetFormat format);
+    TargetFormat getTargetFormat() const { return targetFormat; }
+
+    // store a hash of every archived file in the file index; an incremental backup then
+    // compares the content of files where only the times changed, and skips them when it's the same
+    void setHashContent(bool b) { hashContent = b; }
+    bool getHashContent() const { return hashContent; }
+
+    // write the slices for a remote target directly into a KIO upload, without a file in tmp.
+    // Not with CompressSlices, which needs the file to know the compressed size
+    void setStreamUpload(bool b) { streamUpload = b; }
+    bool getStreamUpload() const { return streamUpload; }
 
     // number of backups to keep before older ones will be deleted (UNLIMITED or 1..n)
     void setKeptBackups(int num);
@@ -83,6 +148,14 @@ class Archiver : public QObject
     // print every single file/dir in non-interactive mode
     void setVerbose(bool b) { verbose = b; }
 
+    // write all slices one after the other into stdout ("-") or a FIFO instead of
+    // files in the target dir; an empty name switches back to the target dir
+    void setPipeTarget(const QString &name) { pipeTarget = name; }
+    const QString &getPipeTarget() const { return pipeTarget; }
+
+    // "-" or the name of a FIFO
+    static bool isPipe(const QString &name);
+
     // loads the profile into the Archiver and returns includes/excludes lists
     // return true if loaded, false on file open error
     bool loadProfile(const QString &fileName, QStringList &includes, QStringList &excludes, QString &error);
@@ -103,6 +176,9 @@ class Archiver : public QObject
     // TODO: put probably in some global settings object
     static QString sliceScript;
 
+    // compressed files up to this size (in bytes) are kept in memory instead of a temporary file
+    static qint64 compressBufferSize;
+
   public Q_SLOTS:
     void cancel();  // cancel a running creation
     void setForceFullBackup(bool force = true);
@@ -118,6 +194,8 @@ class Archiver : public QObject
     void totalFilesChanged(int) const;
     void totalBytesChanged(KIO::filesize_t) const;
     void elapsedChanged(const QTime &) const;
+    // percent of the estimated bytes and the remaining seconds; -1 when not known
+    void remainingChanged(int percent, int seconds) const;
     void backupTypeChanged(bool incremental) const;
 
   private Q_SLOTS:
@@ -127,50 +205,187 @@ class Archiver : public QObject
     void loggingSlot(const QString &message); // for non-interactive output
     void warningSlot(const QString &message); // for non-interactive output
     void updateElapsed();
+    void preScanFinished();
+    void sliceUploaded(const QString &fileName, const QUrl &url);
+    void sliceUploadFailed(const QString &fileName, const QString &errorString);
 
   private:
     void calculateCapacity();  // also emits signals
-    void addDirFiles(QDir &dir);
-    void addFile(const QFileInfo &info);
+    void checkTargetSpace();  // cancels when the estimated rest does not fit
+
+    // delete the backups beyond numKeptBackups. Without a catalog knowing all
+    // backups in the target, the target dir is listed
+    bool reduceBackupsWithCatalog();
+    void reduceBackupsWithListing();
+    // syncs the catalog with the backups kept in the target: adds those it does not know yet,
+    // and marks those with prefix which are gone as removed
+    void addFoundRuns(const QMap<QString, BackupCatalog::Run> &found, const QString &prefix);
+    void deleteFromTarget(const QString &fileName);
+    QString catalogTarget() const;
+    void addDirFiles(DirScanner::Node *node);
+    // write the headers of the directories on the pending stack
+    void writePendingDirs();
+    // excludes is the node of the entry in excludeTrie, if any
+    void addFile(const FileEntry &entry, const PathTrie::Node *excludes);
+    bool addSymLink(const FileEntry &entry);
+    void addDir(const FileEntry &dir);
+
+    // decides by the file index, or by the time of the last backup without an index.
+    // pos is the position in the index, if the file was there
+    bool isUnchanged(const FileEntry &entry, qint64 &pos);
+
+    // true when the content still has the hash stored at pos in the file index.
+    // hash is set to the one of the current content when it could be read
+    bool hasSameContent(const FileEntry &entry, qint64 pos, quint64 &hash);
+    bool hashFile(const FileEntry &entry, quint64 &hash);
 
     enum AddFileStatus { Error, Added, Skipped };
-    AddFileStatus addLocalFile(const QFileInfo &info);
-
-    bool compressFile(const QString &origName, QFile &comprFile);
+    AddFileStatus addLocalFile(const FileEntry &entry);
+    // only the data extents of a file with holes are read and stored
+    AddFileStatus addSparseFile(const FileEntry &entry, QFile &sourceFile,
+                                const QVector<TarHeader::Extent> &extents);
+    AddFileStatus addChunkedFile(const FileEntry &entry);
+
+    bool compressFile(const QString &origName, QIODevice &comprDevice);
+
+    // size the ioBuffer for a device with the given st_blksize (0 = default)
+    bool allocateBuffer(blksize_t blockSize);
+    AddFileStatus addCompressedFile(const FileEntry &entry, QIODevice &comprDevice);
+
+    // another name of an inode already in the current slice as member target.
+    // Skipped when the slice has no room left for it
+    AddFileStatus addHardLink(const FileEntry &entry, const QString &target);
+
+    // the name under which the content of entry is stored in the archive
+    QString memberName(const FileEntry &entry) const;
+
+    // writes the index of the current slice next to it. Returns the file name or
+    // an empty string when there is none
+    QString writeSliceIndex();
+
+    // with parallel compression all entries are queued to keep them in traversal order
+    bool useCompressQueue() const { return getCompressFiles() && (compressWorkers > 1) && !chunkStore.isOpen(); }
+    void queueDir(const FileEntry &dir);
+    void queueFile(const FileEntry &file, const QString &linkTarget = QString(),
+                   int linkSlice = HardLinkTable::PENDING);
+    // write all finished entries from the queue head;
+    // waits for the head as long as more than maxJobs compressions are running
+    void writeQueuedEntries(int maxJobs);
+    // bookkeeping after a queued file was written; false when the archive is broken
+    bool queuedFileWritten(const FileEntry &file, AddFileStatus ret, quint64 hash);
+    void discardQueuedEntries();
 
     void finishSlice();
     bool getNextSlice();
 
-    void runScript(const QString &mode);
+    // instead of the slices with a chunk repository
+    bool startSnapshot();
+    void finishSnapshot();
+    void deleteArchive();
+
+    // the bytes the current slice occupies on the target
+    KIO::filesize_t getSliceBytes() const;
+
+    bool isStreamingUpload() const
+    {
+      return streamUpload && !targetURL.isLocalFile() && (compressMode != CompressSlices) && pipeTarget.isEmpty();
+    }
+
+    bool openPipe();
+    void closePipe();
+
+    // the url of the current slice on a remote target
+    QUrl getSliceUrl() const;
+
+    // the content bytes which still fit into the current slice, in whole tar blocks
+    qint64 sliceRoom() const;
+
+    // continue the content of entry after offset bytes in the next slice.
+    // room is set to the content bytes fitting there
+    bool continueInNextSlice(const FileEntry &entry, qint64 offset, qint64 &room);
+
+    // sliceName defaults to the current slice
+    void runScript(const QString &mode, const QString &sliceName = QString());
+
+    // wait while more than maxPending slices are uploading, or while the tmp dir
+    // has no room for a slice of the given size besides them
+    void waitForUploads(int maxPending, KIO::filesize_t needed = 0);
     void setIncrementalBackup(bool inc);
 
-    // returns true if the next backup will be an incremental one, false for a full backup
-    bool isIncrementalBackup() const { return !forceFullBackup && incrementalBackup; }
+    // returns true if the next backup will be an incremental one, false for a full backup.
+    // A snapshot in a chunk repository is always complete
+    bool isIncrementalBackup() const { return (targetFormat == TarSlices) && !forceFullBackup && incrementalBackup; }
 
     // return true if given fileName matches any of the defined filters
     bool fileIsFiltered(const QString &fileName) const;
 
+    // true if the absolute path or a directory above it is excluded
+    bool isExcluded(const QString &path) const;
+
+    // true if the file name or a directory above the absolute path is filtered
+    bool isFilteredPath(const QString &path) const;
+
+    // true if the absolute path or a directory above it could not be read by this run
+    bool isInUnreadDir(const QString &path) const;
+
     void emitArchiveError() const;
 
     static bool UDSlessThan(const KIO::UDSEntry &left, const KIO::UDSEntry &right);
 
   private:
-    QSet<QString> excludeFiles;
-    QSet<QString> excludeDirs;
+    struct QueuedEntry
+    {
+      enum Type { Dir, SymLink, HardLink, File } type;
+      FileEntry file;
+      QString linkTarget;  // HardLink only
+      int linkSlice;  // HardLink only: slice of linkTarget, HardLinkTable::PENDING while queued
+      CompressJob *job;  // File only
+    };
+
+  private:
+    PathTrie excludeTrie;
+    FileIndex fileIndex;
+    BackupCatalog catalog;
+    bool hashContent;
+    ContentHash contentHash;  // of the file currently archived
+    HardLinkTable hardLinks;  // links only point into the same slice
+    int memberSlice;  // holding the header of the last file member
+    QVector<FileEntry> pendingDirs;  // entered, but the header is not written yet
+    QSet<QString> unreadDirs;  // their files are not reported as removed
 
     QString archiveName;
+    QString archivePath;  // absolute and clean archiveName
     QString filePrefix;  // default = "backup"
     QStringList sliceList;
     QString loadedProfile;
 
+    TargetFormat targetFormat;
+    ChunkStore chunkStore;
+
     KTar *archive;
+    SliceIndex sliceIndex;  // the members of the current slice
     KIO::filesize_t totalBytes;
     int totalFiles;
     int filteredFiles;  // filter or time filter (incremental backup)
+    int sameContentFiles;  // changed times but the same content
     QElapsedTimer elapsed;
 
-    QList<QRegExp> filters;
-    QList<QRegExp> dirFilters;
+    bool preScan;
+    PreScanner preScanner;
+    bool haveEstimate;
+    int estimatedFiles;
+    KIO::filesize_t estimatedBytes;
+    int handledFiles;  // files and dirs passed to the archive, as the estimate counts them
+    KIO::filesize_t handledBytes;
+    QList< QPair<qint64, KIO::filesize_t> > throughputSamples;  // msecs, handledBytes
+    KIO::filesize_t freeAtStart;  // on a local target
+    bool spaceChecked;  // the user wants to continue anyway
+    bool spaceCheckDue;  // done at the next file, where the backup can stop
+    qint64 progressLogged;  // msecs of the last progress line in non-interactive mode
+
+    WildcardMatcher filters;
+    WildcardMatcher dirFilters;
+    DirScanner dirScanner;
 
     QUrl targetURL;
     QString baseName;
@@ -191,8 +406,32 @@ class Archiver : public QObject
     KIO::filesize_t sliceBytes;
     KIO::filesize_t sliceCapacity;
 
+    CompressMode compressMode;
     QString ext;
-    KCompressionDevice::CompressionType compressionType;
+    CompressionCodec codec;
+
+    IoBuffer ioBuffer;  // for the archive writer pipeline
+    FileReader fileReader;
+
+    PageCache::Mode cacheMode;
+    PageCache readCache;   // for the file currently archived or compressed
+    PageCache sliceCache;  // for sliceFile
+
+    // the slice file on a local target or with CompressSlices (then the tar goes through sliceFilter)
+    QFile *sliceFile;
+    QIODevice *sliceFilter;
+
+    bool streamUpload;
+    KioPutDevice *uploadDevice;  // the device of the KTar while streaming a slice
+
+    QString pipeTarget;
+    int pipeFd;  // open during the backup when pipeTarget is set
+    PipeDevice *pipeDevice;  // the current slice in the pipe
+
+    int compressWorkers;
+    QThreadPool compressPool;
+    QList<QueuedEntry> compressQueue;
+    int queuedJobs;  // entries in compressQueue which have a CompressJob
 
     bool interactive;
     bool cancelled;
@@ -200,7 +439,7 @@ class Archiver : public QObject
     bool skippedFiles;  // did we skip files during backup ?
     bool verbose;
 
-    QPointer<KIO::CopyJob> job;
+    SliceUploader uploader;  // for a remote target
     int jobResult;
 };
 
@@ -0,0 +1,610 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <BackupCatalog.hxx>
+#include <SliceIndex.hxx>
+#include <FileIndex.hxx>
+#include <ContentHash.hxx>
+
+#include <QFileInfo>
+#include <QByteArray>
+
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+//--------------------------------------------------------------------------------
+
+struct BackupCatalog::RunHeader
+{
+  char magic[8];
+  quint64 runSize;  // of the whole run, a multiple of 8
+  qint64 startTime;  // msecs since epoch
+  quint32 flags;
+  quint32 metaSize;  // of the lines behind the header
+  quint64 count;
+  quint64 recordsOffset;  // from the start of the run
+  quint64 pathsOffset;
+  quint64 pathsSize;
+};
+
+enum { Incremental = 1, Removed = 2, Found = 4, Synced = 8 };
+
+static const char CATALOG_MAGIC[8] = { 'K', 'B', 'C', 'A', 'T', 'L', 'G', '1' };
+static const char RUN_MAGIC[8] = { 'K', 'B', 'C', 'R', 'U', 'N', '0', '1' };
+
+//--------------------------------------------------------------------------------
+
+static quint64 align8(quint64 value)
+{
+  return (value + 7) & ~static_cast<quint64>(7);
+}
+
+//--------------------------------------------------------------------------------
+
+static bool hashLess(const BackupCatalog::Member &left, const BackupCatalog::Member &right)
+{
+  return left.pathHash < right.pathHash;
+}
+
+//--------------------------------------------------------------------------------
+
+static bool runLess(const BackupCatalog::Run &left, const BackupCatalog::Run &right)
+{
+  return left.startTime < right.startTime;
+}
+
+//--------------------------------------------------------------------------------
+
+static bool versionLess(const BackupCatalog::Version &left, const BackupCatalog::Version &right)
+{
+  if ( left.run.startTime != right.run.startTime )
+    return left.run.startTime < right.run.startTime;
+
+  return left.slice < right.slice;
+}
+
+//--------------------------------------------------------------------------------
+
+static QString runKey(const BackupCatalog::Run &run)
+{
+  return run.target + QLatin1Char('\n') + run.name;
+}
+
+//--------------------------------------------------------------------------------
+
+BackupCatalog::BackupCatalog()
+  : map(nullptr), mapSize(0), validSize(0), newPathsSize(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+BackupCatalog::~BackupCatalog()
+{
+  discardRun();
+  close();
+}
+
+//--------------------------------------------------------------------------------
+
+QString BackupCatalog::fileNameForProfile(const QString &profile)
+{
+  QFileInfo info(profile);
+  return info.absolutePath() + QLatin1Char('/') + info.completeBaseName() + QStringLiteral(".catalog");
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::open(const QString &fileName)
+{
+  close();
+  error = QString();
+
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 )
+  {
+    if ( errno != ENOENT )  // no catalog yet is no error
+      error = QString::fromLocal8Bit(strerror(errno));
+
+    return false;
+  }
+
+  struct stat status;
+  if ( (::fstat(fd, &status) == -1) || (status.st_size < static_cast<off_t>(sizeof(CATALOG_MAGIC))) )
+  {
+    ::close(fd);
+    error = QStringLiteral("invalid catalog file");
+    return false;
+  }
+
+  void *addr = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if ( addr == MAP_FAILED )
+  {
+    error = QString::fromLocal8Bit(strerror(errno));
+    return false;
+  }
+
+  map = static_cast<uchar *>(addr);
+  mapSize = status.st_size;
+
+  if ( memcmp(map, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0 )
+  {
+    close();
+    error = QStringLiteral("invalid catalog file");
+    return false;
+  }
+
+  // lookups jump from run to run; don't read ahead
+  ::madvise(map, mapSize, MADV_RANDOM);
+
+  // the runs up to the first damaged one, e.g. of a crash while appending
+  qint64 pos = sizeof(CATALOG_MAGIC);
+  while ( pos + static_cast<qint64>(sizeof(RunHeader)) <= mapSize )
+  {
+    const RunHeader *header = runAt(pos);
+    const quint64 rest = mapSize - pos;
+
+    if ( (memcmp(header->magic, RUN_MAGIC, sizeof(RUN_MAGIC)) != 0) ||
+         (header->runSize < sizeof(RunHeader)) || (header->runSize > rest) || (header->runSize % 8) ||
+         (sizeof(RunHeader) + header->metaSize > header->recordsOffset) ||
+         (header->count > header->runSize / sizeof(Member)) ||
+         (header->recordsOffset + header->count * sizeof(Member) > header->pathsOffset) ||
+         (header->pathsOffset + header->pathsSize > header->runSize) )
+      break;
+
+    runOffsets.append(pos);
+    pos += header->runSize;
+  }
+
+  validSize = pos;
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalog::close()
+{
+  if ( map )
+    ::munmap(map, mapSize);
+
+  map = nullptr;
+  mapSize = 0;
+  runOffsets.clear();
+  validSize = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+const BackupCatalog::RunHeader *BackupCatalog::runAt(qint64 pos) const
+{
+  return reinterpret_cast<const RunHeader *>(map + pos);
+}
+
+//--------------------------------------------------------------------------------
+
+BackupCatalog::Run BackupCatalog::runInfo(const RunHeader *header) const
+{
+  const char *meta = reinterpret_cast<const char *>(header) + sizeof(RunHeader);
+  const QStringList lines = QString::fromUtf8(meta, header->metaSize).split(QLatin1Char('\n'));
+
+  Run run;
+  run.target = lines.value(0);
+  run.name = lines.value(1);
+  run.startTime = QDateTime::fromMSecsSinceEpoch(header->startTime);
+  run.incremental = header->flags & Incremental;
+
+  for (int i = 2; i < lines.count(); i++)
+  {
+    if ( lines[i].isEmpty() )
+      continue;
+
+    const QString file = lines[i].mid(1);
+
+    if ( lines[i][0] == QLatin1Char('S') )
+      run.slices.append(file);
+
+    run.files.append(file);
+  }
+
+  return run;
+}
+
+//--------------------------------------------------------------------------------
+
+QSet<QString> BackupCatalog::removedRuns() const
+{
+  QSet<QString> removed;
+
+  foreach (qint64 pos, runOffsets)
+  {
+    const RunHeader *header = runAt(pos);
+
+    if ( header->flags & Removed )
+      removed.insert(runKey(runInfo(header)));
+  }
+
+  return removed;
+}
+
+//--------------------------------------------------------------------------------
+
+QVector<BackupCatalog::Run> BackupCatalog::runs(const QString &target) const
+{
+  QVector<Run> list;
+  const QSet<QString> removed = removedRuns();
+
+  foreach (qint64 pos, runOffsets)
+  {
+    const RunHeader *header = runAt(pos);
+
+    if ( header->flags & (Removed | Synced) )
+      continue;
+
+    const Run run = runInfo(header);
+
+    if ( (run.target == target) && !removed.contains(runKey(run)) )
+      list.append(run);
+  }
+
+  // backups found in the target dir are added after newer ones
+  std::stable_sort(list.begin(), list.end(), runLess);
+
+  return list;
+}
+
+//--------------------------------------------------------------------------------
+
+QVector<BackupCatalog::Version> BackupCatalog::lookup(const QString &name) const
+{
+  QVector<Version> versions;
+
+  if ( !map )
+    return versions;
+
+  const QSet<QString> removed = removedRuns();
+
+  QList<QByteArray> names;
+  names << name.toUtf8();
+  foreach (const QString &ext, QStringList() << QStringLiteral(".xz") << QStringLiteral(".bz2")
+                                             << QStringLiteral(".gz") << QStringLiteral(".zst"))
+    names << (name + ext).toUtf8();
+
+  QVector<quint64> hashes;
+  foreach (const QByteArray &key, names)
+    hashes.append(FileIndex::hashPath(QString::fromUtf8(key)));
+
+  foreach (qint64 pos, runOffsets)
+  {
+    const RunHeader *header = runAt(pos);
+
+    if ( (header->flags & Removed) || (header->count == 0) )
+      continue;
+
+    const Member *members = reinterpret_cast<const Member *>(reinterpret_cast<const uchar *>(header) + header->recordsOffset);
+    const Member *end = members + header->count;
+    const char *paths = reinterpret_cast<const char *>(header) + header->pathsOffset;
+
+    Run run;
+    bool haveRun = false;
+
+    for (int i = 0; i < names.count(); i++)
+    {
+      Member key;
+      key.pathHash = hashes[i];
+
+      for (const Member *it = std::lower_bound(members, end, key, hashLess);
+           (it != end) && (it->pathHash == key.pathHash); ++it)
+      {
+        if ( (it->pathOffset + it->pathLength > header->pathsSize) ||
+             (QByteArray::fromRawData(paths + it->pathOffset, it->pathLength) != names[i]) )
+          continue;
+
+        // only parsed for runs which have the member
+        if ( !haveRun )
+        {
+          run = runInfo(header);
+          haveRun = true;
+        }
+
+        if ( removed.contains(runKey(run)) )
+          break;
+
+        Version version;
+        version.run = run;
+        version.slice = it->slice - 1;
+        version.type = static_cast<char>(it->type);
+        version.offset = it->offset;
+        version.size = it->size;
+        version.mtime = QDateTime::fromMSecsSinceEpoch(it->mtime * 1000);
+        version.hash = (it->flags == static_cast<quint32>(ContentHash::algorithm())) ? it->hash : 0;
+
+        versions.append(version);
+      }
+    }
+  }
+
+  std::sort(versions.begin(), versions.end(), versionLess);
+  return versions;
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::startRun(const QString &fileName, const QString &target, const QString &name,
+                             const QDateTime &startTime, bool incremental)
+{
+  discardRun();
+  error = QString();
+
+  newName = fileName;
+  newRun = Run();
+  newRun.target = target;
+  newRun.name = name;
+  newRun.startTime = startTime;
+  newRun.incremental = incremental;
+
+  newRecords.setFileName(fileName + QStringLiteral(".new"));
+  newPaths.setFileName(fileName + QStringLiteral(".paths"));
+  newPathsSize = 0;
+
+  // ReadWrite, as the records are sorted in a mapping of the file
+  if ( !newRecords.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+       !newPaths.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+  {
+    error = newRecords.isOpen() ? newPaths.errorString() : newRecords.errorString();
+    discardRun();
+    return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalog::addSlice(const QString &sliceName, const SliceIndex &index)
+{
+  if ( !newRecords.isOpen() )
+    return;
+
+  newRun.slices.append(sliceName);
+  newRun.files.append(sliceName);
+
+  for (int i = 0; i < index.count(); i++)
+  {
+    const SliceIndex::Entry &entry = index.at(i);
+
+    Member member;
+    memset(&member, 0, sizeof(member));
+    member.pathHash = FileIndex::hashPath(QString::fromUtf8(entry.name));
+    member.offset = entry.offset;
+    member.size = entry.size;
+    member.mtime = entry.mtime;
+    member.hash = entry.checksum;
+    member.pathOffset = newPathsSize;
+    member.pathLength = entry.name.size();
+    member.slice = newRun.slices.count();
+    member.type = entry.type;
+    member.flags = entry.checksum ? ContentHash::algorithm() : ContentHash::None;
+
+    newRecords.write(reinterpret_cast<const char *>(&member), sizeof(member));
+    newPaths.write(entry.name);
+    newPathsSize += entry.name.size();
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalog::addFile(const QString &fileName)
+{
+  if ( newRecords.isOpen() )
+    newRun.files.append(fileName);
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::finishRun()
+{
+  if ( !newRecords.isOpen() )
+    return false;
+
+  if ( !newRecords.flush() || !newPaths.flush() ||
+       (newRecords.error() != QFile::NoError) || (newPaths.error() != QFile::NoError) )
+  {
+    error = (newRecords.error() != QFile::NoError) ? newRecords.errorString() : newPaths.errorString();
+    discardRun();
+    return false;
+  }
+
+  const qint64 recordsSize = newRecords.size();
+  const quint64 num = recordsSize / sizeof(Member);
+
+  // sort inside the page cache, so that millions of members need not fit into memory
+  if ( num )
+  {
+    void *addr = ::mmap(nullptr, recordsSize, PROT_READ | PROT_WRITE, MAP_SHARED, newRecords.handle(), 0);
+    if ( addr == MAP_FAILED )
+    {
+      error = QString::fromLocal8Bit(strerror(errno));
+      discardRun();
+      return false;
+    }
+
+    Member *sorted = static_cast<Member *>(addr);
+    std::sort(sorted, sorted + num, hashLess);
+    ::munmap(addr, recordsSize);
+  }
+
+  const bool ok = appendRun(newName, newRun, newRun.incremental ? Incremental : 0,
+                            &newRecords, &newPaths, newPathsSize);
+
+  discardRun();
+  return ok;
+}
+
+//--------------------------------------------------------------------------------
+
+void BackupCatalog::discardRun()
+{
+  if ( newRecords.isOpen() )
+    newRecords.remove();
+
+  if ( newPaths.isOpen() || newPaths.exists() )
+    newPaths.remove();
+
+  newPathsSize = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::addFoundRun(const QString &fileName, const Run &run)
+{
+  return appendRun(fileName, run, Found | (run.incremental ? Incremental : 0), nullptr, nullptr, 0);
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::removeRun(const QString &fileName, const Run &run)
+{
+  Run removed;
+  removed.target = run.target;
+  removed.name = run.name;
+  removed.startTime = run.startTime;
+  removed.incremental = run.incremental;
+
+  return appendRun(fileName, removed, Removed, nullptr, nullptr, 0);
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::isSynced(const QString &target) const
+{
+  foreach (qint64 pos, runOffsets)
+  {
+    const RunHeader *header = runAt(pos);
+
+    if ( (header->flags & Synced) && (runInfo(header).target == target) )
+      return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::markSynced(const QString &fileName, const QString &target)
+{
+  Run synced;
+  synced.target = target;
+  synced.startTime = QDateTime::currentDateTime();
+  synced.incremental = false;
+
+  return appendRun(fileName, synced, Synced, nullptr, nullptr, 0);
+}
+
+//--------------------------------------------------------------------------------
+
+bool BackupCatalog::appendRun(const QString &fileName, const Run &run, quint32 flags,
+                              QFile *records, QFile *paths, quint64 pathsSize)
+{
+  // a damaged run at the end is overwritten; a file which is no catalog is left alone
+  if ( !open(fileName) && !error.isEmpty() )
+    return false;
+
+  qint64 end = validSize;
+  close();
+
+  QFile catalog(fileName);
+  if ( !catalog.open(QIODevice::ReadWrite) )
+  {
+    error = catalog.errorString();
+    return false;
+  }
+
+  if ( end == 0 )
+  {
+    catalog.resize(0);
+    catalog.write(CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    end = sizeof(CATALOG_MAGIC);
+  }
+  else
+    catalog.resize(end);
+
+  QStringList lines;
+  lines << run.target << run.name;
+  foreach (const QString &file, run.files)
+    lines << (run.slices.contains(file) ? QLatin1Char('S') : QLatin1Char('F')) + file;
+
+  const QByteArray meta = lines.join(QLatin1Char('\n')).toUtf8();
+
+  RunHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RUN_MAGIC, sizeof(RUN_MAGIC));
+  header.startTime = run.startTime.toMSecsSinceEpoch();
+  header.flags = flags;
+  header.metaSize = meta.size();
+  header.count = records ? records->size() / sizeof(Member) : 0;
+  header.recordsOffset = align8(sizeof(RunHeader) + meta.size());
+  header.pathsOffset = header.recordsOffset + header.count * sizeof(Member);
+  header.pathsSize = pathsSize;
+  header.runSize = align8(header.pathsOffset + pathsSize);
+
+  // the header is written last, so that an interrupted append leaves no valid run
+  catalog.seek(end + sizeof(RunHeader));
+  catalog.write(meta);
+  catalog.write(QByteArray(header.recordsOffset - sizeof(RunHeader) - meta.size(), 0));
+
+  if ( records && records->seek(0) )
+  {
+    while ( !records->atEnd() )
+    {
+      const QByteArray data = records->read(1024 * 1024);
+      if ( data.isEmpty() || (catalog.write(data) != data.size()) )
+        break;
+    }
+  }
+
+  if ( paths )
+  {
+    paths->close();
+    if ( paths->open(QIODevice::ReadOnly) )
+    {
+      while ( !paths->atEnd() )
+      {
+        const QByteArray data = paths->read(1024 * 1024);
+        if ( data.isEmpty() || (catalog.write(data) != data.size()) )
+          break;
+      }
+    }
+  }
+
+  catalog.write(QByteArray(header.runSize - header.pathsOffset - pathsSize, 0));
+
+  if ( !catalog.flush() || (::fdatasync(catalog.handle()) == -1) ||
+       !catalog.seek(end) || (catalog.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header)) ||
+       !catalog.flush() || (catalog.error() != QFile::NoError) ||
+       (catalog.size() != static_cast<qint64>(end + header.runSize)) )
+  {
+    error = catalog.errorString();
+    catalog.resize(end);
+    return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
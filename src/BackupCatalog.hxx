@@ -0,0 +1,147 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _BACKUP_CATALOG_H_
+#define _BACKUP_CATALOG_H_
+
+// all backups of a profile with the members of their slices, kept in a file next to it,
+// to find the backups holding a file without reading the target dir or the slices.
+// Runs are only appended; a deleted backup gets a run marking it removed.
+// Backups made before the catalog existed are only known after the target dir was
+// listed once, which appends a run marking the target synced.
+// The catalog is memory mapped for reading.
+//
+// File layout (host byte order, the catalog is never moved to another machine):
+//   char magic[8]
+//   runs, each:
+//     RunHeader
+//     UTF-8 lines: target, name of the backup set, then one per file: 'S' slice or 'F' other file + name
+//     Member[count]  sorted by pathHash
+//     UTF-8 paths    referenced by the members
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QVector>
+#include <QSet>
+#include <QFile>
+
+class SliceIndex;
+
+class BackupCatalog
+{
+  public:
+    struct Member
+    {
+      quint64 pathHash;
+      qint64 offset;  // of the first tar header in the slice
+      qint64 size;    // stored in the slice
+      qint64 mtime;   // secs since epoch
+      quint64 hash;   // of the content; 0 = not known
+      quint64 pathOffset;
+      quint32 pathLength;
+      quint32 slice;  // 1 = the first slice of the run
+      quint32 type;   // SliceIndex::Type
+      quint32 flags;  // the ContentHash::Algorithm of hash
+    };
+
+    struct Run
+    {
+      QString target;
+      QString name;  // the start of the file names of all slices, e.g. backup_2018.01.01-10.00.00
+      QDateTime startTime;
+      bool incremental;
+      QStringList slices;  // in order
+      QStringList files;   // all files of the run in the target dir, including the slices
+    };
+
+    // where a looked up member is stored
+    struct Version
+    {
+      Run run;
+      int slice;  // in run.slices
+      char type;
+      qint64 offset;
+      qint64 size;
+      QDateTime mtime;
+      quint64 hash;  // 0 if not known or made with another ContentHash
+    };
+
+    BackupCatalog();
+    ~BackupCatalog();
+
+    // maps the catalog. Returns false if there is none or it is unusable
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return map != nullptr; }
+
+    // the backups in target which are not removed, the oldest first
+    QVector<Run> runs(const QString &target) const;
+
+    // the backups which hold the member name (as tar lists it), the oldest first.
+    // Also finds a member stored compressed, with the extension of the compression
+    QVector<Version> lookup(const QString &name) const;
+
+    // the running backup; the slices are added when finished,
+    // and the run is appended to the catalog with finishRun()
+    bool startRun(const QString &fileName, const QString &target, const QString &name,
+                  const QDateTime &startTime, bool incremental);
+    bool isWriting() const { return newRecords.isOpen(); }
+    void addSlice(const QString &sliceName, const SliceIndex &index);
+    void addFile(const QString &fileName);
+    bool finishRun();
+    void discardRun();
+
+    // a backup found in the target dir, which was made before the catalog knew about it
+    bool addFoundRun(const QString &fileName, const Run &run);
+
+    // appends the mark that run was deleted
+    bool removeRun(const QString &fileName, const Run &run);
+
+    // true when all backups in target were added, also those found in a listing of it
+    bool isSynced(const QString &target) const;
+
+    // appends the mark that the backups found in a listing of target were added
+    bool markSynced(const QString &fileName, const QString &target);
+
+    QString errorString() const { return error; }
+
+    static QString fileNameForProfile(const QString &profile);
+
+  private:
+    Q_DISABLE_COPY(BackupCatalog)
+
+    struct RunHeader;
+
+    const RunHeader *runAt(qint64 pos) const;
+    Run runInfo(const RunHeader *header) const;
+    QSet<QString> removedRuns() const;  // target and name of every removed run
+
+    // appends a run with the members and paths of the given files (which may be closed)
+    bool appendRun(const QString &fileName, const Run &run, quint32 flags,
+                   QFile *records, QFile *paths, quint64 pathsSize);
+
+  private:
+    // the catalog
+    uchar *map;
+    qint64 mapSize;
+    QVector<qint64> runOffsets;  // of the valid runs
+    qint64 validSize;  // behind the last valid run
+
+    // the running backup
+    QString newName;
+    Run newRun;
+    QFile newRecords;
+    QFile newPaths;
+    quint64 newPathsSize;
+
+    QString error;
+};
+
+#endif
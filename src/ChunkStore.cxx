@@ -0,0 +1,1179 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <ChunkStore.hxx>
+#include <FileIndex.hxx>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+//--------------------------------------------------------------------------------
+
+struct ChunkIndexHeader
+{
+  char magic[8];
+  quint64 count;
+};
+
+struct SnapshotTrailer
+{
+  char magic[8];
+  quint64 recordsOffset;
+  quint64 count;
+};
+
+static const char INDEX_MAGIC[8] = { 'K', 'B', 'C', 'I', 'D', 'X', '0', '1' };
+static const char SNAPSHOT_MAGIC[8] = { 'K', 'B', 'S', 'N', 'A', 'P', '0', '1' };
+static const char TABLE_MAGIC[8] = { 'K', 'B', 'S', 'N', 'T', 'A', 'B', '1' };
+
+static const int ID_SIZE = 32;  // SHA-256
+
+// chunk sizes; large enough to keep the index small for disk images,
+// small enough to find the unchanged parts of a log file
+static const int MIN_CHUNK = 16 * 1024;
+static const int AVG_CHUNK = 64 * 1024;
+static const int MAX_CHUNK = 256 * 1024;
+
+// normalized chunking: harder to cut before the average size, easier after it.
+// The upper bits of the gear hash depend on the last 64 bytes
+static const quint64 MASK_SMALL = Q_UINT64_C(0x3ffff) << 46;  // 18 bits
+static const quint64 MASK_LARGE = Q_UINT64_C(0x3fff) << 50;   // 14 bits
+
+static const qint64 PACK_SIZE = 64 * 1024 * 1024;
+
+// chunks of the running backup which are looked up; about 16 GB of recently stored data
+static const int MAX_RECENT_CHUNKS = 256 * 1024;
+
+//--------------------------------------------------------------------------------
+// the random values of the rolling hash. They define where chunks are cut,
+// so they must never change, or no chunk of an existing repository would be found again
+
+struct GearTable
+{
+  GearTable()
+  {
+    // splitmix64
+    quint64 state = Q_UINT64_C(0x6b62616b75702d31);
+    for (int i = 0; i < 256; i++)
+    {
+      quint64 z = (state += Q_UINT64_C(0x9e3779b97f4a7c15));
+      z = (z ^ (z >> 30)) * Q_UINT64_C(0xbf58476d1ce4e5b9);
+      z = (z ^ (z >> 27)) * Q_UINT64_C(0x94d049bb133111eb);
+      values[i] = z ^ (z >> 31);
+    }
+  }
+
+  quint64 values[256];
+};
+
+static const GearTable gear;
+
+//--------------------------------------------------------------------------------
+// returns the length of the chunk at the start of data; len is at most MAX_CHUNK
+
+static int findCut(const uchar *data, int len)
+{
+  if ( len <= MIN_CHUNK )
+    return len;
+
+  const int normal = qMin(len, AVG_CHUNK);
+  quint64 hash = 0;
+  int i = MIN_CHUNK;
+
+  for (; i < normal; i++)
+  {
+    hash = (hash << 1) + gear.values[data[i]];
+    if ( !(hash & MASK_SMALL) )
+      return i + 1;
+  }
+
+  for (; i < len; i++)
+  {
+    hash = (hash << 1) + gear.values[data[i]];
+    if ( !(hash & MASK_LARGE) )
+      return i + 1;
+  }
+
+  return len;
+}
+
+//--------------------------------------------------------------------------------
+
+static bool idLess(const ChunkStore::ChunkRecord &left, const ChunkStore::ChunkRecord &right)
+{
+  return memcmp(left.id, right.id, ID_SIZE) < 0;
+}
+
+//--------------------------------------------------------------------------------
+
+static bool idEqual(const ChunkStore::ChunkRecord &left, const ChunkStore::ChunkRecord &right)
+{
+  return memcmp(left.id, right.id, ID_SIZE) == 0;
+}
+
+//--------------------------------------------------------------------------------
+
+uint qHash(const ChunkStore::ChunkId &id, uint seed)
+{
+  // a part of a SHA-256 is as good as any hash of it
+  quint64 value;
+  memcpy(&value, id.id, sizeof(value));
+  return qHash(value, seed);
+}
+
+//--------------------------------------------------------------------------------
+
+static bool hashLess(const ChunkStore::SnapshotRecord &left, const ChunkStore::SnapshotRecord &right)
+{
+  return left.pathHash < right.pathHash;
+}
+
+//--------------------------------------------------------------------------------
+
+ChunkStore::ChunkStore()
+  : indexMap(nullptr), indexMapSize(0), records(nullptr), count(0), packNum(0),
+    recentNext(0), previousMap(nullptr), previousMapSize(0), previousRecords(nullptr), previousCount(0),
+    fileBytes(0), pendingStart(0), hasher(QCryptographicHash::Sha256), contentBytes(0), newBytes(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+ChunkStore::~ChunkStore()
+{
+  close();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::setError(const QString &message)
+{
+  error = message;
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::setFileError(const QFile &file)
+{
+  return setError(file.fileName() + QStringLiteral(": ") + file.errorString());
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::open(const QString &dir)
+{
+  close();
+  error = QString();
+
+  QDir repo(dir);
+  if ( !repo.mkpath(QStringLiteral("packs")) || !repo.mkpath(QStringLiteral("snapshots")) )
+    return setError(QString::fromLocal8Bit(strerror(errno)));
+
+  repoDir = repo.absolutePath();
+
+  if ( !openIndex() )
+  {
+    repoDir = QString();
+    return false;
+  }
+
+  // never append to a pack; it might hold data of a cancelled backup behind the indexed chunks
+  packNum = 0;
+  foreach (const QString &name, QDir(repoDir + QStringLiteral("/packs")).entryList(QStringList(QStringLiteral("*.pack")), QDir::Files))
+    packNum = qMax(packNum, name.left(name.indexOf(QLatin1Char('.'))).toUInt() + 1);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::close()
+{
+  discardSnapshot();
+  closeIndex();
+  repoDir = QString();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::openIndex()
+{
+  const QString fileName = repoDir + QStringLiteral("/chunks.idx");
+
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 )
+  {
+    if ( errno == ENOENT )  // a new repository
+      return true;
+
+    return setError(fileName + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+  }
+
+  struct stat status;
+  if ( (::fstat(fd, &status) == -1) || (status.st_size < static_cast<off_t>(sizeof(ChunkIndexHeader))) )
+  {
+    ::close(fd);
+    return setError(fileName + QStringLiteral(": invalid index file"));
+  }
+
+  void *addr = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if ( addr == MAP_FAILED )
+    return setError(fileName + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+  indexMap = static_cast<uchar *>(addr);
+  indexMapSize = status.st_size;
+
+  const ChunkIndexHeader *header = reinterpret_cast<const ChunkIndexHeader *>(indexMap);
+
+  if ( (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) ||
+       (header->count > static_cast<quint64>(indexMapSize) / sizeof(ChunkRecord)) ||
+       (sizeof(ChunkIndexHeader) + header->count * sizeof(ChunkRecord) != static_cast<quint64>(indexMapSize)) )
+  {
+    closeIndex();
+    return setError(fileName + QStringLiteral(": invalid index file"));
+  }
+
+  // every lookup lands somewhere else
+  ::madvise(indexMap, indexMapSize, MADV_RANDOM);
+
+  count = header->count;
+  records = reinterpret_cast<const ChunkRecord *>(indexMap + sizeof(ChunkIndexHeader));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::closeIndex()
+{
+  if ( indexMap )
+    ::munmap(indexMap, indexMapSize);
+
+  indexMap = nullptr;
+  indexMapSize = 0;
+  records = nullptr;
+  count = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+const ChunkStore::ChunkRecord *ChunkStore::findChunk(const char *id) const
+{
+  ChunkRecord key;
+  memcpy(key.id, id, ID_SIZE);
+
+  const ChunkRecord *end = records + count;
+  const ChunkRecord *it = std::lower_bound(records, end, key, idLess);
+
+  return ((it != end) && !idLess(key, *it)) ? it : nullptr;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::containsChunk(const QByteArray &id) const
+{
+  ChunkId recent;
+  memcpy(recent.id, id.constData(), ID_SIZE);
+
+  if ( recentChunks.contains(recent) )
+    return true;
+
+  return findChunk(id.constData()) != nullptr;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::rememberChunk(const QByteArray &id)
+{
+  ChunkId recent;
+  memcpy(recent.id, id.constData(), ID_SIZE);
+
+  if ( recentOrder.count() < MAX_RECENT_CHUNKS )
+    recentOrder.append(recent);
+  else
+  {
+    recentChunks.remove(recentOrder[recentNext]);
+    recentOrder[recentNext] = recent;
+    recentNext = (recentNext + 1) % MAX_RECENT_CHUNKS;
+  }
+
+  recentChunks.insert(recent);
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::startSnapshot(const QString &name)
+{
+  discardSnapshot();
+  error = QString();
+
+  QDir snapshots(repoDir + QStringLiteral("/snapshots"));
+  QStringList existing = snapshots.entryList(QStringList(QStringLiteral("*.snap")), QDir::Files, QDir::Name);
+
+  // the names start with the date, so the last one is the newest
+  if ( !existing.isEmpty() )
+    openPrevious(snapshots.absoluteFilePath(existing.last()));
+
+  snapshotName = snapshots.absoluteFilePath(name + QStringLiteral(".snap"));
+  snapshotFile.setFileName(snapshotName + QStringLiteral(".new"));
+  snapshotRecords.setFileName(snapshotName + QStringLiteral(".files"));
+  newChunks.setFileName(repoDir + QStringLiteral("/chunks.idx.added"));
+
+  // ReadWrite, as the records are sorted in a mapping of the file
+  if ( !snapshotFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+       !snapshotRecords.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+       !newChunks.open(QIODevice::ReadWrite | QIODevice::Truncate) )
+  {
+    setFileError(!snapshotFile.isOpen() ? snapshotFile : !snapshotRecords.isOpen() ? snapshotRecords : newChunks);
+    discardSnapshot();
+    snapshotName = QString();
+    return false;
+  }
+
+  snapshot.setDevice(&snapshotFile);
+  snapshot.setVersion(QDataStream::Qt_5_0);
+  snapshot.writeRawData(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+  contentBytes = 0;
+  newBytes = 0;
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::openPrevious(const QString &fileName)
+{
+  closePrevious();
+
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 )
+    return false;
+
+  struct stat status;
+  if ( (::fstat(fd, &status) == -1) ||
+       (status.st_size < static_cast<off_t>(sizeof(SNAPSHOT_MAGIC) + sizeof(SnapshotTrailer))) )
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void *addr = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if ( addr == MAP_FAILED )
+    return false;
+
+  previousMap = static_cast<uchar *>(addr);
+  previousMapSize = status.st_size;
+
+  SnapshotTrailer trailer;
+  memcpy(&trailer, previousMap + previousMapSize - sizeof(trailer), sizeof(trailer));
+
+  // without a complete table (e.g. an older snapshot) all files are read again
+  if ( (memcmp(previousMap, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) ||
+       (memcmp(trailer.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC)) != 0) ||
+       (trailer.recordsOffset % 8) ||
+       (trailer.count > static_cast<quint64>(previousMapSize) / sizeof(SnapshotRecord)) ||
+       (trailer.recordsOffset + trailer.count * sizeof(SnapshotRecord) + sizeof(trailer) != static_cast<quint64>(previousMapSize)) )
+  {
+    closePrevious();
+    return false;
+  }
+
+  // every lookup lands somewhere else
+  ::madvise(previousMap, previousMapSize, MADV_RANDOM);
+
+  previousRecords = reinterpret_cast<const SnapshotRecord *>(previousMap + trailer.recordsOffset);
+  previousCount = trailer.count;
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::closePrevious()
+{
+  if ( previousMap )
+    ::munmap(previousMap, previousMapSize);
+
+  previousMap = nullptr;
+  previousMapSize = 0;
+  previousRecords = nullptr;
+  previousCount = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+const ChunkStore::SnapshotRecord *ChunkStore::findPrevious(const QString &path) const
+{
+  if ( !previousRecords )
+    return nullptr;
+
+  SnapshotRecord key;
+  key.pathHash = FileIndex::hashPath(path);
+
+  const SnapshotRecord *end = previousRecords + previousCount;
+
+  for (const SnapshotRecord *it = std::lower_bound(previousRecords, end, key, hashLess);
+       (it != end) && (it->pathHash == key.pathHash); ++it)
+  {
+    if ( (it->entryOffset >= static_cast<quint64>(previousMapSize)) ||
+         (it->chunksOffset + static_cast<quint64>(it->chunkCount) * ID_SIZE > static_cast<quint64>(previousMapSize)) )
+      continue;
+
+    // the entry starts with its type and path; enough for the longest path
+    const qint64 len = qMin(previousMapSize - static_cast<qint64>(it->entryOffset), Q_INT64_C(256 * 1024));
+    const QByteArray entry = QByteArray::fromRawData(reinterpret_cast<const char *>(previousMap + it->entryOffset),
+                                                     static_cast<int>(len));
+    QDataStream in(entry);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint8 type;
+    QString entryPath;
+    in >> type >> entryPath;
+
+    if ( (in.status() == QDataStream::Ok) && (type == File) && (entryPath == path) )
+      return it;
+  }
+
+  return nullptr;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::writeEntry(EntryType type, const FileEntry &entry)
+{
+  snapshot << static_cast<quint8>(type) << entry.path << static_cast<quint32>(entry.mode)
+           << entry.owner() << entry.group()
+           << entry.mtime << entry.ctime << entry.size;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::addDir(const FileEntry &entry)
+{
+  writeEntry(Dir, entry);
+
+  return (snapshot.status() == QDataStream::Ok) || setFileError(snapshotFile);
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::addSymLink(const FileEntry &entry, const QString &target)
+{
+  writeEntry(SymLink, entry);
+  snapshot << target;
+
+  return (snapshot.status() == QDataStream::Ok) || setFileError(snapshotFile);
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::addUnchangedFile(const FileEntry &entry)
+{
+  const SnapshotRecord *prev = findPrevious(entry.path);
+
+  if ( !prev || (prev->size != entry.size) || (prev->mtime != entry.mtime) || (prev->ctime != entry.ctime) )
+    return false;
+
+  const qint64 entryOffset = snapshotFile.pos();
+
+  writeEntry(File, entry);
+  writeFileChunks(entry, entryOffset, reinterpret_cast<const char *>(previousMap + prev->chunksOffset), prev->chunkCount);
+
+  contentBytes += entry.size;
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::writeFileChunks(const FileEntry &entry, qint64 entryOffset, const char *ids, quint32 num)
+{
+  snapshot << num;
+
+  SnapshotRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.pathHash = FileIndex::hashPath(entry.path);
+  rec.size = entry.size;
+  rec.mtime = entry.mtime;
+  rec.ctime = entry.ctime;
+  rec.entryOffset = entryOffset;
+  rec.chunksOffset = snapshotFile.pos();
+  rec.chunkCount = num;
+
+  snapshot.writeRawData(ids, static_cast<int>(num * ID_SIZE));
+  snapshotRecords.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::startFile(const FileEntry &entry)
+{
+  currentFile = entry;
+  fileBytes = 0;
+  pending.clear();
+  pendingStart = 0;
+  fileChunks.clear();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::writeData(const char *data, qint64 len)
+{
+  pending.append(data, static_cast<int>(len));
+  fileBytes += len;
+  contentBytes += len;
+
+  return storeChunks(false);
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::storeChunks(bool endOfFile)
+{
+  const uchar *data = reinterpret_cast<const uchar *>(pending.constData());
+
+  while ( true )
+  {
+    const int available = pending.size() - pendingStart;
+
+    // a cut can only be decided with a full MAX_CHUNK in front of us
+    if ( (available == 0) || (!endOfFile && (available < MAX_CHUNK)) )
+      break;
+
+    const int len = findCut(data + pendingStart, qMin(available, MAX_CHUNK));
+
+    if ( !storeChunk(pending.constData() + pendingStart, len) )
+      return false;
+
+    pendingStart += len;
+  }
+
+  // move the rest to the front only once in a while
+  if ( pendingStart >= pending.size() / 2 )
+  {
+    pending.remove(0, pendingStart);
+    pendingStart = 0;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::storeChunk(const char *data, int len)
+{
+  hasher.reset();
+  hasher.addData(data, len);
+  const QByteArray id = hasher.result();
+
+  fileChunks.append(id);
+
+  if ( containsChunk(id) )
+    return true;
+
+  if ( !pack.isOpen() && !openPack() )
+    return false;
+
+  ChunkRecord rec;
+  memcpy(rec.id, id.constData(), ID_SIZE);
+  rec.pack = packNum;
+  rec.length = len;
+  rec.offset = pack.pos();
+
+  if ( pack.write(data, len) != len )
+    return setFileError(pack);
+
+  if ( newChunks.write(reinterpret_cast<const char *>(&rec), sizeof(rec)) != sizeof(rec) )
+    return setFileError(newChunks);
+
+  rememberChunk(id);
+  newBytes += len;
+
+  if ( pack.pos() >= PACK_SIZE )
+    return closePack();
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::finishFile()
+{
+  if ( !storeChunks(true) )
+    return false;
+
+  // what we read, even if the file changed in the meantime
+  currentFile.size = fileBytes;
+
+  const qint64 entryOffset = snapshotFile.pos();
+
+  writeEntry(File, currentFile);
+  writeFileChunks(currentFile, entryOffset, fileChunks.constData(), static_cast<quint32>(fileChunks.size() / ID_SIZE));
+
+  pending.clear();
+  pendingStart = 0;
+
+  return (snapshot.status() == QDataStream::Ok) || setFileError(snapshotFile);
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::writeTable()
+{
+  if ( !snapshotRecords.flush() || (snapshotRecords.error() != QFile::NoError) )
+    return setFileError(snapshotRecords);
+
+  const qint64 recordsSize = snapshotRecords.size();
+  const quint64 num = recordsSize / sizeof(SnapshotRecord);
+
+  // sort inside the page cache, so that millions of files need not fit into memory
+  if ( num )
+  {
+    void *addr = ::mmap(nullptr, recordsSize, PROT_READ | PROT_WRITE, MAP_SHARED, snapshotRecords.handle(), 0);
+    if ( addr == MAP_FAILED )
+      return setError(snapshotRecords.fileName() + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+    SnapshotRecord *sorted = static_cast<SnapshotRecord *>(addr);
+    std::sort(sorted, sorted + num, hashLess);
+    ::munmap(addr, recordsSize);
+  }
+
+  SnapshotTrailer trailer;
+  memcpy(trailer.magic, TABLE_MAGIC, sizeof(TABLE_MAGIC));
+  trailer.recordsOffset = (snapshotFile.pos() + 7) & ~Q_INT64_C(7);
+  trailer.count = num;
+
+  snapshotFile.write(QByteArray(static_cast<int>(trailer.recordsOffset - snapshotFile.pos()), 0));
+
+  if ( !snapshotRecords.seek(0) )
+    return setFileError(snapshotRecords);
+
+  while ( !snapshotRecords.atEnd() )
+  {
+    const QByteArray data = snapshotRecords.read(1024 * 1024);
+
+    if ( data.isEmpty() )
+      return setFileError(snapshotRecords);
+
+    if ( snapshotFile.write(data) != data.size() )
+      return setFileError(snapshotFile);
+  }
+
+  if ( snapshotFile.write(reinterpret_cast<const char *>(&trailer), sizeof(trailer)) != sizeof(trailer) )
+    return setFileError(snapshotFile);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+QString ChunkStore::packFileName(quint32 num) const
+{
+  return repoDir + QStringLiteral("/packs/%1.pack").arg(num, 8, 10, QLatin1Char('0'));
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::openPack()
+{
+  pack.setFileName(packFileName(packNum));
+
+  if ( !pack.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    return setFileError(pack);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::closePack()
+{
+  // the index must never list chunks which are not on the disk yet
+  bool ok = pack.flush() && (::fdatasync(pack.handle()) == 0) && (pack.error() == QFile::NoError);
+
+  if ( !ok )
+    setFileError(pack);
+
+  pack.close();
+  packNum++;
+
+  return ok;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::finishSnapshot()
+{
+  if ( !snapshotFile.isOpen() )
+    return false;
+
+  if ( pack.isOpen() && !closePack() )
+  {
+    discardSnapshot();
+    return false;
+  }
+
+  snapshot << static_cast<quint8>(EndOfSnapshot);
+
+  if ( (snapshot.status() != QDataStream::Ok) || !writeTable() )
+  {
+    if ( error.isEmpty() )
+      setFileError(snapshotFile);
+
+    discardSnapshot();
+    return false;
+  }
+
+  // like the packs and the index; after a crash the renamed snapshot must be complete
+  if ( !snapshotFile.flush() || (::fdatasync(snapshotFile.handle()) == -1) ||
+       (snapshotFile.error() != QFile::NoError) )
+  {
+    setFileError(snapshotFile);
+    discardSnapshot();
+    return false;
+  }
+
+  const QString indexName = repoDir + QStringLiteral("/chunks.idx");
+  QFile index(indexName + QStringLiteral(".new"));
+
+  if ( !mergeIndex(index) )
+  {
+    index.remove();
+    discardSnapshot();
+    return false;
+  }
+
+  index.close();
+  closeIndex();
+
+  // first the index, so that a snapshot never references unknown chunks
+  if ( ::rename(QFile::encodeName(index.fileName()).constData(), QFile::encodeName(indexName).constData()) == -1 )
+  {
+    setError(indexName + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+    index.remove();
+    discardSnapshot();
+    openIndex();
+    return false;
+  }
+
+  snapshotFile.close();
+  if ( ::rename(QFile::encodeName(snapshotFile.fileName()).constData(),
+                QFile::encodeName(snapshotName).constData()) == -1 )
+  {
+    setError(snapshotName + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+    snapshotFile.remove();
+    discardSnapshot();
+    openIndex();
+    return false;
+  }
+
+  snapshot.setDevice(nullptr);
+  snapshotRecords.remove();
+  newChunks.remove();
+  recentChunks.clear();
+  recentOrder.clear();
+  recentNext = 0;
+  closePrevious();
+
+  return openIndex();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::mergeIndex(QFile &index)
+{
+  if ( !newChunks.flush() || (newChunks.error() != QFile::NoError) )
+    return setFileError(newChunks);
+
+  if ( !index.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    return setFileError(index);
+
+  // sorted inside the page cache like the table of the snapshot;
+  // a chunk stored twice keeps only one record
+  const qint64 addedSize = newChunks.size();
+  quint64 num = addedSize / sizeof(ChunkRecord);
+  ChunkRecord *added = nullptr;
+
+  if ( num )
+  {
+    void *addr = ::mmap(nullptr, addedSize, PROT_READ | PROT_WRITE, MAP_SHARED, newChunks.handle(), 0);
+    if ( addr == MAP_FAILED )
+      return setError(newChunks.fileName() + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+    added = static_cast<ChunkRecord *>(addr);
+    std::sort(added, added + num, idLess);
+    num = std::unique(added, added + num, idEqual) - added;
+
+    // merged front to back
+    ::madvise(addr, addedSize, MADV_SEQUENTIAL);
+  }
+
+  ChunkIndexHeader header;
+  memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.count = count + num;
+  index.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  const ChunkRecord *old = records, *oldEnd = records + count;
+  const ChunkRecord *it = added, *end = added + num;
+
+  while ( (old != oldEnd) || (it != end) )
+  {
+    const ChunkRecord *next;
+
+    if ( (it == end) || ((old != oldEnd) && idLess(*old, *it)) )
+      next = old++;
+    else
+      next = it++;
+
+    index.write(reinterpret_cast<const char *>(next), sizeof(ChunkRecord));
+  }
+
+  if ( added )
+    ::munmap(added, addedSize);
+
+  if ( !index.flush() || (::fdatasync(index.handle()) == -1) || (index.error() != QFile::NoError) )
+    return setFileError(index);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void ChunkStore::discardSnapshot()
+{
+  // the data in the pack is simply not referenced
+  if ( pack.isOpen() )
+  {
+    pack.close();
+    packNum++;
+  }
+
+  snapshot.setDevice(nullptr);
+
+  if ( snapshotFile.isOpen() )
+    snapshotFile.remove();
+
+  if ( snapshotRecords.isOpen() )
+    snapshotRecords.remove();
+
+  if ( newChunks.isOpen() )
+    newChunks.remove();
+
+  recentChunks.clear();
+  recentOrder.clear();
+  recentNext = 0;
+  closePrevious();
+  pending.clear();
+  pendingStart = 0;
+  fileChunks.clear();
+}
+
+//--------------------------------------------------------------------------------
+
+// the ids of the names in a snapshot; -1 leaves the owner as it is
+
+static uid_t userId(const QString &name)
+{
+  static QHash<QString, uid_t> ids;
+
+  QHash<QString, uid_t>::const_iterator it = ids.constFind(name);
+  if ( it != ids.constEnd() )
+    return it.value();
+
+  struct passwd *pw = ::getpwnam(name.toLocal8Bit().constData());
+  const uid_t id = pw ? pw->pw_uid : static_cast<uid_t>(-1);
+
+  ids.insert(name, id);
+  return id;
+}
+
+//--------------------------------------------------------------------------------
+
+static gid_t groupId(const QString &name)
+{
+  static QHash<QString, gid_t> ids;
+
+  QHash<QString, gid_t>::const_iterator it = ids.constFind(name);
+  if ( it != ids.constEnd() )
+    return it.value();
+
+  struct group *gr = ::getgrnam(name.toLocal8Bit().constData());
+  const gid_t id = gr ? gr->gr_gid : static_cast<gid_t>(-1);
+
+  ids.insert(name, id);
+  return id;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::restoreSnapshot(const QString &fileName, const QString &targetDir)
+{
+  close();
+  error = QString();
+
+  // the snapshots are in a subdir of the repository
+  repoDir = QDir::cleanPath(QFileInfo(fileName).absolutePath() + QStringLiteral("/.."));
+
+  QFile file(fileName);
+
+  if ( !QFile::exists(repoDir + QStringLiteral("/chunks.idx")) )
+    setError(fileName + QStringLiteral(": not in a chunk repository"));
+  else if ( openIndex() && !file.open(QIODevice::ReadOnly) )
+    setFileError(file);
+
+  if ( !error.isEmpty() )
+  {
+    closeIndex();
+    repoDir = QString();
+    return false;
+  }
+
+  QDataStream in(&file);
+  in.setVersion(QDataStream::Qt_5_0);
+
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  if ( (in.readRawData(magic, sizeof(magic)) != static_cast<int>(sizeof(magic))) || (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) )
+    in.setStatus(QDataStream::ReadCorruptData);
+
+  QString base = QDir(targetDir).absolutePath();
+  if ( !base.endsWith(QLatin1Char('/')) )
+    base += QLatin1Char('/');
+
+  const bool isRoot = (::geteuid() == 0);
+
+  QStringList problems;
+  QVector<FileEntry> dirs;  // their metadata is set when everything inside them is written
+  QFile packFile;
+
+  while ( in.status() == QDataStream::Ok )
+  {
+    quint8 type = EndOfSnapshot;
+    in >> type;
+
+    if ( (in.status() != QDataStream::Ok) || (type == EndOfSnapshot) )
+      break;
+
+    FileEntry entry;
+    quint32 mode = 0;
+    QString owner, group, target;
+    QByteArray ids;
+
+    in >> entry.path >> mode >> owner >> group >> entry.mtime >> entry.ctime >> entry.size;
+    entry.mode = mode;
+
+    if ( type == SymLink )
+      in >> target;
+    else if ( type == File )
+    {
+      quint32 num = 0;
+      in >> num;
+
+      if ( num > file.size() / ID_SIZE )
+        in.setStatus(QDataStream::ReadCorruptData);
+      else
+      {
+        ids.resize(static_cast<int>(num * ID_SIZE));
+        if ( in.readRawData(ids.data(), ids.size()) != ids.size() )
+          in.setStatus(QDataStream::ReadPastEnd);
+      }
+    }
+    else if ( type != Dir )
+      in.setStatus(QDataStream::ReadCorruptData);
+
+    if ( in.status() != QDataStream::Ok )
+      break;
+
+    // stay inside targetDir, whatever the snapshot says
+    const QString path = QDir::cleanPath(base + entry.path);
+    if ( !(path + QLatin1Char('/')).startsWith(base) )
+    {
+      problems.append(entry.path + QStringLiteral(": invalid path"));
+      continue;
+    }
+
+    entry.path = path;
+    entry.uid = isRoot ? userId(owner) : static_cast<uid_t>(-1);
+    entry.gid = isRoot ? groupId(group) : static_cast<gid_t>(-1);
+
+    const QByteArray name = QFile::encodeName(path);
+    error = QString();
+
+    if ( type == Dir )
+    {
+      if ( QDir().mkpath(path) )
+        dirs.append(entry);
+      else
+        problems.append(path + QStringLiteral(": could not create the directory"));
+
+      continue;
+    }
+
+    // the dirs come first, but an entry below an unreadable dir may be all there is
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    // replaces what was restored there before, without writing through a symlink
+    if ( (::unlink(name.constData()) == -1) && (errno != ENOENT) )
+      setError(path + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+    else if ( type == SymLink )
+    {
+      if ( ::symlink(QFile::encodeName(target).constData(), name.constData()) == -1 )
+        setError(path + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+      else
+        restoreMetadata(entry);
+    }
+    else if ( restoreFile(entry, ids, packFile) )
+      restoreMetadata(entry);
+
+    if ( !error.isEmpty() )
+      problems.append(error);
+  }
+
+  if ( in.status() != QDataStream::Ok )
+    problems.append(fileName + QStringLiteral(": invalid snapshot file"));
+
+  // the deepest first, as restoring the content changed the times of the dirs
+  for (int i = dirs.count() - 1; i >= 0; i--)
+  {
+    if ( !restoreMetadata(dirs[i]) )
+      problems.append(error);
+  }
+
+  closeIndex();
+  repoDir = QString();
+
+  error = problems.join(QLatin1Char('\n'));
+  return problems.isEmpty();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::restoreFile(const FileEntry &entry, const QByteArray &ids, QFile &packFile)
+{
+  QFile out(entry.path);
+  if ( !out.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    return setFileError(out);
+
+  QByteArray data;
+  qint64 written = 0;
+
+  for (int i = 0; i < ids.size(); i += ID_SIZE)
+  {
+    const ChunkRecord *rec = findChunk(ids.constData() + i);
+
+    if ( !rec )
+      return setError(entry.path + QStringLiteral(": a chunk is missing in the repository"));
+
+    if ( !readChunk(*rec, packFile, data) )
+      return setError(entry.path + QStringLiteral(": ") + error);
+
+    if ( out.write(data) != data.size() )
+      return setFileError(out);
+
+    written += data.size();
+  }
+
+  if ( !out.flush() || (out.error() != QFile::NoError) )
+    return setFileError(out);
+
+  if ( written != entry.size )
+    return setError(entry.path + QStringLiteral(": the chunks do not give the size of the file"));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::readChunk(const ChunkRecord &rec, QFile &packFile, QByteArray &data)
+{
+  const QString name = packFileName(rec.pack);
+
+  if ( (packFile.fileName() != name) || !packFile.isOpen() )
+  {
+    packFile.close();
+    packFile.setFileName(name);
+
+    if ( !packFile.open(QIODevice::ReadOnly) )
+      return setFileError(packFile);
+  }
+
+  if ( !packFile.seek(static_cast<qint64>(rec.offset)) )
+    return setFileError(packFile);
+
+  data = packFile.read(rec.length);
+
+  if ( data.size() != static_cast<int>(rec.length) )
+    return setError(name + QStringLiteral(": the pack is too short"));
+
+  hasher.reset();
+  hasher.addData(data);
+
+  if ( memcmp(hasher.result().constData(), rec.id, ID_SIZE) != 0 )
+    return setError(name + QStringLiteral(": a chunk is damaged"));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ChunkStore::restoreMetadata(const FileEntry &entry)
+{
+  const QByteArray name = QFile::encodeName(entry.path);
+
+  // an id of -1 is not changed; only root may give files away.
+  // Before the mode, as chown clears the setuid bits
+  if ( ((entry.uid != static_cast<uid_t>(-1)) || (entry.gid != static_cast<gid_t>(-1))) &&
+       (::lchown(name.constData(), entry.uid, entry.gid) == -1) )
+    return setError(entry.path + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+  if ( !entry.isSymLink() && (::chmod(name.constData(), entry.mode & 07777) == -1) )
+    return setError(entry.path + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+  qint64 secs = entry.mtime / 1000;
+  qint64 msecs = entry.mtime % 1000;
+  if ( msecs < 0 )
+  {
+    msecs += 1000;
+    secs--;
+  }
+
+  struct timespec times[2];
+  times[0].tv_sec = 0;
+  times[0].tv_nsec = UTIME_OMIT;  // atime
+  times[1].tv_sec = secs;
+  times[1].tv_nsec = msecs * 1000000;
+
+  if ( ::utimensat(AT_FDCWD, name.constData(), times, AT_SYMLINK_NOFOLLOW) == -1 )
+    return setError(entry.path + QStringLiteral(": ") + QString::fromLocal8Bit(strerror(errno)));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
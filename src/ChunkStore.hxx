@@ -0,0 +1,202 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _CHUNK_STORE_H_
+#define _CHUNK_STORE_H_
+
+// a deduplicating repository as alternative to tar slices.
+// File contents are cut into chunks at content defined boundaries (FastCDC with a
+// gear rolling hash), so that an insertion only changes the chunks around it.
+// Every chunk is identified by its SHA-256 and stored only once for all backups.
+//
+// Repository layout (all numbers in host byte order):
+//   packs/NNNNNNNN.pack  chunk data, appended until the pack reaches PACK_SIZE
+//   chunks.idx           Header + ChunkRecord[count], sorted by id
+//   chunks.idx.added     ChunkRecords of the running backup, unsorted; merged into the index at the end
+//   snapshots/NAME.snap  one per backup: the metadata of every entry and the ids of its chunks
+//
+// The index only lists chunks of packs which were completely written, and a snapshot
+// only appears when the backup finished, so a cancelled backup leaves only unused pack data.
+// restoreSnapshot() writes the files of a snapshot back; every chunk is checked against its id.
+//
+// Snapshot (QDataStream, Qt_5_0):
+//   "KBSNAP01"
+//   per entry: quint8 type, QString path, quint32 mode, QString owner, QString group,
+//              qint64 mtime, qint64 ctime, qint64 size,
+//              then for a SymLink: QString target; for a File: quint32 count, count * 32 bytes id
+//   quint8 0
+// followed by the table of its files (host byte order), through which the next backup
+// finds the unchanged files in the memory mapped snapshot:
+//   SnapshotRecord[count]  sorted by pathHash, at an offset aligned to 8
+//   SnapshotTrailer        "KBSNTAB1", offset of the records, count
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QSet>
+#include <QVector>
+#include <QDataStream>
+#include <QCryptographicHash>
+
+#include <FileEntry.hxx>
+
+#include <string.h>
+
+class ChunkStore
+{
+  public:
+    enum EntryType { EndOfSnapshot = 0, Dir = 1, File = 2, SymLink = 3 };
+
+    struct ChunkRecord
+    {
+      uchar id[32];
+      quint32 pack;
+      quint32 length;
+      quint64 offset;
+    };
+
+    struct SnapshotRecord
+    {
+      quint64 pathHash;
+      qint64 size;
+      qint64 mtime;
+      qint64 ctime;
+      quint64 entryOffset;   // of the entry in the snapshot
+      quint64 chunksOffset;  // of its chunk ids
+      quint32 chunkCount;
+      quint32 reserved;
+    };
+
+    ChunkStore();
+    ~ChunkStore();
+
+    // opens or creates the repository in dir
+    bool open(const QString &dir);
+    void close();
+    bool isOpen() const { return !repoDir.isEmpty(); }
+
+    // starts a new snapshot. The newest existing one tells which files are unchanged
+    bool startSnapshot(const QString &name);
+
+    bool addDir(const FileEntry &entry);
+    bool addSymLink(const FileEntry &entry, const QString &target);
+
+    // records the file with the chunks of the last snapshot when size, mtime and ctime
+    // did not change since; returns false if the file has to be read
+    bool addUnchangedFile(const FileEntry &entry);
+
+    // the content of a changed file is passed in with writeData() between these
+    void startFile(const FileEntry &entry);
+    bool writeData(const char *data, qint64 len);
+    bool finishFile();
+
+    // writes the index and makes the snapshot visible
+    bool finishSnapshot();
+    void discardSnapshot();
+
+    QString getSnapshotFileName() const { return snapshotName; }
+
+    // writes the dirs, files and symlinks of the snapshot fileName into targetDir, each below
+    // its absolute path there. The owner is only restored when running as root.
+    // An entry which can not be restored is skipped; then false is returned and
+    // errorString() lists all of them
+    bool restoreSnapshot(const QString &fileName, const QString &targetDir);
+
+    // content bytes of the snapshot, and how many of them were not yet in the repository
+    quint64 getContentBytes() const { return contentBytes; }
+    quint64 getNewBytes() const { return newBytes; }
+
+    QString errorString() const { return error; }
+
+  private:
+    Q_DISABLE_COPY(ChunkStore)
+
+    struct ChunkId
+    {
+      uchar id[32];
+
+      bool operator==(const ChunkId &other) const { return memcmp(id, other.id, sizeof(id)) == 0; }
+    };
+
+    friend uint qHash(const ChunkId &id, uint seed);
+
+    bool openIndex();
+    void closeIndex();
+    const ChunkRecord *findChunk(const char *id) const;
+    bool containsChunk(const QByteArray &id) const;
+    void rememberChunk(const QByteArray &id);
+
+    // sorts the chunks of the running backup and writes them with the old ones into index
+    bool mergeIndex(QFile &index);
+
+    // maps the table of files of the newest snapshot
+    bool openPrevious(const QString &fileName);
+    void closePrevious();
+    const SnapshotRecord *findPrevious(const QString &path) const;
+
+    void writeEntry(EntryType type, const FileEntry &entry);
+    void writeFileChunks(const FileEntry &entry, qint64 entryOffset, const char *ids, quint32 num);
+    bool writeTable();
+    bool storeChunks(bool endOfFile);
+    bool storeChunk(const char *data, int len);
+    QString packFileName(quint32 num) const;
+    bool openPack();
+    bool closePack();
+
+    bool restoreFile(const FileEntry &entry, const QByteArray &ids, QFile &packFile);
+    bool readChunk(const ChunkRecord &rec, QFile &packFile, QByteArray &data);
+    bool restoreMetadata(const FileEntry &entry);
+
+    bool setError(const QString &message);
+    bool setFileError(const QFile &file);
+
+  private:
+    QString repoDir;
+    QString error;
+
+    // the sorted index of all chunks of the earlier backups
+    uchar *indexMap;
+    qint64 indexMapSize;
+    const ChunkRecord *records;
+    quint64 count;
+
+    // chunks stored by the running backup. Only the most recent ones are looked up, so that
+    // the memory stays bounded; a chunk repeated far apart within one backup is stored twice
+    QFile newChunks;
+    QSet<ChunkId> recentChunks;
+    QVector<ChunkId> recentOrder;  // the oldest is replaced at recentNext
+    int recentNext;
+
+    quint32 packNum;
+    QFile pack;
+
+    // the newest snapshot
+    uchar *previousMap;
+    qint64 previousMapSize;
+    const SnapshotRecord *previousRecords;
+    quint64 previousCount;
+
+    QString snapshotName;
+    QFile snapshotFile;
+    QDataStream snapshot;
+    QFile snapshotRecords;  // of the files, sorted into the table at the end
+
+    // the file currently added
+    FileEntry currentFile;
+    qint64 fileBytes;
+    QByteArray pending;
+    int pendingStart;
+    QByteArray fileChunks;
+    QCryptographicHash hasher;
+
+    quint64 contentBytes;
+    quint64 newBytes;
+};
+
+#endif
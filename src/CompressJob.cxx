@@ -0,0 +1,154 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <CompressJob.hxx>
+
+#include <KLocalizedString>
+
+#include <QFile>
+#include <QMutexLocker>
+#include <QScopedPointer>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+
+CompressJob::CompressJob(const QString &name, const CompressionCodec &comprCodec, qint64 spillThreshold,
+                         PageCache::Mode mode)
+  : origName(name), codec(comprCodec), comprBuffer(spillThreshold), cacheMode(mode),
+    cancelled(0), done(false), ok(false)
+{
+  setAutoDelete(false);  // the Archiver still needs the result after run()
+}
+
+//--------------------------------------------------------------------------------
+
+void CompressJob::run()
+{
+  bool result = compress();
+
+  QMutexLocker locker(&mutex);
+  ok = result;
+  done = true;
+  doneCondition.wakeAll();
+}
+
+//--------------------------------------------------------------------------------
+
+void CompressJob::cancel()
+{
+  cancelled.fetchAndStoreRelease(1);
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressJob::isDone() const
+{
+  QMutexLocker locker(&mutex);
+  return done;
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressJob::waitForDone(unsigned long msecs)
+{
+  QMutexLocker locker(&mutex);
+
+  if ( !done )
+    doneCondition.wait(&mutex, msecs);
+
+  return done;
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressJob::compress()
+{
+  QFile origFile(origName);
+  if ( ! origFile.open(QIODevice::ReadOnly | QIODevice::Unbuffered) )
+  {
+    errorString = i18n("Could not read file: %1\n"
+                       "The operating system reports: %2",
+                       origName,
+                       origFile.errorString());
+    return false;
+  }
+
+  QScopedPointer<QIODevice> filter(codec.createDevice(&comprBuffer, origFile.size()));
+
+  if ( !filter->open(QIODevice::WriteOnly) )
+  {
+    errorString = i18n("Could not create temporary file for compressing: %1\n"
+                       "The operating system reports: %2",
+                       origName,
+                       filter->errorString());
+    return false;
+  }
+
+  struct stat status;
+  memset(&status, 0, sizeof(status));
+  ::fstat(origFile.handle(), &status);
+
+  if ( ! ioBuffer.resize(IoBuffer::sizeFor(status.st_blksize)) )
+  {
+    errorString = i18n("Could not allocate memory for compressing: %1", origName);
+    return false;
+  }
+
+  qint64 len;
+  qint64 fileSize = origFile.size();
+  qint64 readBytes = 0;
+
+  pageCache.startReading(origFile.handle(), cacheMode);
+  contentHash.reset();
+
+  while ( fileSize && !origFile.atEnd() && !cancelled.loadAcquire() )
+  {
+    len = origFile.read(ioBuffer.data(), ioBuffer.size());
+
+    if ( len < 0 )  // error in reading
+    {
+      errorString = i18n("Could not read from file '%1'\n"
+                         "The operating system reports: %2",
+                         origName,
+                         origFile.errorString());
+      return false;
+    }
+
+    if ( filter->write(ioBuffer.data(), len) != len )
+    {
+      errorString = i18n("Could not write to temporary file");
+      return false;
+    }
+
+    contentHash.addData(ioBuffer.data(), len);
+
+    pageCache.doneReading(readBytes, len);
+    readBytes += len;
+  }
+
+  if ( cancelled.loadAcquire() )
+    return false;
+
+  // a member without the end of the compressed data could not be uncompressed
+  if ( !CompressionCodec::closeDevice(filter.data()) )
+  {
+    errorString = i18n("Could not compress file '%1'\n"
+                       "The operating system reports: %2",
+                       origName,
+                       filter->errorString());
+    return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _COMPRESS_JOB_H_
+#define _COMPRESS_JOB_H_
+
+// compresses one file in a worker thread of the Archiver's compression pool.
+// The job does not touch the GUI; the Archiver collects the result in
+// traversal order and copies it into the archive
+
+#include <QRunnable>
+#include <QString>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+#include <SpillBuffer.hxx>
+#include <CompressionCodec.hxx>
+#include <IoBuffer.hxx>
+#include <PageCache.hxx>
+#include <ContentHash.hxx>
+
+class CompressJob : public QRunnable
+{
+  public:
+    // the compressed data is kept in memory up to spillThreshold bytes
+    CompressJob(const QString &origName, const CompressionCodec &codec, qint64 spillThreshold,
+                PageCache::Mode cacheMode);
+
+    void run() override;
+
+    // ask the worker to stop as soon as possible; the result is then not ok
+    void cancel();
+
+    bool isDone() const;
+
+    // returns true if the job finished within the given time
+    bool waitForDone(unsigned long msecs);
+
+    // only valid after the job is done
+    bool isOk() const { return ok; }
+    const QString &getErrorString() const { return errorString; }
+    SpillBuffer &getBuffer() { return comprBuffer; }
+
+    // of the original content; cheap compared to the compression, so always done
+    quint64 getContentHash() const { return contentHash.result(); }
+
+  private:
+    bool compress();
+
+  private:
+    QString origName;
+    CompressionCodec codec;
+    SpillBuffer comprBuffer;
+    IoBuffer ioBuffer;
+    PageCache::Mode cacheMode;
+    PageCache pageCache;
+    ContentHash contentHash;
+    QString errorString;
+    QAtomicInt cancelled;
+
+    mutable QMutex mutex;
+    QWaitCondition doneCondition;
+    bool done;
+    bool ok;
+};
+
+#endif
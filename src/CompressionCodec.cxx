@@ -0,0 +1,187 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <CompressionCodec.hxx>
+
+#ifdef HAVE_ZSTD
+#include <ZstdDevice.hxx>
+#endif
+
+#include <KFilterBase>
+
+//--------------------------------------------------------------------------------
+
+// below this size it's not worth to start compression threads for a single file
+const qint64 MULTITHREAD_SIZE = 64 * 1024 * 1024;
+
+//--------------------------------------------------------------------------------
+
+CompressionCodec::CompressionCodec()
+  : type(Auto), level(0), workers(1)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+void CompressionCodec::setType(Type t)
+{
+  type = isAvailable(t) ? t : Auto;
+}
+
+//--------------------------------------------------------------------------------
+
+CompressionCodec::Type CompressionCodec::resolvedType() const
+{
+  if ( type != Auto )
+    return type;
+
+  if ( isAvailable(Xz) )
+    return Xz;
+
+  if ( isAvailable(BZip2) )
+    return BZip2;
+
+  return GZip;
+}
+
+//--------------------------------------------------------------------------------
+
+QString CompressionCodec::getExtension() const
+{
+  switch ( resolvedType() )
+  {
+    case Xz:    return QStringLiteral(".xz");
+    case BZip2: return QStringLiteral(".bz2");
+    case Zstd:  return QStringLiteral(".zst");
+    default:    return QStringLiteral(".gz");
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressionCodec::usesThreads(qint64 inputSize) const
+{
+#ifdef HAVE_ZSTD
+  // a slice (unknown size) is always large
+  return (resolvedType() == Zstd) && (workers > 1) && ((inputSize < 0) || (inputSize >= MULTITHREAD_SIZE));
+#else
+  Q_UNUSED(inputSize)
+  return false;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+
+QIODevice *CompressionCodec::createDevice(QIODevice *dev, qint64 inputSize) const
+{
+  Type t = resolvedType();
+
+#ifdef HAVE_ZSTD
+  if ( t == Zstd )
+    return new ZstdDevice(dev, level, usesThreads(inputSize) ? workers : 1);
+#else
+  Q_UNUSED(inputSize)
+#endif
+
+  return new KCompressionDevice(dev, false, kdeType(t));
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressionCodec::closeDevice(QIODevice *device)
+{
+  device->close();
+
+#ifdef HAVE_ZSTD
+  // KCompressionDevice does not tell if its close() failed
+  ZstdDevice *zstd = qobject_cast<ZstdDevice *>(device);
+  if ( zstd && zstd->failed() )
+    return false;
+#endif
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 CompressionCodec::pendingBytes(const QIODevice *device)
+{
+#ifdef HAVE_ZSTD
+  const ZstdDevice *zstd = qobject_cast<const ZstdDevice *>(device);
+  if ( zstd )
+    return zstd->pendingBytes();
+#else
+  Q_UNUSED(device)
+#endif
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
+
+bool CompressionCodec::isAvailable(Type t)
+{
+  if ( t == Auto )
+    return true;
+
+  if ( t == Zstd )
+  {
+#ifdef HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  KFilterBase *base = KCompressionDevice::filterForCompressionType(kdeType(t));
+  bool available = (base != nullptr);
+  delete base;
+
+  return available;
+}
+
+//--------------------------------------------------------------------------------
+
+KCompressionDevice::CompressionType CompressionCodec::kdeType(Type t)
+{
+  switch ( t )
+  {
+    case Xz:    return KCompressionDevice::Xz;
+    case BZip2: return KCompressionDevice::BZip2;
+    case GZip:  return KCompressionDevice::GZip;
+    default:    return KCompressionDevice::None;
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+QString CompressionCodec::typeName(Type t)
+{
+  switch ( t )
+  {
+    case Xz:    return QStringLiteral("xz");
+    case BZip2: return QStringLiteral("bzip2");
+    case GZip:  return QStringLiteral("gzip");
+    case Zstd:  return QStringLiteral("zstd");
+    default:    return QStringLiteral("auto");
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+CompressionCodec::Type CompressionCodec::typeFromName(const QString &name)
+{
+  for (int t = Xz; t <= Zstd; t++)
+    if ( name == typeName(static_cast<Type>(t)) )
+      return static_cast<Type>(t);
+
+  return Auto;
+}
+
+//--------------------------------------------------------------------------------
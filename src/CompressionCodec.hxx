@@ -0,0 +1,76 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _COMPRESSION_CODEC_H_
+#define _COMPRESSION_CODEC_H_
+
+// describes how files or slices are compressed and creates the device doing it.
+// A plain value, so that compression worker threads can take a copy
+
+#include <QString>
+#include <KCompressionDevice>
+
+class QIODevice;
+
+class CompressionCodec
+{
+  public:
+    // Auto chooses the best one of xz, bzip2 and gzip which is available
+    enum Type { Auto, Xz, BZip2, GZip, Zstd };
+
+    CompressionCodec();
+
+    // an unavailable type falls back to Auto
+    void setType(Type t);
+    Type getType() const { return type; }
+
+    // 0 is the default level of the codec; negative levels select the zstd fast modes.
+    // Only zstd supports a level
+    void setLevel(int lev) { level = lev; }
+    int getLevel() const { return level; }
+
+    // threads zstd may use for large data.
+    // A file compressed in a worker of the compression pool gets only 1
+    void setWorkers(int num) { workers = num; }
+
+    // true if data of inputSize (-1 if not known) is compressed with several threads
+    bool usesThreads(qint64 inputSize) const;
+
+    QString getExtension() const;
+
+    // returns a not yet opened device compressing all written data into dev.
+    // inputSize is the size of the data to be compressed, or -1 if not known.
+    // The caller owns the returned device
+    QIODevice *createDevice(QIODevice *dev, qint64 inputSize) const;
+
+    // closes a device made by createDevice(), which writes the end of the compressed data.
+    // Returns false if that failed; device->errorString() tells why
+    static bool closeDevice(QIODevice *device);
+
+    // the most bytes a device made by createDevice() still writes for the data it got so far,
+    // or -1 if the codec does not tell
+    static qint64 pendingBytes(const QIODevice *device);
+
+    static bool isAvailable(Type t);
+
+    // names as stored in the profile
+    static QString typeName(Type t);
+    static Type typeFromName(const QString &name);
+
+  private:
+    Type resolvedType() const;
+    static KCompressionDevice::CompressionType kdeType(Type t);
+
+  private:
+    Type type;
+    int level;
+    int workers;
+};
+
+#endif
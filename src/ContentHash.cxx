@@ -0,0 +1,238 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <ContentHash.hxx>
+
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+
+#ifdef HAVE_XXHASH
+
+ContentHash::ContentHash()
+  : state(XXH3_createState())
+{
+  reset();
+}
+
+//--------------------------------------------------------------------------------
+
+ContentHash::~ContentHash()
+{
+  XXH3_freeState(state);
+}
+
+//--------------------------------------------------------------------------------
+
+void ContentHash::reset()
+{
+  XXH3_64bits_reset(state);
+}
+
+//--------------------------------------------------------------------------------
+
+void ContentHash::addData(const char *data, qint64 len)
+{
+  XXH3_64bits_update(state, data, static_cast<size_t>(len));
+}
+
+//--------------------------------------------------------------------------------
+
+quint64 ContentHash::result() const
+{
+  const quint64 hash = XXH3_64bits_digest(state);
+  return hash ? hash : 1;
+}
+
+//--------------------------------------------------------------------------------
+
+ContentHash::Algorithm ContentHash::algorithm()
+{
+  return Xxh3;
+}
+
+//--------------------------------------------------------------------------------
+
+#else  // XXH64, as specified in xxhash's doc/xxhash_spec.md
+
+static const quint64 PRIME1 = Q_UINT64_C(11400714785074694791);
+static const quint64 PRIME2 = Q_UINT64_C(14029467366897019727);
+static const quint64 PRIME3 = Q_UINT64_C(1609587929392839161);
+static const quint64 PRIME4 = Q_UINT64_C(9650029242287828579);
+static const quint64 PRIME5 = Q_UINT64_C(2870177450012600261);
+
+static inline quint64 rotl(quint64 x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// the input is read as little endian
+static inline quint64 read64(const uchar *p)
+{
+  quint64 v;
+  memcpy(&v, p, sizeof(v));
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static inline quint32 read32(const uchar *p)
+{
+  quint32 v;
+  memcpy(&v, p, sizeof(v));
+#if Q_BYTE_ORDER == Q_BIG_ENDIAN
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline quint64 xxhRound(quint64 acc, quint64 input)
+{
+  acc += input * PRIME2;
+  acc = rotl(acc, 31);
+  return acc * PRIME1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 val)
+{
+  acc ^= xxhRound(0, val);
+  return acc * PRIME1 + PRIME4;
+}
+
+//--------------------------------------------------------------------------------
+
+ContentHash::ContentHash()
+{
+  reset();
+}
+
+//--------------------------------------------------------------------------------
+
+ContentHash::~ContentHash()
+{
+}
+
+//--------------------------------------------------------------------------------
+
+void ContentHash::reset()
+{
+  acc[0] = PRIME1 + PRIME2;
+  acc[1] = PRIME2;
+  acc[2] = 0;
+  acc[3] = 0 - PRIME1;
+  totalLength = 0;
+  buffered = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+void ContentHash::addData(const char *data, qint64 len)
+{
+  const uchar *p = reinterpret_cast<const uchar *>(data);
+  const uchar *end = p + len;
+
+  totalLength += len;
+
+  // complete a stripe from the last call first
+  if ( buffered )
+  {
+    const int fill = static_cast<int>(qMin(static_cast<qint64>(32 - buffered), len));
+    memcpy(buffer + buffered, p, fill);
+    buffered += fill;
+    p += fill;
+
+    if ( buffered < 32 )
+      return;
+
+    for (int i = 0; i < 4; i++)
+      acc[i] = xxhRound(acc[i], read64(buffer + i * 8));
+
+    buffered = 0;
+  }
+
+  // four independent lanes, which the compiler keeps in registers
+  quint64 v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+
+  for (; end - p >= 32; p += 32)
+  {
+    v1 = xxhRound(v1, read64(p));
+    v2 = xxhRound(v2, read64(p + 8));
+    v3 = xxhRound(v3, read64(p + 16));
+    v4 = xxhRound(v4, read64(p + 24));
+  }
+
+  acc[0] = v1; acc[1] = v2; acc[2] = v3; acc[3] = v4;
+
+  if ( p < end )
+  {
+    memcpy(buffer, p, end - p);
+    buffered = static_cast<int>(end - p);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+quint64 ContentHash::result() const
+{
+  quint64 hash;
+
+  if ( totalLength >= 32 )
+  {
+    hash = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+
+    for (int i = 0; i < 4; i++)
+      hash = mergeRound(hash, acc[i]);
+  }
+  else
+    hash = PRIME5;  // + the seed, which is 0
+
+  hash += totalLength;
+
+  const uchar *p = buffer;
+  const uchar *end = buffer + buffered;
+
+  for (; end - p >= 8; p += 8)
+  {
+    hash ^= xxhRound(0, read64(p));
+    hash = rotl(hash, 27) * PRIME1 + PRIME4;
+  }
+
+  if ( end - p >= 4 )
+  {
+    hash ^= static_cast<quint64>(read32(p)) * PRIME1;
+    hash = rotl(hash, 23) * PRIME2 + PRIME3;
+    p += 4;
+  }
+
+  for (; p < end; p++)
+  {
+    hash ^= (*p) * PRIME5;
+    hash = rotl(hash, 11) * PRIME1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+
+  return hash ? hash : 1;
+}
+
+//--------------------------------------------------------------------------------
+
+ContentHash::Algorithm ContentHash::algorithm()
+{
+  return Xxh64;
+}
+
+#endif
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _CONTENT_HASH_H_
+#define _CONTENT_HASH_H_
+
+// a fast non-cryptographic 64 bit hash of a file content, to find out if a file
+// with a new mtime still has the content of the last backup.
+// Uses XXH3 of libxxhash (which selects the SIMD variant for the CPU) when available,
+// else a built-in XXH64. The digests of both differ, so algorithm() is stored with them
+
+#include <QtGlobal>
+
+#ifdef HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+class ContentHash
+{
+  public:
+    enum Algorithm { None = 0, Xxh3 = 1, Xxh64 = 2 };
+
+    ContentHash();
+    ~ContentHash();
+
+    void reset();
+    void addData(const char *data, qint64 len);
+
+    // never 0, which means "not known" in the file index
+    quint64 result() const;
+
+    static Algorithm algorithm();
+
+  private:
+    Q_DISABLE_COPY(ContentHash)
+
+#ifdef HAVE_XXHASH
+    XXH3_state_t *state;
+#else
+    quint64 acc[4];
+    quint64 totalLength;
+    uchar buffer[32];
+    int buffered;
+#endif
+};
+
+#endif
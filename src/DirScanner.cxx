@@ -0,0 +1,383 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <DirScanner.hxx>
+#include <DirWalker.hxx>
+
+#include <QRunnable>
+#include <QMutexLocker>
+
+#include <fcntl.h>
+#include <errno.h>
+
+//--------------------------------------------------------------------------------
+
+int DirScanner::numThreads = 4;
+
+// the scanners pause when this many entries are read but not yet archived
+const int MAX_PENDING_ENTRIES = 100000;
+
+// dirs kept open for their subdirs; the others are opened by the absolute path.
+// Well below the usual limit of 1024 open files
+const int MAX_OPEN_DIRS = 256;
+
+//--------------------------------------------------------------------------------
+
+class ScanJob : public QRunnable
+{
+  public:
+    ScanJob(DirScanner *dirScanner, int index) : scanner(dirScanner), self(index) { }
+
+    void run() override { scanner->work(self); }
+
+  private:
+    DirScanner *scanner;
+    int self;
+};
+
+//--------------------------------------------------------------------------------
+
+DirScanner::DirScanner()
+  : excludeTrie(nullptr), root(nullptr), pendingEntries(0), openDirs(0), stopping(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+DirScanner::~DirScanner()
+{
+  stop();
+}
+
+//--------------------------------------------------------------------------------
+
+DirScanner::Node *DirScanner::start(const FileEntry &rootEntry, int threads)
+{
+  stop();
+
+  // every thread gets its own copy of the matcher
+  for (int i = 0; i <= threads; i++)
+  {
+    filterCopies.append(dirFilters);
+    queues.append(QList<Node *>());
+  }
+
+  const int self = threads;  // the caller
+
+  root = new Node(rootEntry);
+  root->excludes = excludeTrie ? excludeTrie->find(rootEntry.path) : nullptr;
+  classify(root, filterCopies[self]);
+
+  if ( root->state == Node::Waiting )
+  {
+    root->queue = self;
+    queues[self].append(root);
+  }
+
+  pool.setMaxThreadCount(qMax(1, threads));
+  for (int i = 0; i < threads; i++)
+    pool.start(new ScanJob(this, i));
+
+  return root;
+}
+
+//--------------------------------------------------------------------------------
+
+bool DirScanner::waitScanned(Node *node, unsigned long msecs)
+{
+  QMutexLocker locker(&mutex);
+
+  if ( node->state == Node::Waiting )
+  {
+    // no scanner got to it yet; don't wait for them
+    QList<Node *> &queue = queues[node->queue];
+
+    // without scanner threads it's always the last one
+    if ( queue.last() == node )
+      queue.removeLast();
+    else
+      queue.removeOne(node);
+
+    node->queue = -1;
+    node->state = Node::Scanning;
+
+    const int self = queues.count() - 1;
+    const WildcardMatcher &filters = filterCopies[self];
+
+    locker.unlock();
+    scan(node, filters);
+    locker.relock();
+
+    scanned(node, self);
+    return true;
+  }
+
+  if ( node->state == Node::Scanning )
+    changed.wait(&mutex, msecs);
+
+  return node->state == Node::Scanned;
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::release(Node *parent, int index)
+{
+  QMutexLocker locker(&mutex);
+
+  Node *node = parent->subdirs[index];
+  int entries = 0;
+
+  // when the caller gave up early, scanners might still work below the node;
+  // then it's only deleted in stop()
+  if ( detach(node, entries) )
+  {
+    parent->subdirs[index] = nullptr;
+    pendingEntries -= entries;
+    delete node;
+
+    changed.wakeAll();
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::stop()
+{
+  {
+    QMutexLocker locker(&mutex);
+    stopping = true;
+    changed.wakeAll();
+  }
+
+  pool.waitForDone();
+
+  delete root;
+  root = nullptr;
+
+  filterCopies.clear();
+  queues.clear();
+  pendingEntries = 0;
+  openDirs = 0;  // closed with the tree
+  stopping = false;
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::work(int self)
+{
+  QMutexLocker locker(&mutex);
+
+  const WildcardMatcher &filters = filterCopies[self];
+
+  while ( !stopping )
+  {
+    Node *node = (pendingEntries < MAX_PENDING_ENTRIES) ? takeWork(self) : nullptr;
+
+    if ( !node )
+    {
+      changed.wait(&mutex);
+      continue;
+    }
+
+    node->state = Node::Scanning;
+
+    locker.unlock();
+    scan(node, filters);
+    locker.relock();
+
+    scanned(node, self);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::scan(Node *node, const WildcardMatcher &filters)
+{
+  DirWalker walker;
+
+  // the parent's fd does not go away before we told that we opened ours
+  Node *parent = node->parent;
+  const bool relative = parent && (parent->fd != -1);
+
+  const bool opened = relative ? walker.open(parent->fd, node->dir.name) : walker.open(AT_FDCWD, node->dir.path);
+  const int openErrno = errno;
+
+  if ( parent )
+  {
+    QMutexLocker locker(&mutex);
+    subdirOpened(parent);
+  }
+
+  if ( !opened )
+  {
+    node->openError = openErrno;
+    return;
+  }
+
+  if ( !walker.readEntries(node->dir.path, node->entries) )
+  {
+    node->readError = errno;
+    return;
+  }
+
+  foreach (const FileEntry &entry, node->entries)
+  {
+    if ( entry.isDir() )
+    {
+      Node *subdir = new Node(entry, node);
+      subdir->excludes = node->excludes ? node->excludes->child(entry.name) : nullptr;
+      classify(subdir, filters);
+      node->subdirs.append(subdir);
+    }
+  }
+
+  node->fd = walker.takeHandle();  // scanned() decides if the subdirs get it
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::classify(Node *node, const WildcardMatcher &filters)
+{
+  if ( node->excludes && node->excludes->isExcludedDir() )
+    node->skip = Node::Excluded;
+  else if ( filters.matches(node->dir.path) )
+    node->skip = Node::Filtered;
+
+  // nothing to read
+  if ( (node->skip != Node::NotSkipped) || node->dir.error )
+    node->state = Node::Scanned;
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::scanned(Node *node, int self)
+{
+  node->state = Node::Scanned;
+
+  int waiting = 0;
+
+  if ( node->abandoned )  // nobody will look at the subdirs
+  {
+    foreach (Node *subdir, node->subdirs)
+      subdir->state = Node::Scanned;
+  }
+  else
+  {
+    pendingEntries += node->entries.count();
+
+    // the first subdir is needed first, so it goes to the end where we take from
+    for (int i = node->subdirs.count() - 1; i >= 0; i--)
+    {
+      Node *subdir = node->subdirs[i];
+
+      if ( subdir->state == Node::Waiting )
+      {
+        subdir->queue = self;
+        queues[self].append(subdir);
+        waiting++;
+      }
+    }
+  }
+
+  if ( node->fd != -1 )
+  {
+    if ( waiting && (openDirs < MAX_OPEN_DIRS) )
+    {
+      node->unopened = waiting;
+      openDirs++;
+    }
+    else
+    {
+      ::close(node->fd);
+      node->fd = -1;
+    }
+  }
+
+  changed.wakeAll();
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::subdirOpened(Node *parent)
+{
+  if ( (parent->fd != -1) && (--parent->unopened == 0) )
+    closeDir(parent);
+}
+
+//--------------------------------------------------------------------------------
+
+void DirScanner::closeDir(Node *node)
+{
+  ::close(node->fd);
+  node->fd = -1;
+  openDirs--;
+}
+
+//--------------------------------------------------------------------------------
+
+DirScanner::Node *DirScanner::takeWork(int self)
+{
+  Node *node = nullptr;
+
+  if ( !queues[self].isEmpty() )
+    node = queues[self].takeLast();
+  else
+  {
+    // steal the oldest dir of another queue, which is most probably the largest subtree
+    for (int i = 1; !node && (i < queues.count()); i++)
+    {
+      QList<Node *> &queue = queues[(self + i) % queues.count()];
+
+      if ( !queue.isEmpty() )
+        node = queue.takeFirst();
+    }
+  }
+
+  if ( node )
+    node->queue = -1;
+
+  return node;
+}
+
+//--------------------------------------------------------------------------------
+
+bool DirScanner::detach(Node *node, int &entries)
+{
+  if ( node->state == Node::Scanning )
+  {
+    node->abandoned = true;
+    return false;
+  }
+
+  if ( node->state == Node::Waiting )  // never read it
+  {
+    queues[node->queue].removeOne(node);
+    node->queue = -1;
+    node->state = Node::Scanned;
+
+    if ( node->parent )
+      subdirOpened(node->parent);
+  }
+  else if ( !node->abandoned )
+    entries += node->entries.count();
+
+  bool idle = true;
+
+  foreach (Node *subdir, node->subdirs)
+    if ( subdir && !detach(subdir, entries) )
+      idle = false;
+
+  // no subdir will open relative to it anymore
+  if ( idle && (node->fd != -1) )
+    closeDir(node);
+
+  return idle;
+}
+
+//--------------------------------------------------------------------------------
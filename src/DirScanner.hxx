@@ -0,0 +1,134 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _DIR_SCANNER_H_
+#define _DIR_SCANNER_H_
+
+// reads a directory tree with a pool of scanner threads ahead of the archiver.
+// Every scanner keeps its own queue of directories still to read: it takes the most
+// recently found one itself (depth first) and, when idle, steals the oldest one
+// (the largest subtree) from another scanner.
+// The archiver walks the resulting tree in the usual order and therefore writes
+// the members in the same order regardless of the number of threads. When it reaches a
+// directory no scanner has started on yet, it reads it itself instead of waiting.
+// Excluded and filtered directories are decided by the scanners and never read.
+// Every node keeps its place in the exclude trie, so only the names of entries
+// below a dir with excludes are looked up.
+// A scanned dir stays open until all its subdirs are opened relative to it, so that
+// the kernel does not resolve the whole path again for every dir
+
+#include <QVector>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+
+#include <FileEntry.hxx>
+#include <WildcardMatcher.hxx>
+#include <PathTrie.hxx>
+
+#include <unistd.h>
+
+class DirScanner
+{
+  public:
+    struct Node
+    {
+      enum State { Waiting, Scanning, Scanned };
+      enum Skip { NotSkipped, Excluded, Filtered };
+
+      explicit Node(const FileEntry &entry, Node *parentNode = nullptr)
+        : dir(entry), parent(parentNode), excludes(nullptr), state(Waiting), skip(NotSkipped), openError(0), readError(0),
+          fd(-1), unopened(0), queue(-1), abandoned(false) { }
+      ~Node() { qDeleteAll(subdirs); if ( fd != -1 ) ::close(fd); }
+
+      FileEntry dir;
+      Node *parent;  // nullptr for the root
+      const PathTrie::Node *excludes;  // nullptr when nothing below is excluded
+      State state;
+      Skip skip;
+      int openError;  // errno if the dir could not be opened
+      int readError;  // errno if the entries could not be read
+
+      // only valid when Scanned
+      QVector<FileEntry> entries;
+      QVector<Node *> subdirs;  // one per entry which is a dir, in the same order
+
+      int fd;  // the opened dir while subdirs still need it, else -1
+      int unopened;  // subdirs which will open relative to fd
+
+      int queue;  // the scanner queue holding the node while Waiting
+      bool abandoned;  // released while it was scanned
+    };
+
+    DirScanner();
+    ~DirScanner();
+
+    // set before start()
+    void setExcludes(const PathTrie *trie) { excludeTrie = trie; }
+    void setDirFilters(const WildcardMatcher &filters) { dirFilters = filters; }
+
+    // starts the scanners on the tree below root. The returned node stays valid until stop()
+    Node *start(const FileEntry &root, int threads);
+
+    // returns true when the node is scanned. Reads the node in the calling thread when
+    // no scanner took it yet; else waits at most msecs for the scanner
+    bool waitScanned(Node *node, unsigned long msecs);
+
+    // the caller is done with parent->subdirs[index] and everything below it
+    void release(Node *parent, int index);
+
+    // stops all scanners and deletes the whole tree
+    void stop();
+
+    // number of scanner threads (0 = the archiver reads all dirs itself)
+    static int numThreads;
+
+  private:
+    Q_DISABLE_COPY(DirScanner)
+
+    friend class ScanJob;
+    void work(int self);
+
+    // reads the node; uses the given copy of the filters, since the matcher is not thread safe
+    void scan(Node *node, const WildcardMatcher &filters);
+
+    // decide if the dir is excluded or filtered
+    void classify(Node *node, const WildcardMatcher &filters);
+
+    // with the mutex locked
+    void scanned(Node *node, int self);
+    Node *takeWork(int self);
+
+    // with the mutex locked: one subdir of parent is opened or will never be
+    void subdirOpened(Node *parent);
+    void closeDir(Node *node);
+
+    // makes sure no scanner will touch the subtree again and adds up its entries.
+    // Returns false when a scanner still works in it
+    bool detach(Node *node, int &entries);
+
+  private:
+    const PathTrie *excludeTrie;
+    WildcardMatcher dirFilters;
+    QVector<WildcardMatcher> filterCopies;  // one per scanner plus one for the caller
+
+    Node *root;
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QVector< QList<Node *> > queues;  // one per scanner plus one for the caller
+    int pendingEntries;  // scanned but not yet released
+    int openDirs;  // kept open for their subdirs
+    bool stopping;
+
+    QThreadPool pool;
+};
+
+#endif
@@ -0,0 +1,177 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <DirWalker.hxx>
+
+#include <QFile>
+#include <QPair>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <stdint.h>
+
+// the kernel's record format for getdents64
+struct KernelDirent64
+{
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+#endif
+
+//--------------------------------------------------------------------------------
+
+DirWalker::DirWalker()
+  : fd(-1)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+DirWalker::~DirWalker()
+{
+  close();
+}
+
+//--------------------------------------------------------------------------------
+
+bool DirWalker::open(int parentFd, const QString &name)
+{
+  close();
+
+  fd = ::openat(parentFd, QFile::encodeName(name).constData(),
+                O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+  return fd != -1;
+}
+
+//--------------------------------------------------------------------------------
+
+void DirWalker::close()
+{
+  if ( fd != -1 )
+  {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+bool DirWalker::readNames(QList<QByteArray> &names)
+{
+#ifdef Q_OS_LINUX
+  // enough for several hundred names per call.
+  // The kernel pads every record to a multiple of 8 bytes, so all of them are aligned
+  alignas(8) char buffer[32 * 1024];
+
+  while ( true )
+  {
+    long len = ::syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+
+    if ( len == -1 )
+    {
+      if ( errno == EINTR )
+        continue;
+
+      return false;
+    }
+
+    if ( len == 0 )  // end of directory
+      return true;
+
+    for (long pos = 0; pos < len; )
+    {
+      const KernelDirent64 *entry = reinterpret_cast<const KernelDirent64 *>(buffer + pos);
+      pos += entry->d_reclen;
+
+      if ( (strcmp(entry->d_name, ".") != 0) && (strcmp(entry->d_name, "..") != 0) )
+        names.append(QByteArray(entry->d_name));
+    }
+  }
+#else
+  // readdir() closes the fd it gets; we keep ours for openat()
+  int dupFd = ::dup(fd);
+  DIR *dir = (dupFd == -1) ? nullptr : ::fdopendir(dupFd);
+
+  if ( !dir )
+  {
+    if ( dupFd != -1 )
+      ::close(dupFd);
+
+    return false;
+  }
+
+  struct dirent *entry;
+  while ( (errno = 0, entry = ::readdir(dir)) )
+  {
+    if ( (strcmp(entry->d_name, ".") != 0) && (strcmp(entry->d_name, "..") != 0) )
+      names.append(QByteArray(entry->d_name));
+  }
+
+  int err = errno;
+  ::closedir(dir);
+  errno = err;
+
+  return err == 0;
+#endif
+}
+
+//--------------------------------------------------------------------------------
+
+bool DirWalker::readEntries(const QString &dirPath, QVector<FileEntry> &entries)
+{
+  entries.clear();
+
+  QList<QByteArray> names;
+  if ( !readNames(names) )
+    return false;
+
+  // QDir::Name | QDir::IgnoreCase, with the exact name deciding between equal ones
+  QVector< QPair<QString, int> > order;
+  order.reserve(names.count());
+
+  QVector<FileEntry> unsorted(names.count());
+
+  for (int i = 0; i < names.count(); i++)
+  {
+    FileEntry &entry = unsorted[i];
+
+    if ( !entry.statAt(fd, dirPath, names[i]) && (entry.error == ENOENT) )
+      continue;  // deleted meanwhile
+
+    order.append(qMakePair(entry.name.toLower(), i));
+  }
+
+  std::sort(order.begin(), order.end(),
+            [&unsorted](const QPair<QString, int> &left, const QPair<QString, int> &right)
+            {
+              if ( left.first != right.first )
+                return left.first < right.first;
+
+              return unsorted[left.second].name < unsorted[right.second].name;
+            });
+
+  entries.reserve(order.count());
+  for (int i = 0; i < order.count(); i++)
+    entries.append(unsorted[order[i].second]);
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
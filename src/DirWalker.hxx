@@ -0,0 +1,56 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _DIR_WALKER_H_
+#define _DIR_WALKER_H_
+
+// reads one directory with all the metadata of its entries.
+// Subdirectories are opened relative to the open parent directory, names are
+// read in large blocks (getdents64 on Linux) and every entry gets exactly one stat call
+
+#include <QVector>
+#include <QList>
+#include <QByteArray>
+
+#include <FileEntry.hxx>
+
+class DirWalker
+{
+  public:
+    DirWalker();
+    ~DirWalker();
+
+    // opens the directory name inside the already opened directory parentFd,
+    // or an absolute path when parentFd is AT_FDCWD.
+    // Returns false and sets errno on failure
+    bool open(int parentFd, const QString &name);
+    void close();
+
+    int handle() const { return fd; }
+
+    // the caller owns the fd from now on and must close it
+    int takeHandle() { int handle = fd; fd = -1; return handle; }
+
+    // reads all entries of the opened directory with the absolute path dirPath,
+    // sorted by name as QDir sorts them.
+    // Entries which vanished meanwhile are not returned; entries which could not
+    // be stat'ed have their error set.
+    // Returns false and sets errno when the directory itself could not be read
+    bool readEntries(const QString &dirPath, QVector<FileEntry> &entries);
+
+  private:
+    Q_DISABLE_COPY(DirWalker)
+
+    bool readNames(QList<QByteArray> &names);
+
+  private:
+    int fd;
+};
+
+#endif
@@ -0,0 +1,156 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <FileEntry.hxx>
+
+#include <QFile>
+#include <QHash>
+
+#include <sys/sysmacros.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pwd.h>
+#include <grp.h>
+
+//--------------------------------------------------------------------------------
+
+static QHash<uid_t, QString> userNames;
+static QHash<gid_t, QString> groupNames;
+
+//--------------------------------------------------------------------------------
+
+FileEntry::FileEntry()
+  : error(0), mode(0), uid(0), gid(0), size(0), allocated(0), blockSize(0), device(0), inode(0), links(0),
+    atime(0), mtime(0), ctime(0), btime(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+FileEntry::FileEntry(const QString &absolutePath)
+  : path(absolutePath), error(0), mode(0), uid(0), gid(0), size(0), allocated(0), blockSize(0), device(0), inode(0), links(0),
+    atime(0), mtime(0), ctime(0), btime(0)
+{
+  name = path.mid(path.lastIndexOf(QLatin1Char('/')) + 1);
+
+  statAt(AT_FDCWD, QFile::encodeName(path).constData());
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileEntry::statAt(int dirFd, const QString &dirPath, const QByteArray &fileName)
+{
+  name = QFile::decodeName(fileName);
+
+  if ( dirPath.endsWith(QLatin1Char('/')) )
+    path = dirPath + name;
+  else
+    path = dirPath + QLatin1Char('/') + name;
+
+  return statAt(dirFd, fileName.constData());
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileEntry::statAt(int dirFd, const char *fileName)
+{
+#ifdef STATX_BASIC_STATS
+  struct statx status;
+
+  if ( ::statx(dirFd, fileName, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT,
+               STATX_BASIC_STATS | STATX_BTIME, &status) == -1 )
+  {
+    error = errno;
+    return false;
+  }
+
+  mode = status.stx_mode;
+  uid = status.stx_uid;
+  gid = status.stx_gid;
+  size = static_cast<qint64>(status.stx_size);
+  allocated = static_cast<qint64>(status.stx_blocks) * 512;
+  blockSize = status.stx_blksize;
+  device = makedev(status.stx_dev_major, status.stx_dev_minor);
+  inode = status.stx_ino;
+  links = status.stx_nlink;
+
+  atime = status.stx_atime.tv_sec * 1000 + status.stx_atime.tv_nsec / 1000000;
+  mtime = status.stx_mtime.tv_sec * 1000 + status.stx_mtime.tv_nsec / 1000000;
+  ctime = status.stx_ctime.tv_sec * 1000 + status.stx_ctime.tv_nsec / 1000000;
+
+  if ( status.stx_mask & STATX_BTIME )
+    btime = status.stx_btime.tv_sec * 1000 + status.stx_btime.tv_nsec / 1000000;
+  else
+    btime = ctime;
+#else
+  struct stat status;
+
+  if ( ::fstatat(dirFd, fileName, &status, AT_SYMLINK_NOFOLLOW) == -1 )
+  {
+    error = errno;
+    return false;
+  }
+
+  mode = status.st_mode;
+  uid = status.st_uid;
+  gid = status.st_gid;
+  size = status.st_size;
+  allocated = qint64(status.st_blocks) * 512;
+  blockSize = status.st_blksize;
+  device = status.st_dev;
+  inode = status.st_ino;
+  links = status.st_nlink;
+
+  atime = qint64(status.st_atim.tv_sec) * 1000 + status.st_atim.tv_nsec / 1000000;
+  mtime = qint64(status.st_mtim.tv_sec) * 1000 + status.st_mtim.tv_nsec / 1000000;
+  ctime = qint64(status.st_ctim.tv_sec) * 1000 + status.st_ctim.tv_nsec / 1000000;
+  btime = ctime;
+#endif
+
+  error = 0;
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+QString FileEntry::owner() const
+{
+  QHash<uid_t, QString>::const_iterator it = userNames.constFind(uid);
+  if ( it != userNames.constEnd() )
+    return it.value();
+
+  // an unknown id gives an empty name, as QFileInfo::owner() does
+  QString userName;
+  struct passwd *pw = getpwuid(uid);
+  if ( pw )
+    userName = QFile::decodeName(pw->pw_name);
+
+  userNames.insert(uid, userName);
+  return userName;
+}
+
+//--------------------------------------------------------------------------------
+
+QString FileEntry::group() const
+{
+  QHash<gid_t, QString>::const_iterator it = groupNames.constFind(gid);
+  if ( it != groupNames.constEnd() )
+    return it.value();
+
+  QString groupName;
+  struct group *gr = getgrgid(gid);
+  if ( gr )
+    groupName = QFile::decodeName(gr->gr_name);
+
+  groupNames.insert(gid, groupName);
+  return groupName;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,74 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _FILE_ENTRY_H_
+#define _FILE_ENTRY_H_
+
+// a file, dir or symlink found during the backup, together with all the
+// metadata the archiver needs. It's filled with one single stat call and then
+// passed along, so that nothing needs to ask the filesystem again
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+class FileEntry
+{
+  public:
+    FileEntry();
+
+    // get the metadata of the given absolute path (not following a symlink).
+    // On failure, error is set to the errno value
+    explicit FileEntry(const QString &absolutePath);
+
+    // get the metadata of name inside the opened directory dirFd (not following a symlink).
+    // dirPath is the absolute path of that directory.
+    // Returns false and sets error to the errno value on failure
+    bool statAt(int dirFd, const QString &dirPath, const QByteArray &name);
+
+    bool isDir() const { return S_ISDIR(mode); }
+    bool isSymLink() const { return S_ISLNK(mode); }
+
+    QDateTime lastRead() const { return QDateTime::fromMSecsSinceEpoch(atime); }
+    QDateTime lastModified() const { return QDateTime::fromMSecsSinceEpoch(mtime); }
+    QDateTime created() const { return QDateTime::fromMSecsSinceEpoch(btime); }
+
+    // user and group names; looked up only once per id (not thread safe)
+    QString owner() const;
+    QString group() const;
+
+  public:
+    QString path;  // absolute
+    QString name;  // last path component
+    int error;     // errno of a failed stat, else 0
+
+    mode_t mode;
+    uid_t uid;
+    gid_t gid;
+    qint64 size;
+    qint64 allocated;  // bytes on the disk; less than size for a sparse file
+    blksize_t blockSize;
+    dev_t device;
+    ino_t inode;
+    nlink_t links;
+
+    // msecs since the epoch; btime is the birth time if the filesystem knows it, else ctime
+    qint64 atime;
+    qint64 mtime;
+    qint64 ctime;
+    qint64 btime;
+
+  private:
+    bool statAt(int dirFd, const char *name);
+};
+
+#endif
@@ -0,0 +1,392 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <FileIndex.hxx>
+#include <FileEntry.hxx>
+#include <ContentHash.hxx>
+
+#include <QFileInfo>
+#include <QByteArray>
+
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+//--------------------------------------------------------------------------------
+
+struct IndexHeader
+{
+  char magic[8];
+  quint64 count;
+  quint64 pathsOffset;
+  quint64 pathsSize;
+};
+
+static const char INDEX_MAGIC[8] = { 'K', 'B', 'F', 'I', 'D', 'X', '0', '1' };
+
+//--------------------------------------------------------------------------------
+
+static bool keyLess(const FileIndex::Record &left, const FileIndex::Record &right)
+{
+  if ( left.device != right.device )
+    return left.device < right.device;
+
+  if ( left.inode != right.inode )
+    return left.inode < right.inode;
+
+  return left.pathHash < right.pathHash;
+}
+
+//--------------------------------------------------------------------------------
+
+FileIndex::FileIndex()
+  : map(nullptr), mapSize(0), records(nullptr), count(0), paths(nullptr), pathsSize(0), newPathsSize(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+FileIndex::~FileIndex()
+{
+  discardWriting();
+  close();
+}
+
+//--------------------------------------------------------------------------------
+
+QString FileIndex::fileNameForProfile(const QString &profile)
+{
+  QFileInfo info(profile);
+  return info.absolutePath() + QLatin1Char('/') + info.completeBaseName() + QStringLiteral(".idx");
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileIndex::open(const QString &fileName)
+{
+  close();
+  error = QString();
+
+  int fd = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+  if ( fd == -1 )
+  {
+    if ( errno != ENOENT )  // no index yet is no error
+      error = QString::fromLocal8Bit(strerror(errno));
+
+    return false;
+  }
+
+  struct stat status;
+  if ( (::fstat(fd, &status) == -1) || (status.st_size < static_cast<off_t>(sizeof(IndexHeader))) )
+  {
+    ::close(fd);
+    error = QStringLiteral("invalid index file");
+    return false;
+  }
+
+  void *addr = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if ( addr == MAP_FAILED )
+  {
+    error = QString::fromLocal8Bit(strerror(errno));
+    return false;
+  }
+
+  map = static_cast<uchar *>(addr);
+  mapSize = status.st_size;
+
+  const IndexHeader *header = reinterpret_cast<const IndexHeader *>(map);
+  const quint64 recordsEnd = sizeof(IndexHeader) + header->count * sizeof(Record);
+
+  if ( (memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0) ||
+       (header->count > static_cast<quint64>(mapSize) / sizeof(Record)) ||
+       (header->pathsOffset < recordsEnd) ||
+       (header->pathsOffset + header->pathsSize > static_cast<quint64>(mapSize)) )
+  {
+    close();
+    error = QStringLiteral("invalid index file");
+    return false;
+  }
+
+  // lookups jump around in the file; don't read ahead
+  ::madvise(map, mapSize, MADV_RANDOM);
+
+  count = header->count;
+  records = reinterpret_cast<const Record *>(map + sizeof(IndexHeader));
+  paths = reinterpret_cast<const char *>(map + header->pathsOffset);
+  pathsSize = header->pathsSize;
+  seen.fill(false, static_cast<int>(count));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndex::close()
+{
+  if ( map )
+    ::munmap(map, mapSize);
+
+  map = nullptr;
+  mapSize = 0;
+  records = nullptr;
+  count = 0;
+  paths = nullptr;
+  pathsSize = 0;
+  seen.clear();
+}
+
+//--------------------------------------------------------------------------------
+
+quint64 FileIndex::hashPath(const QString &path)
+{
+  // FNV-1a; qHash() is seeded differently in every process
+  quint64 hash = Q_UINT64_C(14695981039346656037);
+
+  const QChar *data = path.constData();
+  for (int i = 0; i < path.length(); i++)
+  {
+    hash ^= data[i].unicode();
+    hash *= Q_UINT64_C(1099511628211);
+  }
+
+  return hash;
+}
+
+//--------------------------------------------------------------------------------
+
+QString FileIndex::pathAt(qint64 pos) const
+{
+  const Record &rec = records[pos];
+
+  if ( rec.pathOffset + rec.pathLength > pathsSize )
+    return QString();
+
+  return QString::fromUtf8(paths + rec.pathOffset, rec.pathLength);
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 FileIndex::find(const FileEntry &entry) const
+{
+  if ( !records )
+    return -1;
+
+  Record key;
+  key.device = entry.device;
+  key.inode = entry.inode;
+  key.pathHash = hashPath(entry.path);
+
+  const Record *end = records + count;
+  const Record *it = std::lower_bound(records, end, key, keyLess);
+
+  // the same inode under another name is a hard link or a reused inode
+  for (; (it != end) && !keyLess(key, *it); ++it)
+  {
+    if ( pathAt(it - records) == entry.path )
+      return it - records;
+  }
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileIndex::isUnchanged(qint64 pos, const FileEntry &entry) const
+{
+  const Record &rec = records[pos];
+
+  // ctime also catches files which were restored or copied with their old mtime
+  return (rec.size == entry.size) && (rec.mtime == entry.mtime) && (rec.ctime == entry.ctime);
+}
+
+//--------------------------------------------------------------------------------
+
+quint64 FileIndex::contentHash(qint64 pos) const
+{
+  const Record &rec = records[pos];
+
+  return (rec.flags == static_cast<quint32>(ContentHash::algorithm())) ? rec.hash : 0;
+}
+
+//--------------------------------------------------------------------------------
+
+QStringList FileIndex::unseenPaths() const
+{
+  QStringList list;
+
+  for (quint64 i = 0; i < count; i++)
+    if ( !seen.testBit(static_cast<int>(i)) )
+      list.append(pathAt(i));
+
+  list.sort();
+  return list;
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileIndex::startWriting(const QString &fileName)
+{
+  discardWriting();
+  error = QString();
+
+  newName = fileName;
+  newRecords.setFileName(fileName + QStringLiteral(".new"));
+  newPaths.setFileName(fileName + QStringLiteral(".paths"));
+  newPathsSize = 0;
+
+  // ReadWrite, as the records are sorted in a mapping of the file
+  if ( !newRecords.open(QIODevice::ReadWrite | QIODevice::Truncate) ||
+       !newPaths.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+  {
+    error = newRecords.isOpen() ? newPaths.errorString() : newRecords.errorString();
+    discardWriting();
+    return false;
+  }
+
+  // the header is written when we know the sizes
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  newRecords.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndex::add(const FileEntry &entry, quint64 contentHash)
+{
+  if ( !newRecords.isOpen() )
+    return;
+
+  const QByteArray path = entry.path.toUtf8();
+
+  Record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.device = entry.device;
+  rec.inode = entry.inode;
+  rec.pathHash = hashPath(entry.path);
+  rec.size = entry.size;
+  rec.mtime = entry.mtime;
+  rec.ctime = entry.ctime;
+  rec.hash = contentHash;
+  rec.flags = contentHash ? ContentHash::algorithm() : ContentHash::None;
+  rec.pathOffset = newPathsSize;
+  rec.pathLength = path.size();
+
+  newRecords.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+  newPaths.write(path);
+  newPathsSize += path.size();
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileIndex::finishWriting()
+{
+  if ( !newRecords.isOpen() )
+    return false;
+
+  if ( !newRecords.flush() || !newPaths.flush() ||
+       (newRecords.error() != QFile::NoError) || (newPaths.error() != QFile::NoError) )
+  {
+    error = (newRecords.error() != QFile::NoError) ? newRecords.errorString() : newPaths.errorString();
+    discardWriting();
+    return false;
+  }
+
+  const qint64 recordsEnd = newRecords.size();
+  const quint64 num = (recordsEnd - sizeof(IndexHeader)) / sizeof(Record);
+
+  // sort inside the page cache, so that millions of entries need not fit into memory
+  if ( num )
+  {
+    void *addr = ::mmap(nullptr, recordsEnd, PROT_READ | PROT_WRITE, MAP_SHARED, newRecords.handle(), 0);
+    if ( addr == MAP_FAILED )
+    {
+      error = QString::fromLocal8Bit(strerror(errno));
+      discardWriting();
+      return false;
+    }
+
+    Record *sorted = reinterpret_cast<Record *>(static_cast<uchar *>(addr) + sizeof(IndexHeader));
+    std::sort(sorted, sorted + num, keyLess);
+    ::munmap(addr, recordsEnd);
+  }
+
+  // append the paths
+  newPaths.close();
+  if ( !newPaths.open(QIODevice::ReadOnly) || !newRecords.seek(recordsEnd) )
+  {
+    error = newPaths.errorString();
+    discardWriting();
+    return false;
+  }
+
+  while ( !newPaths.atEnd() )
+  {
+    const QByteArray data = newPaths.read(1024 * 1024);
+    if ( data.isEmpty() || (newRecords.write(data) != data.size()) )
+      break;
+  }
+
+  IndexHeader header;
+  memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.count = num;
+  header.pathsOffset = recordsEnd;
+  header.pathsSize = newPathsSize;
+
+  newRecords.seek(0);
+  newRecords.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  if ( !newRecords.flush() || (newRecords.error() != QFile::NoError) ||
+       (newRecords.size() != static_cast<qint64>(recordsEnd + newPathsSize)) )
+  {
+    error = newRecords.errorString();
+    discardWriting();
+    return false;
+  }
+
+  newRecords.close();
+  newPaths.remove();
+
+  close();  // the last index is replaced now
+
+  if ( ::rename(QFile::encodeName(newRecords.fileName()).constData(),
+                QFile::encodeName(newName).constData()) == -1 )
+  {
+    error = QString::fromLocal8Bit(strerror(errno));
+    newRecords.remove();
+    return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void FileIndex::discardWriting()
+{
+  if ( newRecords.isOpen() )
+    newRecords.remove();
+
+  if ( newPaths.isOpen() || newPaths.exists() )
+    newPaths.remove();
+
+  newPathsSize = 0;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,108 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _FILE_INDEX_H_
+#define _FILE_INDEX_H_
+
+// the state of every file stored by the last backup of a profile, kept in a file next to it.
+// The index of the last backup is memory mapped and only read; the index of the
+// running backup is written to a new file which replaces the old one when the backup
+// finished.
+//
+// File layout (host byte order, the index is never moved to another machine):
+//   Header
+//   Record[count]  sorted by device, inode, pathHash
+//   UTF-8 paths    referenced by the records
+
+#include <QString>
+#include <QFile>
+#include <QBitArray>
+#include <QStringList>
+
+class FileEntry;
+
+class FileIndex
+{
+  public:
+    struct Record
+    {
+      quint64 device;
+      quint64 inode;
+      quint64 pathHash;
+      qint64 size;
+      qint64 mtime;  // msecs since epoch
+      qint64 ctime;
+      quint64 hash;  // of the content; 0 = not known
+      quint64 pathOffset;
+      quint32 pathLength;
+      quint32 flags;  // the ContentHash::Algorithm of hash
+    };
+
+    FileIndex();
+    ~FileIndex();
+
+    // maps the index of the last backup. Returns false if there is none or it is unusable
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return records != nullptr; }
+
+    // the position of the entry in the last index or -1 if it was not there
+    qint64 find(const FileEntry &entry) const;
+    const Record &record(qint64 pos) const { return records[pos]; }
+
+    // true when size, mtime and ctime are still the same
+    bool isUnchanged(qint64 pos, const FileEntry &entry) const;
+
+    // the content hash of the record if it was made with the ContentHash we use, else 0
+    quint64 contentHash(qint64 pos) const;
+
+    // remember the entry is still in the backup; the others were removed since the last one
+    void markSeen(qint64 pos) { seen.setBit(pos); }
+    QStringList unseenPaths() const;
+
+    // the index of the running backup
+    bool startWriting(const QString &fileName);
+    void add(const FileEntry &entry, quint64 contentHash = 0);
+
+    // sorts the new index and replaces the last one with it
+    bool finishWriting();
+    void discardWriting();
+
+    QString errorString() const { return error; }
+
+    static QString fileNameForProfile(const QString &profile);
+
+    // the same in every process, so it can be stored
+    static quint64 hashPath(const QString &path);
+
+  private:
+    Q_DISABLE_COPY(FileIndex)
+
+    QString pathAt(qint64 pos) const;
+
+  private:
+    // last index
+    uchar *map;
+    qint64 mapSize;
+    const Record *records;
+    quint64 count;
+    const char *paths;
+    quint64 pathsSize;
+    QBitArray seen;
+
+    // new index
+    QString newName;
+    QFile newRecords;
+    QFile newPaths;
+    quint64 newPathsSize;
+
+    QString error;
+};
+
+#endif
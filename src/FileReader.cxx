@@ -0,0 +1,205 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <FileReader.hxx>
+#include <IoBuffer.hxx>
+
+#include <QMutexLocker>
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+
+qint64 FileReader::maxInFlight = 32 * 1024 * 1024;
+
+//--------------------------------------------------------------------------------
+
+FileReader::FileReader()
+  : chunkSize(0), fd(-1), offset(0), remaining(0),
+    head(0), tail(0), filled(0), holding(false), eof(false), error(0), stopRequested(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+FileReader::~FileReader()
+{
+  stopReading();
+  qDeleteAll(slots);
+}
+
+//--------------------------------------------------------------------------------
+
+bool FileReader::startReading(int fileDescriptor, qint64 size, qint64 chunk)
+{
+  // at least 2 buffers, so that reading and writing overlap
+  int num = qMax(2, static_cast<int>(maxInFlight / chunk));
+
+  if ( (num != slots.count()) || (chunk != chunkSize) )
+  {
+    qDeleteAll(slots);
+    slots.clear();
+    lengths.fill(0, num);
+    chunkSize = chunk;
+
+    for (int i = 0; i < num; i++)
+    {
+      slots.append(new IoBuffer(chunkSize));
+
+      if ( slots.last()->size() != chunkSize )  // out of memory
+      {
+        qDeleteAll(slots);
+        slots.clear();
+        return false;
+      }
+    }
+  }
+
+  fd = fileDescriptor;
+  offset = 0;
+  remaining = size;
+  head = tail = filled = 0;
+  holding = eof = stopRequested = false;
+  error = 0;
+
+  start();
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+void FileReader::stopReading()
+{
+  {
+    QMutexLocker locker(&mutex);
+    stopRequested = true;
+    slotFree.wakeAll();
+  }
+
+  wait();
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 FileReader::nextChunk(char *&data, unsigned long msecs)
+{
+  QMutexLocker locker(&mutex);
+
+  if ( holding )  // the previous chunk is written, give it back to the reader
+  {
+    head = (head + 1) % slots.count();
+    filled--;
+    holding = false;
+    slotFree.wakeAll();
+  }
+
+  if ( (filled == 0) && !eof && !error )
+    dataReady.wait(&mutex, msecs);
+
+  if ( filled > 0 )
+  {
+    data = slots[head]->data();
+    holding = true;
+    return lengths[head];
+  }
+
+  if ( error )
+    return Failed;
+
+  return eof ? 0 : Pending;
+}
+
+//--------------------------------------------------------------------------------
+
+QString FileReader::errorString() const
+{
+  QMutexLocker locker(&mutex);
+  return QString::fromLocal8Bit(strerror(error));
+}
+
+//--------------------------------------------------------------------------------
+
+void FileReader::run()
+{
+  while ( true )
+  {
+    int slot;
+    {
+      QMutexLocker locker(&mutex);
+
+      while ( (filled == slots.count()) && !stopRequested )
+        slotFree.wait(&mutex);
+
+      if ( stopRequested )
+        return;
+
+      slot = tail;
+    }
+
+    // the slot is ours until it's counted as filled
+    char *data = slots[slot]->data();
+    qint64 want = qMin(chunkSize, remaining);
+    qint64 len = 0;
+    int err = 0;
+
+    // always ask for a whole chunk (a file never continues beyond its end),
+    // so that every read is aligned as O_DIRECT needs it
+    while ( len < want )
+    {
+      ssize_t ret = ::pread(fd, data + len, static_cast<size_t>(chunkSize - len), offset + len);
+
+      if ( ret < 0 )
+      {
+        if ( errno == EINTR )
+          continue;
+
+        err = errno;
+        break;
+      }
+
+      if ( ret == 0 )  // the file was truncated meanwhile
+        break;
+
+      len += ret;
+    }
+
+    len = qMin(len, want);  // the file may have grown meanwhile
+
+    QMutexLocker locker(&mutex);
+
+    if ( err )
+    {
+      error = err;
+      dataReady.wakeAll();
+      return;
+    }
+
+    if ( len > 0 )
+    {
+      lengths[slot] = len;
+      tail = (tail + 1) % slots.count();
+      filled++;
+      offset += len;
+      remaining -= len;
+    }
+
+    // we never read more than the size stored in the tar header
+    if ( (len < want) || (remaining == 0) )
+      eof = true;
+
+    dataReady.wakeAll();
+
+    if ( eof )
+      return;
+  }
+}
+
+//--------------------------------------------------------------------------------
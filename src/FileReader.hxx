@@ -0,0 +1,75 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _FILE_READER_H_
+#define _FILE_READER_H_
+
+// reads a file in its own thread ahead into a ring of buffers, so that reading
+// the source file and writing the archive overlap
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QVector>
+#include <QString>
+
+class IoBuffer;
+
+class FileReader : public QThread
+{
+  Q_OBJECT
+
+  public:
+    FileReader();
+    ~FileReader() override;
+
+    // start reading size bytes from fd (which must stay open until stopReading())
+    // in chunks of chunkSize. Returns false if the buffers could not be allocated
+    bool startReading(int fd, qint64 size, qint64 chunkSize);
+
+    // stops the thread and waits for it
+    void stopReading();
+
+    enum { Failed = -1, Pending = -2 };
+
+    // gives the next chunk of the file and returns its length, 0 at the end of the file,
+    // Failed on a read error or Pending if no data arrived within msecs.
+    // The chunk stays valid until the next call
+    qint64 nextChunk(char *&data, unsigned long msecs);
+
+    QString errorString() const;
+
+    // the limit of bytes read ahead but not yet taken by nextChunk()
+    static qint64 maxInFlight;
+
+  protected:
+    void run() override;
+
+  private:
+    QVector<IoBuffer *> slots;
+    QVector<qint64> lengths;
+    qint64 chunkSize;
+
+    int fd;
+    qint64 offset;
+    qint64 remaining;
+
+    mutable QMutex mutex;
+    QWaitCondition dataReady;
+    QWaitCondition slotFree;
+    int head;      // next slot for the consumer
+    int tail;      // next slot for the reader thread
+    int filled;
+    bool holding;  // the consumer still uses the head slot
+    bool eof;
+    int error;     // errno of a failed read
+    bool stopRequested;
+};
+
+#endif
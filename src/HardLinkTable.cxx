@@ -0,0 +1,105 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <HardLinkTable.hxx>
+#include <FileEntry.hxx>
+
+//--------------------------------------------------------------------------------
+
+uint qHash(const HardLinkTable::Key &key, uint seed)
+{
+  return qHash(static_cast<quint64>(key.inode), seed) ^ static_cast<uint>(key.device);
+}
+
+//--------------------------------------------------------------------------------
+
+HardLinkTable::Key HardLinkTable::keyOf(const FileEntry &entry)
+{
+  Key key;
+  key.device = entry.device;
+  key.inode = entry.inode;
+  return key;
+}
+
+//--------------------------------------------------------------------------------
+
+QString HardLinkTable::linkTarget(const FileEntry &entry, const QString &name, int slice, int &targetSlice)
+{
+  QHash<Key, Link>::iterator it = links.find(keyOf(entry));
+
+  if ( it == links.end() )
+  {
+    Link link;
+    link.name = name.toUtf8();
+    link.remaining = entry.links - 1;
+    link.slice = PENDING;
+
+    links.insert(keyOf(entry), link);
+    return QString();
+  }
+
+  QString target;
+
+  if ( (it->slice == PENDING) || (it->slice == slice) )
+  {
+    target = QString::fromUtf8(it->name);
+    targetSlice = it->slice;
+  }
+
+  // all names seen; a link created during the backup is stored in full again
+  if ( --it->remaining == 0 )
+    links.erase(it);
+  else if ( target.isEmpty() )
+  {
+    // the caller stores this name in full; the names still to come link to it
+    it->name = name.toUtf8();
+    it->slice = PENDING;
+  }
+
+  return target;
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTable::retarget(const FileEntry &entry, const QString &name)
+{
+  QHash<Key, Link>::iterator it = links.find(keyOf(entry));
+
+  if ( it == links.end() )
+    return;
+
+  it->name = name.toUtf8();
+  it->slice = PENDING;
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTable::stored(const FileEntry &entry, const QString &name, int slice)
+{
+  QHash<Key, Link>::iterator it = links.find(keyOf(entry));
+
+  if ( it == links.end() )
+    return;
+
+  it->name = name.toUtf8();
+  it->slice = slice;
+}
+
+//--------------------------------------------------------------------------------
+
+void HardLinkTable::failed(const FileEntry &entry)
+{
+  QHash<Key, Link>::iterator it = links.find(keyOf(entry));
+
+  // keep counting the names, so that the entry is still dropped after the last one
+  if ( it != links.end() )
+    it->slice = NO_TARGET;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,82 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _HARD_LINK_TABLE_H_
+#define _HARD_LINK_TABLE_H_
+
+// remembers the archive member of every file with more than one link, so that the
+// other names of the inode are stored as tar hard links instead of another copy.
+// An inode is dropped as soon as all of its links were seen, so the table only holds
+// the inodes with links still to come
+
+#include <QHash>
+#include <QByteArray>
+#include <QString>
+
+#include <sys/types.h>
+
+class FileEntry;
+
+class HardLinkTable
+{
+  public:
+    HardLinkTable() { }
+
+    // slice of a member which is queued, but not written yet
+    static const int PENDING = -1;
+
+    // the member name to link the entry to, if its inode was archived into the given
+    // slice (or is still pending); targetSlice is that member's slice.
+    // Else an empty string is returned and the entry's content has to be stored as
+    // member name, which becomes the PENDING target of the names still to come.
+    // A link into another slice could not be extracted from that slice alone
+    QString linkTarget(const FileEntry &entry, const QString &name, int slice, int &targetSlice);
+
+    // a name which got a link target is stored in full after all (the target failed,
+    // moved into another slice or the link did not fit); it becomes the PENDING target
+    void retarget(const FileEntry &entry, const QString &name);
+
+    // the content of entry was written as member name into the given slice;
+    // does nothing when all names of the inode were seen already
+    void stored(const FileEntry &entry, const QString &name, int slice);
+
+    // the content of the target could not be archived; the next name is stored in full
+    void failed(const FileEntry &entry);
+
+    void clear() { links.clear(); }
+
+  private:
+    Q_DISABLE_COPY(HardLinkTable)
+
+    // the content of the last target could not be archived
+    static const int NO_TARGET = -2;
+
+    struct Key
+    {
+      dev_t device;
+      ino_t inode;
+
+      bool operator==(const Key &other) const { return (device == other.device) && (inode == other.inode); }
+    };
+
+    friend uint qHash(const Key &key, uint seed);
+
+    struct Link
+    {
+      QByteArray name;  // UTF-8, to keep the table small
+      nlink_t remaining;  // links not seen yet
+      int slice;  // holding the member's header, PENDING or NO_TARGET
+    };
+
+    static Key keyOf(const FileEntry &entry);
+
+    QHash<Key, Link> links;
+};
+
+#endif
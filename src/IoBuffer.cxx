@@ -0,0 +1,67 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <IoBuffer.hxx>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------
+
+qint64 IoBuffer::defaultSize = 4 * 1024 * 1024;
+
+//--------------------------------------------------------------------------------
+
+IoBuffer::IoBuffer(qint64 size)
+  : buffer(nullptr), bufferSize(0)
+{
+  if ( size > 0 )
+    resize(size);
+}
+
+//--------------------------------------------------------------------------------
+
+IoBuffer::~IoBuffer()
+{
+  free(buffer);
+}
+
+//--------------------------------------------------------------------------------
+
+bool IoBuffer::resize(qint64 size)
+{
+  if ( size == bufferSize )
+    return true;
+
+  free(buffer);
+  buffer = nullptr;
+  bufferSize = 0;
+
+  void *mem = nullptr;
+  if ( posix_memalign(&mem, static_cast<size_t>(sysconf(_SC_PAGESIZE)), static_cast<size_t>(size)) != 0 )
+    return false;
+
+  buffer = static_cast<char *>(mem);
+  bufferSize = size;
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 IoBuffer::sizeFor(blksize_t blockSize)
+{
+  if ( blockSize <= 0 )
+    return defaultSize;
+
+  // a multiple of the device's block size, so that every read/write covers whole blocks
+  qint64 blocks = qMax(Q_INT64_C(1), (defaultSize + blockSize - 1) / blockSize);
+  return blocks * blockSize;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,45 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _IO_BUFFER_H_
+#define _IO_BUFFER_H_
+
+// a page aligned buffer for reading and writing file content.
+// Every pipeline (the archive writer, each compression worker) has its own
+
+#include <QtGlobal>
+
+#include <sys/types.h>
+
+class IoBuffer
+{
+  public:
+    explicit IoBuffer(qint64 size = 0);
+    ~IoBuffer();
+
+    // (re)allocates the buffer when the size changes; the content is not kept
+    bool resize(qint64 size);
+
+    char *data() { return buffer; }
+    qint64 size() const { return bufferSize; }
+
+    // the buffer size to use for a device with the given preferred block size (st_blksize)
+    static qint64 sizeFor(blksize_t blockSize);
+
+    // the buffer size used when the device does not ask for more
+    static qint64 defaultSize;
+
+  private:
+    Q_DISABLE_COPY(IoBuffer)
+
+    char *buffer;
+    qint64 bufferSize;
+};
+
+#endif
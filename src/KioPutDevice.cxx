@@ -0,0 +1,174 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <KioPutDevice.hxx>
+
+#include <kio/transferjob.h>
+#include <KLocalizedString>
+
+#include <QCoreApplication>
+
+//--------------------------------------------------------------------------------
+
+// the data handed to the job at once; more than this waiting lets write() block
+static const int CHUNK_SIZE = 1024 * 1024;
+static const int MAX_BUFFERED = 4 * CHUNK_SIZE;
+
+//--------------------------------------------------------------------------------
+
+KioPutDevice::KioPutDevice(const QUrl &theUrl)
+  : url(theUrl), dataWanted(false), jobFailed(false), written(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+KioPutDevice::~KioPutDevice()
+{
+  abort();
+
+  if ( isOpen() )
+    QIODevice::close();
+}
+
+//--------------------------------------------------------------------------------
+
+bool KioPutDevice::open(OpenMode mode)
+{
+  if ( (mode & ReadOnly) || isOpen() )
+    return false;
+
+  buffer.clear();
+  dataWanted = false;
+  jobFailed = false;
+  written = 0;
+
+  job = KIO::put(url, -1, KIO::HideProgressInfo);
+
+  // data is sent when we have it, not when the job asks
+  job->setAsyncDataEnabled(true);
+
+  connect(job, SIGNAL(dataReq(KIO::Job *, QByteArray &)), this, SLOT(slotDataReq(KIO::Job *, QByteArray &)));
+  connect(job, SIGNAL(result(KJob *)), this, SLOT(slotResult(KJob *)));
+
+  return QIODevice::open(mode | Unbuffered);
+}
+
+//--------------------------------------------------------------------------------
+
+void KioPutDevice::close()
+{
+  if ( !isOpen() )
+    return;
+
+  // the rest of the data, then an empty block as the end of the file
+  while ( job && !buffer.isEmpty() )
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+  while ( job && !dataWanted )
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+  if ( job )
+    job->sendAsyncData(QByteArray());
+
+  dataWanted = false;
+
+  while ( job )
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+  QIODevice::close();
+}
+
+//--------------------------------------------------------------------------------
+
+void KioPutDevice::abort()
+{
+  // the device stays open, as a write() may be waiting for the job further up the stack.
+  // It and all further writes fail
+  if ( job )
+  {
+    job->kill();
+    job = nullptr;
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 KioPutDevice::readData(char *data, qint64 maxSize)
+{
+  Q_UNUSED(data)
+  Q_UNUSED(maxSize)
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 KioPutDevice::writeData(const char *data, qint64 maxSize)
+{
+  if ( !job )
+  {
+    if ( !jobFailed )
+      setErrorString(i18n("The upload has ended"));
+
+    return -1;
+  }
+
+  buffer.append(data, static_cast<int>(maxSize));
+  written += maxSize;
+
+  if ( dataWanted )
+    send();
+
+  // flow control: the job takes the data only as fast as the target can store it
+  while ( job && (buffer.size() > MAX_BUFFERED) )
+    QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+
+  return job ? maxSize : -1;
+}
+
+//--------------------------------------------------------------------------------
+
+void KioPutDevice::send()
+{
+  const QByteArray chunk = buffer.left(CHUNK_SIZE);
+  buffer.remove(0, chunk.size());
+
+  dataWanted = false;
+  job->sendAsyncData(chunk);
+}
+
+//--------------------------------------------------------------------------------
+
+void KioPutDevice::slotDataReq(KIO::Job *theJob, QByteArray &data)
+{
+  Q_UNUSED(theJob)
+  Q_UNUSED(data)  // not used in the async mode
+
+  dataWanted = true;
+
+  // an empty chunk would end the file; close() sends it
+  if ( !buffer.isEmpty() )
+    send();
+}
+
+//--------------------------------------------------------------------------------
+
+void KioPutDevice::slotResult(KJob *theJob)
+{
+  job = nullptr;
+
+  if ( theJob->error() )
+  {
+    jobFailed = true;
+    setErrorString(theJob->errorString());
+  }
+}
+
+//--------------------------------------------------------------------------------
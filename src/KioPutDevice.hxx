@@ -0,0 +1,70 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _KIO_PUT_DEVICE_H_
+#define _KIO_PUT_DEVICE_H_
+
+// a write only device which streams everything written to it into a KIO::put job,
+// so that a slice goes to a remote target without a temporary file.
+// The job asks for the data it can take; while more than a few buffers are
+// waiting for it, write() processes events until the job wants more
+
+#include <QIODevice>
+#include <QPointer>
+#include <QUrl>
+
+class KJob;
+namespace KIO { class Job; class TransferJob; }
+
+class KioPutDevice : public QIODevice
+{
+  Q_OBJECT
+
+  public:
+    explicit KioPutDevice(const QUrl &url);
+    ~KioPutDevice() override;
+
+    bool open(OpenMode mode) override;
+
+    // sends the rest of the data and waits until the job has finished.
+    // Check failed() afterwards
+    void close() override;
+
+    // stop the job; the remote file stays incomplete.
+    // Safe to call while write() or close() wait for the job
+    void abort();
+
+    bool isSequential() const override { return true; }
+
+    // the bytes written so far
+    qint64 pos() const override { return written; }
+
+    bool failed() const { return jobFailed; }
+
+  protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+  private Q_SLOTS:
+    void slotDataReq(KIO::Job *job, QByteArray &data);
+    void slotResult(KJob *job);
+
+  private:
+    void send();
+
+  private:
+    QUrl url;
+    QPointer<KIO::TransferJob> job;
+    QByteArray buffer;  // not yet taken by the job
+    bool dataWanted;  // the job waits for data
+    bool jobFailed;
+    qint64 written;
+};
+
+#endif
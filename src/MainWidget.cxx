@@ -47,6 +47,7 @@ MainWidget::MainWidget(QWidget *parent)
 
   connect(Archiver::instance, SIGNAL(fileProgress(int)), this, SLOT(setFileProgress(int)));
   connect(Archiver::instance, SIGNAL(elapsedChanged(const QTime &)), this, SLOT(updateElapsed(const QTime &)));
+  connect(Archiver::instance, SIGNAL(remainingChanged(int, int)), this, SLOT(updateRemaining(int, int)));
 
   connect(Archiver::instance, SIGNAL(backupTypeChanged(bool)), this, SLOT(setIsIncrementalBackup(bool)));
 
@@ -123,6 +124,28 @@ void MainWidget::updateElapsed(const QTime &elapsed)
 
 //--------------------------------------------------------------------------------
 
+void MainWidget::updateRemaining(int percent, int seconds)
+{
+  if ( percent == -1 )
+  {
+    ui.remainingTime->setText(QStringLiteral("--:--:--"));
+    return;
+  }
+
+  QString time = QStringLiteral("--:--:--");
+
+  // QTime can't hold more than a day
+  if ( seconds >= 0 )
+  {
+    time = QStringLiteral("%1:%2:%3")
+             .arg(seconds / 3600, 2, 10, QLatin1Char('0'))
+             .arg((seconds / 60) % 60, 2, 10, QLatin1Char('0'))
+             .arg(seconds % 60, 2, 10, QLatin1Char('0'));
+  }
+
+  ui.remainingTime->setText(i18n("%1 (%2%)", time, percent));
+}
+
 void MainWidget::setTargetURL(const QString &url)
 {
   ui.targetDir->setText(url);
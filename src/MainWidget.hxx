@@ -39,6 +39,7 @@ class MainWidget : public QWidget
   private Q_SLOTS:
     void getMediaSize();
     void updateElapsed(const QTime &);
+    void updateRemaining(int percent, int seconds);
     void updateTotalBytes();
     void setFileProgress(int percent);
     void setCapacity(KIO::filesize_t bytes);
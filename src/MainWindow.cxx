@@ -294,7 +294,15 @@ void MainWindow::profileSettings()
   dialog.setMaxMB(Archiver::instance->getMaxSliceMBs());
   dialog.ui.numBackups->setValue(Archiver::instance->getKeptBackups());
   dialog.ui.mediaNeedsChange->setChecked(Archiver::instance->getMediaNeedsChange());
-  dialog.ui.compressFiles->setChecked(Archiver::instance->getCompressFiles());
+  dialog.ui.compressMode->setCurrentIndex(Archiver::instance->getCompressMode());
+  dialog.setCodec(Archiver::instance->getCompressCodec());
+  dialog.ui.compressLevel->setValue(Archiver::instance->getCompressLevel());
+  dialog.ui.compressWorkers->setValue(Archiver::instance->getCompressWorkers());
+  dialog.ui.cacheMode->setCurrentIndex(Archiver::instance->getCacheMode());
+  dialog.ui.preScan->setChecked(Archiver::instance->getPreScan());
+  dialog.ui.chunkStore->setChecked(Archiver::instance->getTargetFormat() == Archiver::ChunkRepository);
+  dialog.ui.hashContent->setChecked(Archiver::instance->getHashContent());
+  dialog.ui.streamUpload->setChecked(Archiver::instance->getStreamUpload());
   dialog.ui.fullBackupInterval->setValue(Archiver::instance->getFullBackupInterval());
   dialog.ui.filter->setText(Archiver::instance->getFilter());
   dialog.ui.dirFilter->setPlainText(Archiver::instance->getDirFilter());
@@ -305,7 +313,15 @@ void MainWindow::profileSettings()
     Archiver::instance->setMaxSliceMBs(dialog.ui.maxSliceSize->value());
     Archiver::instance->setKeptBackups(dialog.ui.numBackups->value());
     Archiver::instance->setMediaNeedsChange(dialog.ui.mediaNeedsChange->isChecked());
-    Archiver::instance->setCompressFiles(dialog.ui.compressFiles->isChecked());
+    Archiver::instance->setCompressMode(static_cast<Archiver::CompressMode>(dialog.ui.compressMode->currentIndex()));
+    Archiver::instance->setCompressCodec(dialog.getCodec());
+    Archiver::instance->setCompressLevel(dialog.ui.compressLevel->value());
+    Archiver::instance->setCompressWorkers(dialog.ui.compressWorkers->value());
+    Archiver::instance->setCacheMode(static_cast<PageCache::Mode>(dialog.ui.cacheMode->currentIndex()));
+    Archiver::instance->setPreScan(dialog.ui.preScan->isChecked());
+    Archiver::instance->setTargetFormat(dialog.ui.chunkStore->isChecked() ? Archiver::ChunkRepository : Archiver::TarSlices);
+    Archiver::instance->setHashContent(dialog.ui.hashContent->isChecked());
+    Archiver::instance->setStreamUpload(dialog.ui.streamUpload->isChecked());
     Archiver::instance->setFullBackupInterval(dialog.ui.fullBackupInterval->value());
     Archiver::instance->setFilter(dialog.ui.filter->text());
     Archiver::instance->setDirFilter(dialog.ui.dirFilter->toPlainText());
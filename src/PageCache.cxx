@@ -0,0 +1,180 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <PageCache.hxx>
+
+#include <QFile>
+#include <QByteArray>
+#include <QVector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+//--------------------------------------------------------------------------------
+
+// written data is flushed in steps of this size; the cache then holds at most 2 steps
+const qint64 WRITE_STEP = 16 * 1024 * 1024;
+
+// the part of a file we check at once for cached pages
+const qint64 CHECK_WINDOW = 1024 * 1024 * 1024;
+
+//--------------------------------------------------------------------------------
+
+PageCache::PageCache()
+  : fd(-1), dropReads(false), direct(false), syncedPos(0), droppedPos(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+void PageCache::startReading(int fileDescriptor, Mode mode)
+{
+  fd = -1;
+  dropReads = direct = false;
+
+  if ( mode == Normal )
+    return;
+
+  fd = fileDescriptor;
+
+  if ( isCached(fd) )  // in use by someone else; leave it as it is
+  {
+    fd = -1;
+    return;
+  }
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+#ifdef O_DIRECT
+  if ( mode == Direct )
+  {
+    // fails e.g. on tmpfs; then we fall back to dropping what we read
+    int flags = fcntl(fd, F_GETFL);
+    direct = (flags != -1) && (fcntl(fd, F_SETFL, flags | O_DIRECT) == 0);
+  }
+#endif
+
+  dropReads = !direct;
+}
+
+//--------------------------------------------------------------------------------
+
+void PageCache::doneReading(qint64 offset, qint64 len)
+{
+  if ( (fd == -1) || !dropReads || (len <= 0) )
+    return;
+
+  posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+}
+
+//--------------------------------------------------------------------------------
+
+void PageCache::startWriting(int fileDescriptor, Mode mode)
+{
+  fd = (mode == Normal) ? -1 : fileDescriptor;
+  dropReads = direct = false;
+  syncedPos = droppedPos = 0;
+}
+
+//--------------------------------------------------------------------------------
+
+void PageCache::written(qint64 pos)
+{
+  if ( (fd == -1) || ((pos - syncedPos) < WRITE_STEP) )
+    return;
+
+#ifdef Q_OS_LINUX
+  // start writing the new step, then wait for the previous one, which was started
+  // one step earlier, and drop it. So we only wait if the disk is slower than we are
+  sync_file_range(fd, syncedPos, pos - syncedPos, SYNC_FILE_RANGE_WRITE);
+
+  if ( droppedPos < syncedPos )
+  {
+    sync_file_range(fd, droppedPos, syncedPos - droppedPos,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, droppedPos, syncedPos - droppedPos, POSIX_FADV_DONTNEED);
+    droppedPos = syncedPos;
+  }
+#else
+  // only clean pages can be dropped
+  fdatasync(fd);
+  posix_fadvise(fd, droppedPos, pos - droppedPos, POSIX_FADV_DONTNEED);
+  droppedPos = pos;
+#endif
+
+  syncedPos = pos;
+}
+
+//--------------------------------------------------------------------------------
+
+void PageCache::dropFile(int fd)
+{
+  fdatasync(fd);  // only clean pages can be dropped
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+//--------------------------------------------------------------------------------
+
+bool PageCache::isCached(int fd)
+{
+  struct stat status;
+  if ( (fstat(fd, &status) == -1) || !S_ISREG(status.st_mode) )
+    return false;
+
+  const qint64 pageSize = sysconf(_SC_PAGESIZE);
+  QVector<unsigned char> pages;
+
+  for (qint64 offset = 0; offset < status.st_size; offset += CHECK_WINDOW)
+  {
+    size_t len = static_cast<size_t>(qMin(CHECK_WINDOW, status.st_size - offset));
+
+    // mapping does not read anything; it's only needed to ask the kernel
+    void *addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, offset);
+    if ( addr == MAP_FAILED )
+      return false;
+
+    pages.resize(static_cast<int>((len + pageSize - 1) / pageSize));
+    bool ok = (mincore(addr, len, pages.data()) == 0);
+    munmap(addr, len);
+
+    if ( !ok )
+      return false;
+
+    foreach (unsigned char page, pages)
+      if ( page & 1 )
+        return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 PageCache::cachedBytes()
+{
+  QFile file(QStringLiteral("/proc/meminfo"));
+  if ( !file.open(QIODevice::ReadOnly) )
+    return -1;
+
+  while ( !file.atEnd() )
+  {
+    QByteArray line = file.readLine();
+
+    // e.g. "Cached:          1234567 kB"
+    if ( line.startsWith("Cached:") )
+      return line.mid(7).trimmed().split(' ').value(0).toLongLong() * 1024;
+  }
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
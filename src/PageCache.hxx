@@ -0,0 +1,62 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _PAGE_CACHE_H_
+#define _PAGE_CACHE_H_
+
+// keeps a backup from filling the kernel's page cache with data nobody will
+// read again, which would evict the data other programs work with.
+// One object handles one file at a time
+
+#include <QtGlobal>
+
+class PageCache
+{
+  public:
+    // Friendly drops all data we read or wrote from the cache;
+    // Direct additionally reads files with O_DIRECT, bypassing the cache completely
+    enum Mode { Normal = 0, Friendly = 1, Direct = 2 };
+
+    PageCache();
+
+    // prepare reading the file fd sequentially.
+    // Data of a file which was already (partly) cached is left in the cache,
+    // as someone else is using it
+    void startReading(int fd, Mode mode);
+
+    // the given range of the file was read and is no longer needed
+    void doneReading(qint64 offset, qint64 len);
+
+    // prepare writing the file fd
+    void startWriting(int fd, Mode mode);
+
+    // data up to pos was written. Written data is flushed to disk in steps and then dropped
+    void written(qint64 pos);
+
+    // no more calls for the current file
+    void stop() { fd = -1; }
+
+    // writes all data of the file fd to disk and drops it from the cache
+    static void dropFile(int fd);
+
+    // the size of the page cache of the whole system or -1 if unknown
+    static qint64 cachedBytes();
+
+  private:
+    static bool isCached(int fd);
+
+  private:
+    int fd;
+    bool dropReads;
+    bool direct;
+    qint64 syncedPos;   // writeback was started up to here
+    qint64 droppedPos;  // data up to here is on disk and dropped from the cache
+};
+
+#endif
@@ -0,0 +1,64 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <PathTrie.hxx>
+
+#include <QStringList>
+
+//--------------------------------------------------------------------------------
+
+void PathTrie::clear()
+{
+  qDeleteAll(rootNode.children);
+  rootNode.children.clear();
+  rootNode.excludedDir = false;
+  rootNode.excludedFile = false;
+}
+
+//--------------------------------------------------------------------------------
+
+void PathTrie::insert(const QString &absolutePath, bool isDir)
+{
+  Node *node = &rootNode;
+
+  foreach (const QString &name, absolutePath.split(QLatin1Char('/'), QString::SkipEmptyParts))
+  {
+    Node *&child = node->children[name];
+    if ( !child )
+      child = new Node;
+
+    node = child;
+  }
+
+  if ( isDir )
+    node->excludedDir = true;
+  else
+    node->excludedFile = true;
+}
+
+//--------------------------------------------------------------------------------
+
+const PathTrie::Node *PathTrie::find(const QString &absolutePath) const
+{
+  if ( isEmpty() )
+    return nullptr;
+
+  const Node *node = &rootNode;
+
+  foreach (const QString &name, absolutePath.split(QLatin1Char('/'), QString::SkipEmptyParts))
+  {
+    node = node->child(name);
+    if ( !node )
+      return nullptr;
+  }
+
+  return node;
+}
+
+//--------------------------------------------------------------------------------
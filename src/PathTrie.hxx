@@ -0,0 +1,63 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _PATH_TRIE_H_
+#define _PATH_TRIE_H_
+
+// the excluded dirs and files as a tree of path components.
+// A directory walk keeps the node of the current dir and gets the node of an
+// entry with one lookup of its name. Below a dir without a node nothing is
+// excluded, so the whole subtree needs no lookup at all.
+// Lookups are read only and can be done from several threads
+
+#include <QHash>
+#include <QString>
+
+class PathTrie
+{
+  public:
+    class Node
+    {
+      public:
+        Node() : excludedDir(false), excludedFile(false) { }
+        ~Node() { qDeleteAll(children); }
+
+        // nullptr when nothing below name is excluded
+        const Node *child(const QString &name) const { return children.value(name, nullptr); }
+
+        bool isExcludedDir() const { return excludedDir; }
+        bool isExcludedFile() const { return excludedFile; }
+
+      private:
+        Q_DISABLE_COPY(Node)
+        friend class PathTrie;
+
+        QHash<QString, Node *> children;
+        bool excludedDir;
+        bool excludedFile;
+    };
+
+    PathTrie() { }
+
+    void clear();
+    // "/" itself may be excluded, too
+    bool isEmpty() const { return rootNode.children.isEmpty() && !rootNode.excludedDir && !rootNode.excludedFile; }
+
+    void insert(const QString &absolutePath, bool isDir);
+
+    // the node of an absolute path, or nullptr when nothing is excluded at or below it
+    const Node *find(const QString &absolutePath) const;
+
+  private:
+    Q_DISABLE_COPY(PathTrie)
+
+    Node rootNode;  // "/"
+};
+
+#endif
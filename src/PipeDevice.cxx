@@ -0,0 +1,71 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <PipeDevice.hxx>
+
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+//--------------------------------------------------------------------------------
+
+PipeDevice::PipeDevice(int theFd)
+  : fd(theFd), written(0), writeFailed(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+bool PipeDevice::open(OpenMode mode)
+{
+  if ( (mode & ReadOnly) || (fd < 0) )
+    return false;
+
+  return QIODevice::open(mode | Unbuffered);
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 PipeDevice::readData(char *data, qint64 maxSize)
+{
+  Q_UNUSED(data)
+  Q_UNUSED(maxSize)
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 PipeDevice::writeData(const char *data, qint64 maxSize)
+{
+  // a pipe takes only what fits into its buffer
+  qint64 done = 0;
+
+  while ( done < maxSize )
+  {
+    ssize_t len = ::write(fd, data + done, maxSize - done);
+
+    if ( len < 0 )
+    {
+      if ( errno == EINTR )
+        continue;
+
+      writeFailed = true;
+      setErrorString(QString::fromLocal8Bit(strerror(errno)));
+      return -1;
+    }
+
+    done += len;
+  }
+
+  written += done;
+  return done;
+}
+
+//--------------------------------------------------------------------------------
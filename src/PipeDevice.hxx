@@ -0,0 +1,46 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _PIPE_DEVICE_H_
+#define _PIPE_DEVICE_H_
+
+// a write only device on a file descriptor opened by someone else, e.g. stdout or a FIFO.
+// close() leaves the descriptor open, so that all slices of a backup
+// are written one after the other into the same stream
+
+#include <QIODevice>
+
+class PipeDevice : public QIODevice
+{
+  Q_OBJECT
+
+  public:
+    explicit PipeDevice(int fd);
+
+    bool open(OpenMode mode) override;
+
+    bool isSequential() const override { return true; }
+
+    // the bytes written since the device was created
+    qint64 pos() const override { return written; }
+
+    // a write failed, e.g. as the reader went away
+    bool failed() const { return writeFailed; }
+
+  protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+  private:
+    int fd;
+    qint64 written;
+    bool writeFailed;
+};
+
+#endif
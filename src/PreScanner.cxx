@@ -0,0 +1,144 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <PreScanner.hxx>
+#include <DirWalker.hxx>
+#include <FileEntry.hxx>
+#include <FileIndex.hxx>
+
+#include <fcntl.h>
+
+//--------------------------------------------------------------------------------
+
+PreScanner::PreScanner()
+  : excludeTrie(nullptr), modifiedSince(-1), fileIndex(nullptr), stopRequested(0)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+PreScanner::~PreScanner()
+{
+  stopScan();
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::setFilters(const WildcardMatcher &fileFilters, const WildcardMatcher &dirs)
+{
+  // own copies, as the matchers are not thread safe
+  filters = fileFilters;
+  dirFilters = dirs;
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::startScan(const QStringList &rootList)
+{
+  stopScan();
+
+  roots = rootList;
+  totals.clear();
+  stopRequested.store(0);
+
+  start(QThread::LowPriority);
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::stopScan()
+{
+  if ( isRunning() )
+    stopRequested.store(1);
+
+  wait();
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::run()
+{
+  foreach (const QString &path, roots)
+  {
+    if ( stopRequested.load() )
+      return;
+
+    Total total;
+    total.root = path;
+    total.files = 0;
+    total.bytes = 0;
+
+    FileEntry root(path);
+    const PathTrie::Node *excludes = excludeTrie ? excludeTrie->find(path) : nullptr;
+
+    if ( root.isDir() )
+      scanDir(root, excludes, AT_FDCWD, total);
+    else
+      countFile(root, excludes, total);
+
+    totals.append(total);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::scanDir(const FileEntry &dir, const PathTrie::Node *excludes, int parentFd, Total &total)
+{
+  if ( stopRequested.load() || dir.error || (excludes && excludes->isExcludedDir()) || dirFilters.matches(dir.path) )
+    return;
+
+  DirWalker walker;
+  QVector<FileEntry> entries;
+
+  if ( !walker.open(parentFd, (parentFd == AT_FDCWD) ? dir.path : dir.name) ||
+       !walker.readEntries(dir.path, entries) )
+    return;
+
+  total.files++;
+
+  foreach (const FileEntry &entry, entries)
+  {
+    const PathTrie::Node *child = excludes ? excludes->child(entry.name) : nullptr;
+
+    if ( entry.isDir() )
+      scanDir(entry, child, walker.handle(), total);
+    else
+      countFile(entry, child, total);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void PreScanner::countFile(const FileEntry &entry, const PathTrie::Node *excludes, Total &total)
+{
+  if ( entry.error )
+    return;
+
+  if ( fileIndex && fileIndex->isOpen() )
+  {
+    qint64 pos = fileIndex->find(entry);
+    if ( (pos != -1) && fileIndex->isUnchanged(pos, entry) )
+      return;
+  }
+  else if ( (modifiedSince != -1) && (entry.mtime < modifiedSince) )
+    return;
+
+  if ( filters.matches(entry.name) )
+    return;
+
+  if ( excludes && excludes->isExcludedFile() )
+    return;
+
+  total.files++;
+
+  if ( !entry.isSymLink() )
+    total.bytes += entry.size;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,84 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _PRE_SCANNER_H_
+#define _PRE_SCANNER_H_
+
+// walks the backup roots in its own thread and adds up the files and bytes
+// which the backup will store, reading only the metadata.
+// It makes the same exclude, filter and incremental decisions as the Archiver
+
+#include <QThread>
+#include <QStringList>
+#include <QVector>
+#include <QAtomicInt>
+
+#include <WildcardMatcher.hxx>
+#include <PathTrie.hxx>
+
+class FileEntry;
+class FileIndex;
+
+class PreScanner : public QThread
+{
+  Q_OBJECT
+
+  public:
+    PreScanner();
+    ~PreScanner() override;
+
+    // set before startScan()
+    // the trie must stay unchanged while the scan runs
+    void setExcludes(const PathTrie *trie) { excludeTrie = trie; }
+    void setFilters(const WildcardMatcher &fileFilters, const WildcardMatcher &dirFilters);
+
+    // only count files modified after the given time (msecs since epoch), -1 = all
+    void setModifiedSince(qint64 msecs) { modifiedSince = msecs; }
+
+    // or only files which changed since the given index, when it is open
+    void setFileIndex(const FileIndex *index) { fileIndex = index; }
+
+    // roots are absolute paths without a trailing slash
+    void startScan(const QStringList &roots);
+
+    // stops the thread and waits for it
+    void stopScan();
+
+    struct Total
+    {
+      QString root;
+      int files;
+      qint64 bytes;
+    };
+
+    // valid when the thread has finished without being stopped
+    const QVector<Total> &getTotals() const { return totals; }
+    bool wasStopped() const { return stopRequested.load(); }
+
+  protected:
+    void run() override;
+
+  private:
+    // excludes is the node of the entry in the exclude trie, if any
+    void scanDir(const FileEntry &dir, const PathTrie::Node *excludes, int parentFd, Total &total);
+    void countFile(const FileEntry &entry, const PathTrie::Node *excludes, Total &total);
+
+  private:
+    QStringList roots;
+    const PathTrie *excludeTrie;
+    WildcardMatcher filters;
+    WildcardMatcher dirFilters;
+    qint64 modifiedSince;
+    const FileIndex *fileIndex;
+
+    QVector<Total> totals;
+    QAtomicInt stopRequested;
+};
+
+#endif
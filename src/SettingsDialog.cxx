@@ -33,6 +33,35 @@ SettingsDialog::SettingsDialog(QWidget *parent)
   ui.predefSizes->setCurrentIndex(0);
   ui.maxSliceSize->setValue(0);
   ui.maxSliceSize->setDisabled(true);
+
+  // same order as Archiver::CompressMode
+  QStringList compressModes;
+
+  compressModes << i18n("None")
+                << i18n("Compress Files")
+                << i18n("Compress Archive Slices");
+
+  ui.compressMode->addItems(compressModes);
+
+  ui.compressCodec->addItem(i18n("Automatic"), CompressionCodec::Auto);
+  ui.compressCodec->addItem(QStringLiteral("xz"), CompressionCodec::Xz);
+  ui.compressCodec->addItem(QStringLiteral("bzip2"), CompressionCodec::BZip2);
+  ui.compressCodec->addItem(QStringLiteral("gzip"), CompressionCodec::GZip);
+
+  if ( CompressionCodec::isAvailable(CompressionCodec::Zstd) )
+    ui.compressCodec->addItem(QStringLiteral("zstd"), CompressionCodec::Zstd);
+
+  // same order as PageCache::Mode
+  QStringList cacheModes;
+
+  cacheModes << i18n("Normal")
+             << i18n("Keep Cache Clean")
+             << i18n("Direct I/O");
+
+  ui.cacheMode->addItems(cacheModes);
+
+  connect(ui.compressCodec, SIGNAL(activated(int)), this, SLOT(codecSelected(int)));
+  codecSelected(0);
 }
 
 //--------------------------------------------------------------------------------
@@ -70,6 +99,32 @@ void SettingsDialog::sizeSelected(int idx)
 
 //--------------------------------------------------------------------------------
 
+void SettingsDialog::codecSelected(int idx)
+{
+  Q_UNUSED(idx)
+
+  // only zstd supports a compression level
+  ui.compressLevel->setEnabled(getCodec() == CompressionCodec::Zstd);
+}
+
+//--------------------------------------------------------------------------------
+
+void SettingsDialog::setCodec(CompressionCodec::Type type)
+{
+  int idx = ui.compressCodec->findData(type);
+  ui.compressCodec->setCurrentIndex((idx == -1) ? 0 : idx);
+  codecSelected(ui.compressCodec->currentIndex());
+}
+
+//--------------------------------------------------------------------------------
+
+CompressionCodec::Type SettingsDialog::getCodec() const
+{
+  return static_cast<CompressionCodec::Type>(ui.compressCodec->currentData().toInt());
+}
+
+//--------------------------------------------------------------------------------
+
 void SettingsDialog::setMaxMB(int mb)
 {
   ui.maxSliceSize->setValue(mb);
@@ -13,6 +13,8 @@
 #include <QDialog>
 #include <ui_SettingsDialog.h>
 
+#include <CompressionCodec.hxx>
+
 class SettingsDialog : public QDialog
 {
   Q_OBJECT
@@ -22,10 +24,14 @@ class SettingsDialog : public QDialog
 
     void setMaxMB(int mb);
 
+    void setCodec(CompressionCodec::Type type);
+    CompressionCodec::Type getCodec() const;
+
     Ui::SettingsDialog ui;
 
   private Q_SLOTS:
     void sizeSelected(int idx);
+    void codecSelected(int idx);
 };
 
 #endif
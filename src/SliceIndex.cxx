@@ -0,0 +1,96 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <SliceIndex.hxx>
+#include <ContentHash.hxx>
+
+#include <QFile>
+
+//--------------------------------------------------------------------------------
+
+void SliceIndex::add(Type type, const QString &name, qint64 offset, qint64 size, const QDateTime &mtime)
+{
+  Entry entry;
+  entry.type = type;
+  entry.offset = offset;
+  entry.size = size;
+  entry.mtime = mtime.toMSecsSinceEpoch() / 1000;
+  entry.checksum = 0;
+  entry.name = name.toUtf8();
+
+  entries.append(entry);
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceIndex::setChecksum(quint64 checksum)
+{
+  if ( entries.isEmpty() )
+    return;
+
+  Entry &entry = entries.last();
+
+  if ( (entry.type == File) || (entry.type == SparseFile) || (entry.type == Continued) )
+    entry.checksum = checksum;
+}
+
+//--------------------------------------------------------------------------------
+
+bool SliceIndex::write(const QString &fileName)
+{
+  error = QString();
+
+  QFile file(fileName);
+  if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+  {
+    error = file.errorString();
+    return false;
+  }
+
+  QByteArray data("# kbackup slice index 1: type offset size mtime checksum name\n");
+
+  if ( ContentHash::algorithm() == ContentHash::Xxh3 )
+    data += "# checksum xxh3\n";
+  else
+    data += "# checksum xxh64\n";
+
+  foreach (const Entry &entry, entries)
+  {
+    QByteArray name = entry.name;
+    name.replace('\\', "\\\\").replace('\n', "\\n");
+
+    data += static_cast<char>(entry.type);
+    data += ' ' + QByteArray::number(entry.offset);
+    data += ' ' + QByteArray::number(entry.size);
+    data += ' ' + QByteArray::number(entry.mtime);
+    data += ' ' + (entry.checksum ? QByteArray::number(entry.checksum, 16).rightJustified(16, '0') : QByteArray("-"));
+    data += ' ' + name + '\n';
+
+    // keep the memory small for slices with many files
+    if ( data.size() > 1024 * 1024 )
+    {
+      if ( file.write(data) != data.size() )
+        break;
+
+      data.clear();
+    }
+  }
+
+  if ( (file.write(data) != data.size()) || !file.flush() || (file.error() != QFile::NoError) )
+  {
+    error = file.errorString();
+    file.close();
+    file.remove();
+    return false;
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,69 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _SLICE_INDEX_H_
+#define _SLICE_INDEX_H_
+
+// the table of contents of one slice, written next to it as <slice>.idx,
+// so that a member can be read without going through the whole slice.
+//
+// A text file with one line per member:
+//   type offset size mtime checksum name
+// type:     f file, s sparse file, c continued part of a file from the last slice,
+//           d directory, l symbolic link, h hard link
+// offset:   of the first tar header of the member in the (uncompressed) slice
+// size:     the content bytes stored in this slice
+// mtime:    seconds since epoch
+// checksum: the content hash of the file as hex (see the header line for the algorithm), or -
+// name:     the member name as tar lists it; \ and newline are escaped as \\ and \n
+//
+// A file split across slices carries its checksum in the entry of the last part
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QVector>
+
+class SliceIndex
+{
+  public:
+    enum Type { File = 'f', SparseFile = 's', Continued = 'c', Dir = 'd', SymLink = 'l', HardLink = 'h' };
+
+    struct Entry
+    {
+      Type type;
+      qint64 offset;
+      qint64 size;
+      qint64 mtime;
+      quint64 checksum;
+      QByteArray name;  // UTF-8
+    };
+
+    void clear() { entries.clear(); }
+    int count() const { return entries.count(); }
+    const Entry &at(int i) const { return entries[i]; }
+
+    void add(Type type, const QString &name, qint64 offset, qint64 size, const QDateTime &mtime);
+
+    // for the content of the last added file; 0 = not known
+    void setChecksum(quint64 checksum);
+
+    bool write(const QString &fileName);
+
+    QString errorString() const { return error; }
+
+    static QString fileNameForSlice(const QString &slice) { return slice + QStringLiteral(".idx"); }
+    static bool isIndexFile(const QString &fileName) { return fileName.endsWith(QLatin1String(".idx")); }
+
+  private:
+    QVector<Entry> entries;
+    QString error;
+};
+
+#endif
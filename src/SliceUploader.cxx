@@ -0,0 +1,154 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <SliceUploader.hxx>
+
+#include <kio/copyjob.h>
+#include <KJobUiDelegate>
+
+#include <QFile>
+#include <QFileInfo>
+
+//--------------------------------------------------------------------------------
+
+SliceUploader::SliceUploader()
+  : stopped(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+SliceUploader::~SliceUploader()
+{
+  cancel();
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceUploader::add(const QString &fileName, const QUrl &target, const QString &sidecar)
+{
+  Slice slice;
+  slice.fileName = fileName;
+  slice.sidecar = sidecar;
+  slice.target = target;
+  slice.size = QFileInfo(fileName).size();
+  slice.fileDone = false;
+
+  if ( !sidecar.isEmpty() )
+    slice.size += QFileInfo(sidecar).size();
+
+  pending.append(slice);
+
+  if ( !job && !stopped )
+    startNext();
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceUploader::retry(const QUrl &target)
+{
+  if ( pending.isEmpty() )
+    return;
+
+  pending.first().target = target;
+  stopped = false;
+
+  startNext();
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceUploader::cancel()
+{
+  if ( job )
+  {
+    job->kill();
+    job = nullptr;
+  }
+
+  foreach (const Slice &slice, pending)
+  {
+    QFile(slice.fileName).remove();
+
+    if ( !slice.sidecar.isEmpty() )
+      QFile(slice.sidecar).remove();
+  }
+
+  pending.clear();
+  stopped = false;
+}
+
+//--------------------------------------------------------------------------------
+
+KIO::filesize_t SliceUploader::pendingBytes() const
+{
+  KIO::filesize_t bytes = 0;
+
+  foreach (const Slice &slice, pending)
+    bytes += slice.size;
+
+  return bytes;
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceUploader::startNext()
+{
+  if ( pending.isEmpty() )
+    return;
+
+  const Slice &slice = pending.first();
+  const QString &source = slice.fileDone ? slice.sidecar : slice.fileName;
+
+  job = KIO::copy(QUrl::fromLocalFile(source), slice.target, KIO::DefaultFlags);
+
+  connect(job, SIGNAL(result(KJob *)), this, SLOT(slotResult(KJob *)));
+}
+
+//--------------------------------------------------------------------------------
+
+void SliceUploader::slotResult(KJob *theJob)
+{
+  job = nullptr;
+
+  if ( pending.isEmpty() )  // cancelled
+    return;
+
+  // the first slice is the one uploaded
+  const Slice slice = pending.first();
+
+  if ( theJob->error() )
+  {
+    theJob->uiDelegate()->showErrorMessage();
+
+    stopped = true;
+    emit failed(slice.fileDone ? slice.sidecar : slice.fileName, theJob->errorString());
+    return;
+  }
+
+  if ( !slice.fileDone && !slice.sidecar.isEmpty() )
+  {
+    pending.first().fileDone = true;
+    startNext();
+    return;
+  }
+
+  pending.removeFirst();
+
+  QUrl url = slice.target.adjusted(QUrl::StripTrailingSlash);
+  url.setPath(url.path() + QLatin1Char('/') + QFileInfo(slice.fileName).fileName());
+
+  emit uploaded(slice.fileName, url);
+
+  // the receiver may have cancelled
+  if ( !job && !stopped )
+    startNext();
+}
+
+//--------------------------------------------------------------------------------
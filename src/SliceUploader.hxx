@@ -0,0 +1,79 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _SLICE_UPLOADER_H_
+#define _SLICE_UPLOADER_H_
+
+// uploads finished slices from the tmp dir to a remote target in the background,
+// one after the other in the order they were added, while the Archiver already
+// writes the next slice.
+// When an upload fails, the queue stops until the owner calls retry() or cancel()
+
+#include <QObject>
+#include <QPointer>
+#include <QList>
+#include <QUrl>
+
+#include <kio/global.h>
+
+class KJob;
+namespace KIO { class CopyJob; }
+
+class SliceUploader : public QObject
+{
+  Q_OBJECT
+
+  public:
+    SliceUploader();
+    ~SliceUploader() override;
+
+    // the file is kept until uploaded() was emitted.
+    // A sidecar file (e.g. the index of the slice) is uploaded right behind it;
+    // uploaded() is emitted when both are done
+    void add(const QString &fileName, const QUrl &target, const QString &sidecar = QString());
+
+    // upload the failed slice again, maybe into another target dir
+    void retry(const QUrl &target);
+
+    // stop the running upload and remove the files of all slices not yet uploaded
+    void cancel();
+
+    // the slices not uploaded yet, including the one uploading now
+    int count() const { return pending.count(); }
+    KIO::filesize_t pendingBytes() const;
+
+  Q_SIGNALS:
+    // url is the uploaded file
+    void uploaded(const QString &fileName, const QUrl &url);
+
+    // fileName is the file (or the sidecar) which failed
+    void failed(const QString &fileName, const QString &errorString);
+
+  private Q_SLOTS:
+    void slotResult(KJob *theJob);
+
+  private:
+    void startNext();
+
+  private:
+    struct Slice
+    {
+      QString fileName;
+      QString sidecar;
+      QUrl target;  // the dir
+      KIO::filesize_t size;
+      bool fileDone;  // only the sidecar is left
+    };
+
+    QList<Slice> pending;
+    QPointer<KIO::CopyJob> job;
+    bool stopped;  // the first slice failed
+};
+
+#endif
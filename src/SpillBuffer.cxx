@@ -0,0 +1,116 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <SpillBuffer.hxx>
+
+#include <QTemporaryFile>
+
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+
+SpillBuffer::SpillBuffer(qint64 limit)
+  : threshold(limit), tmpFile(nullptr)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+SpillBuffer::~SpillBuffer()
+{
+  delete tmpFile;  // removes the file
+}
+
+//--------------------------------------------------------------------------------
+
+bool SpillBuffer::open(OpenMode mode)
+{
+  if ( mode & QIODevice::WriteOnly )
+  {
+    buffer.clear();
+    delete tmpFile;
+    tmpFile = nullptr;
+  }
+
+  // like QBuffer we do not need the QIODevice internal buffer
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 SpillBuffer::size() const
+{
+  return tmpFile ? tmpFile->size() : buffer.size();
+}
+
+//--------------------------------------------------------------------------------
+
+bool SpillBuffer::seek(qint64 pos)
+{
+  if ( (pos < 0) || (pos > size()) )
+    return false;
+
+  return QIODevice::seek(pos);
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 SpillBuffer::readData(char *data, qint64 maxSize)
+{
+  if ( tmpFile )
+  {
+    if ( !tmpFile->seek(pos()) )
+      return -1;
+
+    return tmpFile->read(data, maxSize);
+  }
+
+  qint64 len = qMin(maxSize, static_cast<qint64>(buffer.size()) - pos());
+  if ( len <= 0 )
+    return 0;
+
+  memcpy(data, buffer.constData() + pos(), len);
+  return len;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 SpillBuffer::writeData(const char *data, qint64 len)
+{
+  // data is only appended
+  if ( !tmpFile && ((buffer.size() + len) > threshold) )
+  {
+    tmpFile = new QTemporaryFile;
+
+    if ( !tmpFile->open() || (tmpFile->write(buffer) != buffer.size()) )
+    {
+      setErrorString(tmpFile->errorString());
+      delete tmpFile;
+      tmpFile = nullptr;
+      return -1;
+    }
+
+    buffer.clear();
+    buffer.squeeze();
+  }
+
+  if ( tmpFile )
+  {
+    qint64 wrote = tmpFile->write(data, len);
+    if ( wrote != len )
+      setErrorString(tmpFile->errorString());
+
+    return wrote;
+  }
+
+  buffer.append(data, static_cast<int>(len));
+  return len;
+}
+
+//--------------------------------------------------------------------------------
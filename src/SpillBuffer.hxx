@@ -0,0 +1,48 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _SPILL_BUFFER_H_
+#define _SPILL_BUFFER_H_
+
+// a QIODevice which keeps its data in memory and only moves it into a
+// temporary file when more than the given threshold of bytes are written.
+// Data is written once from the start and afterwards read back; opening
+// it for writing discards the previous content
+
+#include <QIODevice>
+#include <QByteArray>
+
+class QTemporaryFile;
+
+class SpillBuffer : public QIODevice
+{
+  Q_OBJECT
+
+  public:
+    explicit SpillBuffer(qint64 threshold);
+    ~SpillBuffer() override;
+
+    bool open(OpenMode mode) override;
+    qint64 size() const override;
+    bool seek(qint64 pos) override;
+
+    // true if the data did not fit into memory
+    bool isSpilled() const { return tmpFile != nullptr; }
+
+  protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+  private:
+    qint64 threshold;
+    QByteArray buffer;
+    QTemporaryFile *tmpFile;
+};
+
+#endif
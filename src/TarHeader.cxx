@@ -0,0 +1,221 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <TarHeader.hxx>
+#include <FileEntry.hxx>
+
+#include <QFile>
+
+#include <string.h>
+
+//--------------------------------------------------------------------------------
+// the field offsets of a tar header block
+
+enum
+{
+  NAME = 0, NAME_LENGTH = 100,
+  MODE = 100, UID = 108, GID = 116, NUMBER_LENGTH = 8,
+  SIZE = 124, MTIME = 136, TIME_LENGTH = 12,
+  CHECKSUM = 148,
+  TYPEFLAG = 156,
+  LINKNAME = 157,
+  MAGIC = 257,
+  UNAME = 265, GNAME = 297, OWNER_LENGTH = 32,
+  OFFSET = 369  // of a multi-volume header, in the old GNU format
+};
+
+//--------------------------------------------------------------------------------
+
+void TarHeader::setOctal(char *field, int length, qint64 value)
+{
+  // the digits and a terminating NUL
+  const QByteArray digits = QByteArray::number(value, 8);
+
+  if ( digits.length() < length )
+  {
+    memset(field, '0', length - 1 - digits.length());
+    memcpy(field + length - 1 - digits.length(), digits.constData(), digits.length());
+    field[length - 1] = 0;
+  }
+  else  // too large; GNU base-256 encoding
+  {
+    for (int i = length - 1; i > 0; i--, value >>= 8)
+      field[i] = static_cast<char>(value & 0xff);
+
+    field[0] = static_cast<char>(0x80);
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+void TarHeader::setChecksum(char *block)
+{
+  // computed with the checksum field itself filled with blanks
+  memset(block + CHECKSUM, ' ', 8);
+
+  unsigned int sum = 0;
+  for (int i = 0; i < BLOCK_SIZE; i++)
+    sum += static_cast<unsigned char>(block[i]);
+
+  // six digits, NUL, blank
+  setOctal(block + CHECKSUM, 7, sum);
+  block[CHECKSUM + 7] = ' ';
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::longLink(const QByteArray &name, char type)
+{
+  const int dataSize = name.length() + 1;
+  const int padded = (dataSize + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+
+  QByteArray blocks(BLOCK_SIZE + padded, 0);
+  char *block = blocks.data();
+
+  strcpy(block + NAME, "././@LongLink");
+  setOctal(block + MODE, NUMBER_LENGTH, 0);
+  setOctal(block + UID, NUMBER_LENGTH, 0);
+  setOctal(block + GID, NUMBER_LENGTH, 0);
+  setOctal(block + SIZE, TIME_LENGTH, dataSize);
+  setOctal(block + MTIME, TIME_LENGTH, 0);
+  block[TYPEFLAG] = type;
+  memcpy(block + MAGIC, "ustar\0" "00", 8);
+  setChecksum(block);
+
+  memcpy(block + BLOCK_SIZE, name.constData(), name.length());
+
+  return blocks;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::block(const QByteArray &name, char type, qint64 size, const FileEntry &entry,
+                            const QByteArray &linkName)
+{
+  QByteArray header(BLOCK_SIZE, 0);
+  char *block = header.data();
+
+  // truncated when it's in a long link block
+  memcpy(block + NAME, name.constData(), qMin(name.length(), NAME_LENGTH - 1));
+  memcpy(block + LINKNAME, linkName.constData(), qMin(linkName.length(), NAME_LENGTH - 1));
+
+  setOctal(block + MODE, NUMBER_LENGTH, entry.mode & 07777);
+  setOctal(block + UID, NUMBER_LENGTH, entry.uid);
+  setOctal(block + GID, NUMBER_LENGTH, entry.gid);
+  setOctal(block + SIZE, TIME_LENGTH, size);
+  setOctal(block + MTIME, TIME_LENGTH, qMax(Q_INT64_C(0), entry.mtime / 1000));
+  block[TYPEFLAG] = type;
+  memcpy(block + MAGIC, "ustar\0" "00", 8);
+
+  const QByteArray owner = entry.owner().toLocal8Bit();
+  const QByteArray group = entry.group().toLocal8Bit();
+  memcpy(block + UNAME, owner.constData(), qMin(owner.length(), OWNER_LENGTH - 1));
+  memcpy(block + GNAME, group.constData(), qMin(group.length(), OWNER_LENGTH - 1));
+
+  setChecksum(block);
+
+  return header;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::create(const QString &name, Type type, qint64 size, const FileEntry &entry,
+                             const QString &linkName)
+{
+  const QByteArray encodedName = QFile::encodeName(name);
+  const QByteArray encodedLink = QFile::encodeName(linkName);
+
+  QByteArray blocks;
+
+  if ( encodedLink.length() >= NAME_LENGTH )
+    blocks += longLink(encodedLink, 'K');
+
+  if ( encodedName.length() >= NAME_LENGTH )
+    blocks += longLink(encodedName, 'L');
+
+  return blocks + block(encodedName, static_cast<char>(type), size, entry, encodedLink);
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::paxRecord(const QByteArray &key, const QByteArray &value)
+{
+  // "length key=value\n", where length counts its own digits as well
+  const int rest = key.length() + value.length() + 3;
+  int length = rest + QByteArray::number(rest).length();
+  length = rest + QByteArray::number(length).length();
+
+  return QByteArray::number(length) + ' ' + key + '=' + value + '\n';
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::sparseHeader(const QString &name, qint64 storedSize, const FileEntry &entry)
+{
+  const QByteArray encodedName = QFile::encodeName(name);
+  const QByteArray baseName = encodedName.mid(encodedName.lastIndexOf('/') + 1);
+
+  QByteArray records;
+  records += paxRecord("GNU.sparse.major", "1");
+  records += paxRecord("GNU.sparse.minor", "0");
+  records += paxRecord("GNU.sparse.name", encodedName);
+  records += paxRecord("GNU.sparse.realsize", QByteArray::number(entry.size));
+
+  // the names of the headers are only seen by a tar without sparse support
+  QByteArray blocks = block("PaxHeaders/" + baseName, PaxHeader, records.length(), entry);
+  blocks += records;
+  blocks += QByteArray(padding(records.length()), 0);
+
+  blocks += block("GNUSparseFile.0/" + baseName, RegularFile, storedSize, entry);
+
+  return blocks;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::sparseMap(const QVector<Extent> &extents, qint64 realSize)
+{
+  const bool endsInHole = extents.isEmpty() ||
+                          ((extents.last().offset + extents.last().length) < realSize);
+
+  QByteArray map = QByteArray::number(extents.count() + (endsInHole ? 1 : 0)) + '\n';
+
+  foreach (const Extent &extent, extents)
+    map += QByteArray::number(extent.offset) + '\n' + QByteArray::number(extent.length) + '\n';
+
+  if ( endsInHole )
+    map += QByteArray::number(realSize) + "\n0\n";
+
+  map += QByteArray(padding(map.length()), 0);
+
+  return map;
+}
+
+//--------------------------------------------------------------------------------
+
+QByteArray TarHeader::continuation(const QString &name, qint64 size, qint64 offset)
+{
+  // GNU tar compares the name with the one of the member started in the last
+  // volume. It has no long link block; a longer name is truncated
+  const QByteArray encodedName = QFile::encodeName(name);
+
+  QByteArray header(BLOCK_SIZE, 0);
+  char *block = header.data();
+
+  memcpy(block + NAME, encodedName.constData(), qMin(encodedName.length(), static_cast<int>(NAME_LENGTH)));
+  setOctal(block + SIZE, TIME_LENGTH, size);
+  block[TYPEFLAG] = MultiVolume;
+  setOctal(block + OFFSET, TIME_LENGTH, offset);
+
+  setChecksum(block);
+
+  return header;
+}
+
+//--------------------------------------------------------------------------------
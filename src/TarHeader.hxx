@@ -0,0 +1,78 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _TAR_HEADER_H_
+#define _TAR_HEADER_H_
+
+// builds tar header blocks for the entry types KTar can not write itself.
+// The blocks are written into the archive device between the entries KTar writes,
+// in the same format KTar uses (ustar, with names of 100 bytes and longer stored in
+// GNU ././@LongLink blocks before the header).
+// Sparse files use the PAX format 1.0 of GNU tar: a pax header names the file,
+// and the content starts with a map of the data extents stored behind it.
+// A file continued in the next slice starts there with a GNU multi-volume header
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class FileEntry;
+
+class TarHeader
+{
+  public:
+    enum { BLOCK_SIZE = 512 };
+
+    enum Type { RegularFile = '0', HardLink = '1', SymLink = '2', Directory = '5', PaxHeader = 'x',
+                MultiVolume = 'M' };
+
+    struct Extent
+    {
+      qint64 offset;
+      qint64 length;
+    };
+
+    // the header blocks of an entry named name (as it appears in the archive).
+    // size is the number of content bytes following; linkName is the target of a link
+    static QByteArray create(const QString &name, Type type, qint64 size, const FileEntry &entry,
+                             const QString &linkName = QString());
+
+    // the blocks of a hard link to the archive member target
+    static QByteArray hardLink(const QString &name, const QString &target, const FileEntry &entry)
+    {
+      return create(name, HardLink, 0, entry, target);
+    }
+
+    // the blocks before the content of a sparse file with storedSize bytes of map and data
+    static QByteArray sparseHeader(const QString &name, qint64 storedSize, const FileEntry &entry);
+
+    // the map of the extents with data, padded to full blocks.
+    // A file ending in a hole gets an empty extent at its end
+    static QByteArray sparseMap(const QVector<Extent> &extents, qint64 realSize);
+
+    // the header of the part of a file which continues in the next slice, as GNU tar writes it.
+    // size is the number of content bytes in this part, offset its position in the file
+    static QByteArray continuation(const QString &name, qint64 size, qint64 offset);
+
+    // the bytes to fill the last block of content of the given size
+    static int padding(qint64 size) { return static_cast<int>((BLOCK_SIZE - size % BLOCK_SIZE) % BLOCK_SIZE); }
+
+  private:
+    // a single header block; the names are truncated to the field size
+    static QByteArray block(const QByteArray &name, char type, qint64 size, const FileEntry &entry,
+                            const QByteArray &linkName = QByteArray());
+
+    static QByteArray paxRecord(const QByteArray &key, const QByteArray &value);
+
+    static void setOctal(char *field, int length, qint64 value);
+    static void setChecksum(char *block);
+    static QByteArray longLink(const QByteArray &name, char type);
+};
+
+#endif
@@ -0,0 +1,208 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <WildcardMatcher.hxx>
+
+#include <algorithm>
+
+//--------------------------------------------------------------------------------
+
+WildcardMatcher::WildcardMatcher()
+  : matchAll(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+WildcardMatcher::WildcardMatcher(const WildcardMatcher &other)
+  : matchAll(false)
+{
+  // compile again, so that no QRegExp is shared with the other thread
+  setPatterns(other.patterns);
+}
+
+//--------------------------------------------------------------------------------
+
+WildcardMatcher &WildcardMatcher::operator=(const WildcardMatcher &other)
+{
+  if ( this != &other )
+    setPatterns(other.patterns);
+
+  return *this;
+}
+
+//--------------------------------------------------------------------------------
+
+void WildcardMatcher::setPatterns(const QStringList &list)
+{
+  patterns = list;
+
+  matchAll = false;
+  names.clear();
+  suffixes.clear();
+  suffixLengths.clear();
+  prefixes.clear();
+  prefixLengths.clear();
+  singlePatterns.clear();
+  charSetPatterns.clear();
+
+  QStringList expressions, singleExpressions;
+
+  foreach (const QString &pattern, patterns)
+  {
+    if ( pattern.contains(QLatin1Char('[')) )
+    {
+      charSetPatterns.append(QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard));
+      continue;
+    }
+
+    if ( pattern.contains(QLatin1Char('?')) )
+    {
+      singlePatterns.append(QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard));
+      singleExpressions.append(toRegularExpression(pattern));
+      continue;
+    }
+
+    const int stars = pattern.count(QLatin1Char('*'));
+    const QString literal = QString(pattern).remove(QLatin1Char('*'));
+
+    if ( stars == 0 )
+      names.insert(pattern);
+    else if ( literal.isEmpty() )
+      matchAll = true;
+    else if ( (stars == 1) && pattern.startsWith(QLatin1Char('*')) )
+    {
+      suffixes.insert(literal);
+      if ( !suffixLengths.contains(literal.length()) )
+        suffixLengths.append(literal.length());
+    }
+    else if ( (stars == 1) && pattern.endsWith(QLatin1Char('*')) )
+    {
+      prefixes.insert(literal);
+      if ( !prefixLengths.contains(literal.length()) )
+        prefixLengths.append(literal.length());
+    }
+    else
+      expressions.append(toRegularExpression(pattern));
+  }
+
+  std::sort(suffixLengths.begin(), suffixLengths.end());
+  std::sort(prefixLengths.begin(), prefixLengths.end());
+
+  // QRegExp's '.' also matches a newline
+  const QRegularExpression::PatternOptions options =
+    QRegularExpression::DotMatchesEverythingOption | QRegularExpression::DontCaptureOption;
+
+  combined = QRegularExpression();
+  if ( !expressions.isEmpty() )
+  {
+    combined = QRegularExpression(QStringLiteral("\\A(?:") + expressions.join(QLatin1Char('|')) + QStringLiteral(")\\z"), options);
+    combined.optimize();
+  }
+
+  combinedSingle = QRegularExpression();
+  if ( !singleExpressions.isEmpty() )
+  {
+    combinedSingle = QRegularExpression(QStringLiteral("\\A(?:") + singleExpressions.join(QLatin1Char('|')) + QStringLiteral(")\\z"), options);
+    combinedSingle.optimize();
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+QString WildcardMatcher::toRegularExpression(const QString &pattern)
+{
+  // QRegExp::Wildcard knows no escape character, so everything but * and ? is literal
+  QString expression;
+  QString literal;
+  bool star = false;
+
+  for (int i = 0; i < pattern.length(); i++)
+  {
+    const QChar c = pattern[i];
+
+    if ( (c == QLatin1Char('*')) || (c == QLatin1Char('?')) )
+    {
+      expression += QRegularExpression::escape(literal);
+      literal.clear();
+
+      if ( c == QLatin1Char('?') )
+        expression += QLatin1Char('.');
+      else if ( !star )  // ** is the same as *
+        expression += QLatin1String(".*");
+
+      star = (c == QLatin1Char('*'));
+    }
+    else
+    {
+      literal += c;
+      star = false;
+    }
+  }
+
+  expression += QRegularExpression::escape(literal);
+
+  return expression;
+}
+
+//--------------------------------------------------------------------------------
+
+bool WildcardMatcher::lookup(const QString &str, const QSet<QString> &set, const QVector<int> &lengths, bool atEnd)
+{
+  for (int i = 0; (i < lengths.count()) && (lengths[i] <= str.length()); i++)
+  {
+    const int start = atEnd ? (str.length() - lengths[i]) : 0;
+
+    // no copy of the characters needed for the lookup
+    if ( set.contains(QString::fromRawData(str.constData() + start, lengths[i])) )
+      return true;
+  }
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+
+bool WildcardMatcher::matches(const QString &str) const
+{
+  if ( matchAll || names.contains(str) ||
+       lookup(str, suffixes, suffixLengths, true) ||
+       lookup(str, prefixes, prefixLengths, false) )
+    return true;
+
+  if ( !combined.pattern().isEmpty() && combined.match(str).hasMatch() )
+    return true;
+
+  if ( !singlePatterns.isEmpty() )
+  {
+    bool surrogates = false;
+    for (int i = 0; !surrogates && (i < str.length()); i++)
+      surrogates = str[i].isSurrogate();
+
+    if ( !surrogates )
+    {
+      if ( combinedSingle.match(str).hasMatch() )
+        return true;
+    }
+    else
+    {
+      foreach (const QRegExp &exp, singlePatterns)
+        if ( exp.exactMatch(str) )
+          return true;
+    }
+  }
+
+  foreach (const QRegExp &exp, charSetPatterns)
+    if ( exp.exactMatch(str) )
+      return true;
+
+  return false;
+}
+
+//--------------------------------------------------------------------------------
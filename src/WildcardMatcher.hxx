@@ -0,0 +1,66 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _WILDCARD_MATCHER_H_
+#define _WILDCARD_MATCHER_H_
+
+// matches a string against a list of wildcard patterns at once, with exactly the
+// result of QRegExp(pattern, Qt::CaseSensitive, QRegExp::Wildcard).exactMatch() for any of them.
+// Patterns like "name", "*.ext" and "prefix*" are hash lookups, all other ones
+// are combined into a single regular expression.
+// matches() is not thread safe; every thread must use its own copy
+
+#include <QStringList>
+#include <QSet>
+#include <QVector>
+#include <QList>
+#include <QRegExp>
+#include <QRegularExpression>
+
+class WildcardMatcher
+{
+  public:
+    WildcardMatcher();
+    WildcardMatcher(const WildcardMatcher &other);
+    WildcardMatcher &operator=(const WildcardMatcher &other);
+
+    void setPatterns(const QStringList &list);
+    const QStringList &getPatterns() const { return patterns; }
+
+    bool isEmpty() const { return patterns.isEmpty(); }
+    void clear() { setPatterns(QStringList()); }
+
+    bool matches(const QString &str) const;
+
+  private:
+    static QString toRegularExpression(const QString &pattern);
+    static bool lookup(const QString &str, const QSet<QString> &set, const QVector<int> &lengths, bool atEnd);
+
+  private:
+    QStringList patterns;
+
+    bool matchAll;  // "*"
+    QSet<QString> names;
+    QSet<QString> suffixes;
+    QVector<int> suffixLengths;
+    QSet<QString> prefixes;
+    QVector<int> prefixLengths;
+
+    QRegularExpression combined;
+
+    // '?' is one UTF-16 code unit for QRegExp but a whole character here; for strings
+    // with surrogate pairs these patterns are checked with QRegExp
+    QRegularExpression combinedSingle;
+    QList<QRegExp> singlePatterns;
+
+    // character sets have a different syntax in QRegExp; always checked with QRegExp
+    QList<QRegExp> charSetPatterns;
+};
+
+#endif
@@ -0,0 +1,149 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#include <ZstdDevice.hxx>
+
+#include <KLocalizedString>
+
+//--------------------------------------------------------------------------------
+
+ZstdDevice::ZstdDevice(QIODevice *dev, int lev, int threads)
+  : device(dev), level(lev), workers(threads), context(nullptr), openedDevice(false), writeFailed(false)
+{
+}
+
+//--------------------------------------------------------------------------------
+
+ZstdDevice::~ZstdDevice()
+{
+  close();
+}
+
+//--------------------------------------------------------------------------------
+
+bool ZstdDevice::open(OpenMode mode)
+{
+  if ( (mode & QIODevice::ReadOnly) || !(mode & QIODevice::WriteOnly) )
+  {
+    setErrorString(i18n("Reading zstd compressed data is not supported"));
+    return false;
+  }
+
+  if ( !device->isOpen() )
+  {
+    if ( !device->open(QIODevice::WriteOnly) )
+    {
+      setErrorString(device->errorString());
+      return false;
+    }
+    openedDevice = true;
+  }
+
+  writeFailed = false;
+  context = ZSTD_createCCtx();
+  ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+
+  // fails when libzstd was built without multithreading; then we simply use one thread
+  if ( workers > 1 )
+    ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, workers);
+
+  outBuffer.resize(static_cast<int>(ZSTD_CStreamOutSize()));
+
+  return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+//--------------------------------------------------------------------------------
+
+void ZstdDevice::close()
+{
+  if ( !isOpen() )
+    return;
+
+  compress(nullptr, 0, ZSTD_e_end);  // write the end of the frame
+
+  ZSTD_freeCCtx(context);
+  context = nullptr;
+
+  QIODevice::close();
+
+  if ( openedDevice )
+  {
+    device->close();
+    openedDevice = false;
+  }
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 ZstdDevice::pendingBytes() const
+{
+  if ( !context )
+    return 0;
+
+  const ZSTD_frameProgression progress = ZSTD_getFrameProgression(context);
+
+  // the input not compressed yet might not compress at all
+  return static_cast<qint64>(ZSTD_compressBound(progress.ingested - progress.consumed) +
+                             (progress.produced - progress.flushed));
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 ZstdDevice::readData(char *data, qint64 maxSize)
+{
+  Q_UNUSED(data)
+  Q_UNUSED(maxSize)
+
+  return -1;
+}
+
+//--------------------------------------------------------------------------------
+
+qint64 ZstdDevice::writeData(const char *data, qint64 len)
+{
+  if ( !compress(data, static_cast<size_t>(len), ZSTD_e_continue) )
+    return -1;
+
+  return len;
+}
+
+//--------------------------------------------------------------------------------
+
+bool ZstdDevice::compress(const char *data, size_t len, ZSTD_EndDirective directive)
+{
+  ZSTD_inBuffer input = { data, len, 0 };
+
+  while ( true )
+  {
+    ZSTD_outBuffer output = { outBuffer.data(), static_cast<size_t>(outBuffer.size()), 0 };
+
+    size_t remaining = ZSTD_compressStream2(context, &output, &input, directive);
+
+    if ( ZSTD_isError(remaining) )
+    {
+      setErrorString(QString::fromLatin1(ZSTD_getErrorName(remaining)));
+      writeFailed = true;
+      return false;
+    }
+
+    if ( output.pos &&
+         (device->write(outBuffer.constData(), static_cast<qint64>(output.pos)) != static_cast<qint64>(output.pos)) )
+    {
+      setErrorString(device->errorString());
+      writeFailed = true;
+      return false;
+    }
+
+    // when continuing, all input must be consumed; at the end, zstd must have flushed everything
+    if ( (directive == ZSTD_e_continue) ? (input.pos == input.size) : (remaining == 0) )
+      return true;
+  }
+}
+
+//--------------------------------------------------------------------------------
@@ -0,0 +1,61 @@
+//**************************************************************************
+//   Copyright 2006 - 2018 Martin Koller, kollix@aon.at
+//
+//   This program is free software; you can redistribute it and/or modify
+//   it under the terms of the GNU General Public License as published by
+//   the Free Software Foundation, version 2 of the License
+//
+//**************************************************************************
+
+#ifndef _ZSTD_DEVICE_H_
+#define _ZSTD_DEVICE_H_
+
+// a write-only QIODevice which compresses all data with zstd into another device,
+// the same as KCompressionDevice does for the codecs it knows
+
+#include <QIODevice>
+#include <QByteArray>
+
+#define ZSTD_STATIC_LINKING_ONLY  // ZSTD_getFrameProgression()
+#include <zstd.h>
+
+class ZstdDevice : public QIODevice
+{
+  Q_OBJECT
+
+  public:
+    // level 0 is the zstd default, negative levels are the fast modes.
+    // With workers > 1 zstd compresses in its own threads
+    ZstdDevice(QIODevice *device, int level, int workers);
+    ~ZstdDevice() override;
+
+    bool open(OpenMode mode) override;
+
+    // writes the end of the frame; check failed() afterwards
+    void close() override;
+
+    // some data or the end of the frame could not be written; errorString() tells why
+    bool failed() const { return writeFailed; }
+
+    // the most bytes the data written so far can still add to the device.
+    // zstd's threads hold back about one job per thread, which can be tens of MB
+    qint64 pendingBytes() const;
+
+  protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+  private:
+    bool compress(const char *data, size_t len, ZSTD_EndDirective directive);
+
+  private:
+    QIODevice *device;
+    int level;
+    int workers;
+    ZSTD_CCtx *context;
+    QByteArray outBuffer;
+    bool openedDevice;
+    bool writeFailed;
+};
+
+#endif
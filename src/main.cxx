@@ -16,12 +16,20 @@
 #include <QString>
 #include <QTimer>
 #include <QPointer>
+#include <QFileInfo>
+#include <QDir>
+#include <QUrl>
 
 #include <KAboutData>
 #include <KLocalizedString>
 
 #include <MainWindow.hxx>
 #include <Archiver.hxx>
+#include <IoBuffer.hxx>
+#include <FileReader.hxx>
+#include <DirScanner.hxx>
+#include <BackupCatalog.hxx>
+#include <ChunkStore.hxx>
 
 #include <iostream>
 
@@ -37,6 +45,78 @@ void sigHandler(int sig)
 
 //--------------------------------------------------------------------------------
 
+// prints every backup of the profile which holds the file, with the place in the slice
+static int lookupFile(const QString &file, const QString &profile)
+{
+  if ( profile.isEmpty() )
+  {
+    std::cerr << i18n("Please give the profile whose backups shall be searched for '%1'.", file).toUtf8().constData() << std::endl;
+    return -1;
+  }
+
+  BackupCatalog catalog;
+  const QString catalogName = BackupCatalog::fileNameForProfile(profile);
+
+  if ( !catalog.open(catalogName) )
+  {
+    std::cerr << i18n("Could not open the backup catalog %1: %2", catalogName,
+                      catalog.errorString().isEmpty() ? i18n("There is none yet") : catalog.errorString())
+                 .toUtf8().constData() << std::endl;
+    return -1;
+  }
+
+  // as tar lists the member
+  const QString name = QDir::cleanPath(QStringLiteral(".") + QFileInfo(file).absoluteFilePath());
+
+  const QVector<BackupCatalog::Version> versions = catalog.lookup(name);
+
+  foreach (const BackupCatalog::Version &version, versions)
+  {
+    const QString slice = version.run.target + QLatin1Char('/') + version.run.slices.value(version.slice);
+    const QString checksum = version.hash ? QString::number(version.hash, 16).rightJustified(16, QLatin1Char('0'))
+                                          : QStringLiteral("-");
+
+    std::cout << version.run.startTime.toString(Qt::ISODate).toUtf8().constData()
+              << (version.run.incremental ? " incremental " : " full ")
+              << version.type << ' ' << version.offset << ' ' << version.size << ' '
+              << version.mtime.toString(Qt::ISODate).toUtf8().constData() << ' '
+              << checksum.toUtf8().constData() << ' '
+              << slice.toUtf8().constData() << std::endl;
+  }
+
+  if ( versions.isEmpty() )
+  {
+    std::cerr << i18n("'%1' is in no backup of the catalog %2", name, catalogName).toUtf8().constData() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+//--------------------------------------------------------------------------------
+
+// writes the files of a snapshot of a chunk repository below dir
+static int restoreSnapshot(const QString &snapshot, const QString &dir)
+{
+  if ( dir.isEmpty() )
+  {
+    std::cerr << i18n("Please give the directory into which '%1' shall be restored.", snapshot).toUtf8().constData() << std::endl;
+    return -1;
+  }
+
+  ChunkStore store;
+
+  if ( !store.restoreSnapshot(snapshot, dir) )
+  {
+    std::cerr << i18n("Could not restore all files of %1:\n%2", snapshot, store.errorString()).toUtf8().constData() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+//--------------------------------------------------------------------------------
+
 int main(int argc, char **argv)
 {
   QScopedPointer<QCoreApplication> app(new QCoreApplication(argc, argv));
@@ -75,13 +155,50 @@ int main(int argc, char **argv)
   cmdLine.addOption(QCommandLineOption(QStringLiteral("verbose"), i18n("In autobg mode be verbose and print every "
                                                        "single filename during backup.")));
 
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("target"), i18n("In autobg mode write the backup into this directory "
+                                                      "instead of the one in the profile. With '-' or a FIFO "
+                                                      "all slices are written one after the other into this stream."),
+                                       QStringLiteral("dir|-|fifo")));
+
   cmdLine.addOption(QCommandLineOption(QStringLiteral("forceFull"), i18n("In auto/autobg mode force the backup to be a full backup "
                                                          "instead of acting on the profile settings.")));
 
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("lookup"), i18n("Print all backups of the given profile which hold the file, "
+                                                     "as found in the catalog of the profile, and terminate."), QStringLiteral("file")));
+
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("restore"), i18n("Restore all files of the given snapshot of a chunk repository "
+                                                      "into the directory given as argument, and terminate."), QStringLiteral("snapshot")));
+
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("compressBuffer"), i18n("Size of the memory buffer per compressed file. "
+                                                              "Larger compressed files are stored in a temporary file "
+                                                              "(default: 16 MB)."), QStringLiteral("MB")));
+
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("bufferSize"), i18n("Size of the buffer used to read and write file content. "
+                                                          "It is rounded up to the block size of the device "
+                                                          "(default: 4096 KB)."), QStringLiteral("KB")));
+
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("readAhead"), i18n("Maximum amount of data read ahead from a large file "
+                                                         "while the archive is written (default: 32 MB)."), QStringLiteral("MB")));
+
+  cmdLine.addOption(QCommandLineOption(QStringLiteral("scanThreads"), i18n("Number of threads reading directories ahead of the archive "
+                                                           "(default: 4, 0 = no extra threads)."), QStringLiteral("N")));
+
   about.setupCommandLine(&cmdLine);
   cmdLine.process(*app);
   about.processCommandLine(&cmdLine);
 
+  if ( cmdLine.isSet(QStringLiteral("lookup")) )
+  {
+    QString profile = cmdLine.positionalArguments().value(0);
+    if ( profile.isEmpty() )
+      profile = cmdLine.value(QStringLiteral("autobg"));
+
+    return lookupFile(cmdLine.value(QStringLiteral("lookup")), profile);
+  }
+
+  if ( cmdLine.isSet(QStringLiteral("restore")) )
+    return restoreSnapshot(cmdLine.value(QStringLiteral("restore")), cmdLine.positionalArguments().value(0));
+
   bool interactive = !cmdLine.isSet(QStringLiteral("autobg"));
 
   if ( interactive )
@@ -113,6 +230,30 @@ int main(int argc, char **argv)
   if ( file.length() )
     Archiver::sliceScript = file;
 
+  if ( cmdLine.isSet(QStringLiteral("bufferSize")) )
+  {
+    int kb = cmdLine.value(QStringLiteral("bufferSize")).toInt();
+    if ( kb > 0 )
+      IoBuffer::defaultSize = static_cast<qint64>(kb) * 1024;
+  }
+
+  if ( cmdLine.isSet(QStringLiteral("readAhead")) )
+  {
+    int mb = cmdLine.value(QStringLiteral("readAhead")).toInt();
+    if ( mb > 0 )
+      FileReader::maxInFlight = static_cast<qint64>(mb) * 1024 * 1024;
+  }
+
+  if ( cmdLine.isSet(QStringLiteral("scanThreads")) )
+    DirScanner::numThreads = qBound(0, cmdLine.value(QStringLiteral("scanThreads")).toInt(), 64);
+
+  if ( cmdLine.isSet(QStringLiteral("compressBuffer")) )
+  {
+    // QByteArray can not hold more than 2GB
+    qint64 mb = qBound(0, cmdLine.value(QStringLiteral("compressBuffer")).toInt(), 1024);
+    Archiver::compressBufferSize = mb * 1024 * 1024;
+  }
+
   if ( interactive )
   {
     QString profile;
@@ -157,6 +298,20 @@ int main(int argc, char **argv)
       if ( cmdLine.isSet(QStringLiteral("forceFull")) )
         Archiver::instance->setForceFullBackup();
 
+      // the profile's target may be a FIFO, too
+      QString target = cmdLine.value(QStringLiteral("target"));
+      if ( target.isEmpty() && Archiver::instance->getTarget().isLocalFile() )
+        target = Archiver::instance->getTarget().toLocalFile();
+
+      if ( Archiver::isPipe(target) )
+      {
+        // a reader which went away shall give a write error and not kill us
+        signal(SIGPIPE, SIG_IGN);
+        Archiver::instance->setPipeTarget(target);
+      }
+      else if ( cmdLine.isSet(QStringLiteral("target")) )
+        Archiver::instance->setTarget(QUrl::fromLocalFile(QFileInfo(target).absoluteFilePath()));
+
       if ( Archiver::instance->createArchive(includes, excludes) )
         return 0;
       else